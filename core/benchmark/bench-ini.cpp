@@ -0,0 +1,183 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Throughput benchmark for core::ini::file.
+// Generates ini files from 1 KB up to 100 MB with different section sizes, continuation line and
+// comment densities and reports the parse throughput and the number of heap allocations, both
+// for the default memory resource and for a monotonic arena.
+// Usage: bench-ini [max-size-in-bytes]
+#include <core/ini.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    std::size_t allocation_count{0};
+
+    struct profile {
+        char const* name;
+        int properties_per_section;
+        int continuation_every;     //!< every n-th property is continued on a second line (0 = none)
+        int comment_every;          //!< a comment line after every n-th property (0 = none)
+    };
+
+    struct text {
+        std::string content{};
+        std::size_t sections{0};
+    };
+
+    text generate(profile const& p, std::size_t size)
+    {
+        text t;
+        t.content.reserve(size + 256);
+        int property{0};
+        while (t.content.size() < size) {
+            t.content += "[gpio = gpiochip0-" + std::to_string(t.sections) + "]\n";
+            ++t.sections;
+            for (int i = 0; i < p.properties_per_section; ++i, ++property) {
+                t.content += "property-" + std::to_string(i) + " = \"value of property " + std::to_string(property);
+                if (p.continuation_every > 0 && property % p.continuation_every == 0) {
+                    t.content += " \\\n    continued";
+                }
+                t.content += "\"\n";
+                if (p.comment_every > 0 && property % p.comment_every == 0) {
+                    t.content += "# comment line for property " + std::to_string(property) + "\n";
+                }
+            }
+            t.content += "\n";
+        }
+        return t;
+    }
+
+    struct result {
+        double seconds;
+        std::size_t allocations;
+    };
+
+    //! Parses the content, with use_arena set the file is parsed into a monotonic arena
+    result parse(std::string const& content, bool use_arena)
+    {
+        std::istringstream input{content};
+        auto allocations_before = allocation_count;
+        auto start = std::chrono::steady_clock::now();
+        std::pmr::monotonic_buffer_resource arena{};
+        core::ini::file f{input, true, use_arena ? &arena : std::pmr::get_default_resource()};
+        auto stop = std::chrono::steady_clock::now();
+        auto allocations = allocation_count - allocations_before;
+        if (f.sections().empty()) {
+            std::abort();
+        }
+        return result{std::chrono::duration<double>(stop - start).count(), allocations};
+    }
+
+} // namespace
+
+// Counting replacements of the global allocation functions.
+// GCC >= 11 reports malloc/free in replaced new/delete as mismatched when they get inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// std::pmr::new_delete_resource allocates with the aligned variants
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++allocation_count;
+    auto align = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+int main(int argc, char* argv[])
+{
+    std::size_t max_size{100u * 1024u * 1024u};
+    if (argc > 1) {
+        max_size = std::strtoul(argv[1], nullptr, 10);
+    }
+
+    const std::vector<profile> profiles{
+        {"narrow", 2, 0, 0},
+        {"wide", 32, 0, 0},
+        {"continued", 8, 2, 0},
+        {"commented", 8, 0, 1},
+        {"mixed", 8, 4, 3},
+    };
+
+    std::printf("%-10s %12s %10s %6s %10s %10s %14s\n",
+                "profile", "bytes", "sections", "memory", "ms", "MB/s", "allocs/section");
+    for (auto const& p : profiles) {
+        for (std::size_t size = 1024; size <= max_size; size *= 10) {
+            auto t = generate(p, size);
+            for (bool use_arena : {false, true}) {
+                // repeat small inputs to get a stable measurement, keep the best run
+                int runs = size < 1024u * 1024u ? 20 : 1;
+                result best{1e9, 0};
+                for (int run = 0; run < runs; ++run) {
+                    auto r = parse(t.content, use_arena);
+                    if (r.seconds < best.seconds) {
+                        best = r;
+                    }
+                }
+                auto bytes = static_cast<double>(t.content.size());
+                std::printf("%-10s %12zu %10zu %6s %10.3f %10.1f %14.2f\n",
+                            p.name, t.content.size(), t.sections, use_arena ? "arena" : "heap",
+                            best.seconds * 1e3, bytes / best.seconds / 1e6,
+                            static_cast<double>(best.allocations) / static_cast<double>(t.sections));
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// libFuzzer target for core::ini::file.
+// Build with -DOPT_FUZZING=ON using clang and run e.g.
+//     ./fuzz-ini_file -max_len=4096 ../core/fuzzing/corpus
+#include <core/ini.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const* data, std::size_t size)
+{
+    std::string text(reinterpret_cast<char const*>(data), size);
+    for (bool remove_quotes : {true, false}) {
+        std::istringstream input{text};
+        try {
+            core::ini::file f{input, remove_quotes};
+
+            // line numbers must be positive and increase monotonically
+            int last_line{0};
+            for (auto const& s : f.sections()) {
+                if (!s.name.empty()) {
+                    if (s.line_number <= last_line) {
+                        std::abort();
+                    }
+                    last_line = s.line_number;
+                }
+                for (auto const& p : s.properties) {
+                    if (p.line_number <= last_line || p.name.empty()) {
+                        std::abort();
+                    }
+                    last_line = p.line_number;
+                }
+            }
+
+            // merging a file with itself keeps all named sections twice
+            auto merged = core::ini::merge_files(std::vector<core::ini::file>{f, f});
+            std::size_t named{0};
+            for (auto const& s : f.sections()) {
+                named += s.name.empty() ? 0u : 1u;
+            }
+            std::size_t merged_named{0};
+            for (auto const& s : merged.sections()) {
+                merged_named += s.name.empty() ? 0u : 1u;
+            }
+            if (merged_named != 2 * named) {
+                std::abort();
+            }
+        }
+        catch (core::ini::parse_exception const&) {
+            // syntax errors are expected
+        }
+        catch (std::runtime_error const&) {
+            // unexpected end of file after a continuation line
+        }
+    }
+    return 0;
+}
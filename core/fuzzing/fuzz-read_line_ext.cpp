@@ -0,0 +1,52 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// libFuzzer target for core::ini::read_line_ext.
+// Build with -DOPT_FUZZING=ON using clang and run e.g.
+//     ./fuzz-read_line_ext -max_len=4096 ../core/fuzzing/corpus
+#include <core/ini.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(std::uint8_t const* data, std::size_t size)
+{
+    std::string text(reinterpret_cast<char const*>(data), size);
+    std::istringstream input{text};
+    try {
+        long total_lines{0};
+        while (input.good()) {
+            auto [line, line_count] = core::ini::read_line_ext(input);
+            // every call has to make progress until the end of the stream is reached
+            if (line_count <= 0 && !input.eof()) {
+                std::abort();
+            }
+            if (line.find('\n') != std::string::npos) {
+                std::abort();
+            }
+            total_lines += line_count;
+        }
+        if (total_lines > static_cast<long>(size) + 1) {
+            std::abort();
+        }
+    }
+    catch (std::runtime_error const&) {
+        // unexpected end of file after a continuation line
+    }
+    return 0;
+}
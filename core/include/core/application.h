@@ -15,8 +15,18 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
+#include <core/event_thread.h>
+#include <core/journal.h>
+#include <core/loop_monitor.h>
+#include <core/scheduler.h>
 #include <core/sd_event_loop.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace core {
 
     //! \brief Application base class that initialises sd-event loop and signals.
@@ -47,8 +57,39 @@ namespace core {
         //! \note The application uses always the thread's default sd_event.
         sd_event_loop const& get_sd_event() const;
 
+        //! Returns the scheduler that assigns event sources of the loop to priority classes.
+        event_scheduler& scheduler() noexcept;
+
+        //! Returns the monitor of the loop's iteration times and timer lateness. Its summary is sent
+        //! to systemd as STATUS every 10 seconds while the loop runs.
+        loop_monitor& monitor() noexcept;
+
+        //! Returns the queue that runs tasks posted by worker threads on the application's loop.
+        task_queue& tasks() noexcept;
+
+        //! Starts worker threads with their own sd-event loops. The pools are stopped after the
+        //! loop of the application returned and before post_run is called, while the terminating
+        //! signals are still blocked.
+        event_pool& create_pool(std::string const& name, std::size_t threads);
+
+        //! Returns the writer installed for core::log while the application exists.
+        journal_writer& journal() noexcept;
+
     private:
+        void stop_pools() noexcept;
+        //! sd_event_loop with every dispatch reported to the monitor.
+        int run_loop();
+        void start_status_updates();
+
+        static int gdc_status_timer_handler(sd_event_source* s, std::uint64_t usec, void* userdata);
+
+        journal_writer _journal;    // first, entries of the other members' dtors are still sent
         sd_event_loop _sd_event_loop;
+        loop_monitor _monitor{};
+        event_scheduler _scheduler;
+        sd_event_source* _status_source{nullptr};
+        task_queue _tasks;
+        std::vector<std::unique_ptr<event_pool>> _pools{};
     };
 
 } // namespace core
@@ -18,6 +18,7 @@
 #include <core/application.h>
 #include <systemd/sd-bus.h>
 #include <string>
+#include <vector>
 
 namespace core {
 
@@ -29,7 +30,10 @@ namespace core {
     class dbus_application : public core::application
     {
     public:
-        explicit dbus_application(DBusType dbus_type_, std::string connection_name = std::string{});
+        //! Connects to the bus; when peer_socket is not empty a UNIX socket is created at that path
+        //! which accepts direct peer-to-peer connections when run() is called.
+        explicit dbus_application(DBusType dbus_type_, std::string connection_name = std::string{},
+                                  std::string peer_socket = std::string{});
         ~dbus_application();
 
         dbus_application(dbus_application const&) = delete;
@@ -43,10 +47,38 @@ namespace core {
 
         sd_bus* bus() const;
 
+        //! Connections of peers on the peer socket; they have no bus names.
+        std::vector<sd_bus*> const& peers() const;
+
+        //! Registers the vtable on the bus and on every current and future peer connection.
+        //! The slot of the bus registration is returned in slot, peer registrations live as
+        //! long as the peer connection.
+        int add_object_vtable(sd_bus_slot** slot, char const* path, char const* interface,
+                              sd_bus_vtable const* vtable, void* userdata);
+
     private:
+        struct object_vtable {
+            std::string path;
+            std::string interface;
+            sd_bus_vtable const* vtable;
+            void* userdata;
+        };
+
+        void listen_peers();
+        void close_peers();
+        static int accept_peer_handler(sd_event_source* s, int fd, uint32_t revents, void* userdata);
+        static int peer_disconnected_handler(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+        int add_peer(int fd);
+
         DBusType _dbus_type;
         sd_bus *_sd_bus{nullptr};
         std::string _connection_name;
+        std::string _peer_socket;
+        int _peer_listen_fd{-1};
+        sd_event_source* _peer_listen_source{nullptr};
+        sd_id128_t _peer_server_id{};
+        std::vector<sd_bus*> _peers{};
+        std::vector<object_vtable> _vtables{};
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/sd_event_loop.h>
+
+#include <systemd/sd-event.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+    //! Runs tasks posted from any thread on the thread of an sd-event loop.
+    //! Tasks are pushed to a lock-free list and the loop is woken by an eventfd; a wake-up is
+    //! written only when the list was empty, a burst of posts costs one write and one read.
+    //! Tasks run in the order they were posted. An exception thrown by a task is logged and
+    //! does not affect the following tasks.
+    class task_queue
+    {
+    public:
+        using task = std::function<void()>;
+
+        //! Adds the eventfd to the loop; must be called on the thread that runs the loop.
+        explicit task_queue(sd_event_loop loop, std::int64_t priority = SD_EVENT_PRIORITY_NORMAL);
+        //! Tasks not run yet are dropped.
+        ~task_queue();
+
+        task_queue(task_queue const&) = delete;
+        task_queue& operator=(task_queue const&) = delete;
+
+        //! Queues the task; may be called from any thread.
+        void post(task t);
+
+    private:
+        struct node {
+            task fn;
+            node* next;
+        };
+
+        void run_pending();
+
+        static int gdc_wakeup_handler(sd_event_source* s, int fd, std::uint32_t revents, void* userdata);
+
+        sd_event_loop _loop;
+        int _fd{-1};
+        sd_event_source* _source{nullptr};
+        std::atomic<node*> _head{nullptr};
+    };
+
+    //! Worker thread running its own sd-event loop.
+    //! The worker blocks all signals, so the signals handled by the main loop are never
+    //! delivered to it.
+    class event_thread
+    {
+    public:
+        //! Starts the thread and returns after its loop is set up.
+        //! @param name     thread name, truncated to 15 characters
+        //! @throws core::runtime_exception     Thrown when the loop cannot be set up.
+        explicit event_thread(std::string name);
+        ~event_thread();
+
+        event_thread(event_thread const&) = delete;
+        event_thread& operator=(event_thread const&) = delete;
+
+        //! Runs the task on the worker thread; may be called from any thread until stop is called.
+        void post(task_queue::task t);
+
+        //! Runs the tasks posted so far, leaves the loop and joins the thread. Tasks posted later
+        //! are dropped. Sources the tasks added to the loop must be released by a task before stop.
+        void stop();
+
+        //! The loop of the worker, sources must only be added to it from tasks.
+        sd_event_loop const& loop() const noexcept;
+
+        std::string const& name() const noexcept;
+
+    private:
+        void run(std::promise<void>& started);
+
+        std::string _name;
+        std::unique_ptr<sd_event_loop> _loop{};
+        std::unique_ptr<task_queue> _tasks{};
+        std::thread _thread{};
+    };
+
+    //! Fixed number of event threads; posted tasks are distributed round-robin.
+    class event_pool
+    {
+    public:
+        //! Starts the threads named <name>-<index>.
+        event_pool(std::string const& name, std::size_t threads);
+        ~event_pool();
+
+        event_pool(event_pool const&) = delete;
+        event_pool& operator=(event_pool const&) = delete;
+
+        std::size_t size() const noexcept;
+        event_thread& operator[](std::size_t index) noexcept;
+
+        //! Runs the task on the next thread; tasks that must run in order are posted to one thread.
+        void post(task_queue::task t);
+
+        //! Stops all threads, see event_thread::stop.
+        void stop();
+
+    private:
+        std::vector<std::unique_ptr<event_thread>> _threads{};
+        std::atomic<std::size_t> _next{0};
+    };
+
+} // namespace core
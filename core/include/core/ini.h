@@ -15,9 +15,15 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
+#include <cstdint>
 #include <exception>
+#include <initializer_list>
 #include <istream>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace core::ini {
@@ -51,45 +57,143 @@ namespace core::ini {
 
     //! Property of an ini-file.
     //! Properties have a name (string) and a value.
+    //! The strings are allocated from the memory resource the owning file was parsed with.
     struct property {
-        std::string name{};     //!< name of the property
-        std::string value{};    //!< value for the property (maybe empty)
-        int line_number{};     //!< line number for diagnostics
+        std::pmr::string name{};     //!< name of the property
+        std::pmr::string value{};    //!< value for the property (maybe empty)
+        int line_number{};          //!< line number for diagnostics
+    };
+
+    //! Open addressing hash index from names to element positions.
+    //! The index stores only positions and hashes; names are looked up through the name_of
+    //! function object, so the index stays valid when the indexed elements are copied or moved.
+    class name_index {
+    public:
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        name_index() = default;
+        explicit name_index(std::pmr::memory_resource* resource);
+
+        //! Indexes count elements, name_of(i) returns the name of the i-th element.
+        //! For duplicate names the first position is indexed.
+        template<typename NameOf>
+        void build(std::size_t count, NameOf name_of);
+
+        //! Returns the position of the element with the name or npos.
+        template<typename NameOf>
+        std::size_t find(std::string_view name, NameOf name_of) const;
+
+        void clear();
+
+        //! Returns the number of elements the index was built for.
+        std::size_t size() const;
+
+        //! Returns whether the index was built.
+        bool built() const;
+
+    private:
+        struct slot {
+            std::uint32_t hash{};
+            std::uint32_t position{};   //!< position + 1, 0 for an empty slot
+        };
+
+        static std::uint32_t hash(std::string_view name);
+
+        std::pmr::vector<slot> _slots{};
+        std::size_t _size{0};
     };
 
     //! Section of an ini-file
     //! Sections are named and can have a value like an ini-file property.
     //! Furthermore a section has an ordered list of properties
     struct section : public property {
-        std::vector<property> properties{};
+        std::pmr::vector<property> properties{};
+
+        //! Optional index of the property names used by find, built by build_index.
+        //! When the properties are changed after building the index, find falls back to linear
+        //! search until the index is rebuilt.
+        name_index index{};
+
+        //! Builds the property name index.
+        void build_index();
+
+        //! Returns the first property with the name or nullptr.
+        property const* find(std::string_view name) const;
+
+        //! Returns the converted value of the property or std::nullopt if the property does not exist.
+        //! Supported types are std::string, bool (true|false), int and unsigned.
+        //! @throws     parse_exception     Thrown when the value cannot be converted; the exception
+        //!                                 carries the line number and expression of the property.
+        template<typename T>
+        std::optional<T> get(std::string_view name) const;
+
+        //! Returns the converted value of the property or def_value if the property does not exist.
+        //! @throws     parse_exception     Thrown when the value cannot be converted.
+        template<typename T>
+        T get(std::string_view name, T const& def_value) const;
+
+        //! Returns the enumeration value the property value maps to or def_value if the property
+        //! does not exist.
+        //! @throws     parse_exception     Thrown when the value is not one of the given values.
+        template<typename T>
+        T get_enum(std::string_view name, std::initializer_list<std::pair<std::string_view, T>> values,
+                   T const& def_value) const;
     };
 
     //! Represent an ini-file parsed from an istream.
     class file {
     public:
         file();
-        explicit file(std::istream& str, bool remove_value_quotes = true);
+
+        //! Parses the ini-file from the stream.
+        //! All sections, properties and their strings as well as the temporary line buffers
+        //! are allocated from the memory resource. Passing a std::pmr::monotonic_buffer_resource
+        //! turns the parse into a few (or with a sufficiently large initial buffer no) heap
+        //! allocations. The memory resource must outlive the file and all sections moved out of it;
+        //! copies of the file allocate from the default memory resource.
+        explicit file(std::istream& str, bool remove_value_quotes = true,
+                      std::pmr::memory_resource* resource = std::pmr::get_default_resource());
         ~file();
 
         file(file const&) = default;
         file& operator=(file const&) = default;
+        file(file&&) noexcept = default;
+        file& operator=(file&&) = default;
 
         //! Returns the vector of all sections
-        std::vector<section> const& sections() const;
+        std::pmr::vector<section> const& sections() const;
+
+        //! Returns the sections with the name in the order of the file.
+        std::vector<section const*> sections(std::string_view name) const;
+
+        //! Builds the section name index and the property index of every section.
+        void build_index();
 
     private:
-        std::vector<section> _sections{};
+        std::pmr::vector<section> _sections{};
+
+        //! Maps a section name to its group in _section_groups.
+        name_index _section_index{};
+        //! Per distinct section name the range [offset, offset + count) in _section_order.
+        std::pmr::vector<std::pair<std::uint32_t, std::uint32_t>> _section_groups{};
+        //! Section positions grouped by name and ordered by their position in the file.
+        std::pmr::vector<std::uint32_t> _section_order{};
 
         template<typename T> friend file merge_files(T const&);
+        friend file merge_files(std::vector<file>&&);
     };
 
-//    template<typename T>
-//    file merge_files(T const& list_of_files);
+    //! Merges the files into one file by moving their sections.
+    //! The properties of the root sections are merged into one leading root section, all named
+    //! sections follow in the order of the files. The moved sections keep the memory resource of
+    //! their source file.
+    file merge_files(std::vector<file>&& list_of_files);
 
     class parse_exception : public std::exception
     {
     public:
-        explicit parse_exception(int line_number, std::string expr = std::string{});
+        explicit parse_exception(int line_number, std::string expr = std::string{},
+                                 std::string source = std::string{});
         ~parse_exception() override;
 
         const char* what() const noexcept override;
@@ -98,13 +202,94 @@ namespace core::ini {
 
         int line_number() const noexcept;
 
+        //! Returns the name of the parsed source (e.g. the file path) if known, otherwise an empty string.
+        std::string const& source() const noexcept;
+
     private:
         std::string _expression;
         int _line_number;
+        std::string _source;
     };
 
 }
 
+namespace core::ini {
+    template<> std::optional<std::string> section::get<std::string>(std::string_view name) const;
+    template<> std::optional<bool> section::get<bool>(std::string_view name) const;
+    template<> std::optional<int> section::get<int>(std::string_view name) const;
+    template<> std::optional<unsigned> section::get<unsigned>(std::string_view name) const;
+}
+
+template<typename NameOf>
+void core::ini::name_index::build(std::size_t count, NameOf name_of)
+{
+    std::size_t capacity{8};
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    _slots.assign(capacity, slot{});
+    _size = count;
+    auto mask = capacity - 1;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string_view name{name_of(i)};
+        auto h = hash(name);
+        for (auto pos = h & mask; ; pos = (pos + 1) & mask) {
+            auto& s = _slots[pos];
+            if (s.position == 0) {
+                s.hash = h;
+                s.position = static_cast<std::uint32_t>(i + 1);
+                break;
+            }
+            if (s.hash == h && std::string_view{name_of(s.position - 1)} == name) {
+                break; // duplicate, keep first position
+            }
+        }
+    }
+}
+
+template<typename NameOf>
+std::size_t core::ini::name_index::find(std::string_view name, NameOf name_of) const
+{
+    if (_slots.empty()) {
+        return npos;
+    }
+    auto mask = _slots.size() - 1;
+    auto h = hash(name);
+    for (auto pos = h & mask; ; pos = (pos + 1) & mask) {
+        auto const& s = _slots[pos];
+        if (s.position == 0) {
+            return npos;
+        }
+        if (s.hash == h && std::string_view{name_of(s.position - 1)} == name) {
+            return s.position - 1;
+        }
+    }
+}
+
+template<typename T>
+T core::ini::section::get(std::string_view name, T const& def_value) const
+{
+    auto value = get<T>(name);
+    return value ? *value : def_value;
+}
+
+template<typename T>
+T core::ini::section::get_enum(std::string_view name,
+                               std::initializer_list<std::pair<std::string_view, T>> values,
+                               T const& def_value) const
+{
+    auto p = find(name);
+    if (!p) {
+        return def_value;
+    }
+    for (auto const& v : values) {
+        if (v.first == p->value) {
+            return v.second;
+        }
+    }
+    throw parse_exception{p->line_number, std::string{std::string_view{p->name}}.append(" = ").append(p->value)};
+}
+
 template<typename T>
 core::ini::file core::ini::merge_files(T const& list_of_files)
 {
@@ -0,0 +1,136 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/token_bucket.h>
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace core {
+
+    //! Structured fields of a journal entry; null strings and an error of 0 are not sent.
+    struct log_fields {
+        char const* line{nullptr};      //!< LINE=
+        char const* chip{nullptr};      //!< CHIP=
+        int error{0};                   //!< ERRNO=
+    };
+
+    //! A formatted journal entry as kept in the ring; longer strings are truncated.
+    struct log_record {
+        int priority;
+        int error;
+        char line[64];
+        char chip[32];
+        char message[256];
+    };
+
+    bool operator==(log_record const& a, log_record const& b) noexcept;
+
+    //! Writes journal entries on a background thread.
+    //! Callers format into a fixed-size lock-free ring and never block on the journal; the
+    //! thread is woken by an eventfd that is written only when the ring was drained before.
+    //! The thread sends every entry with sd_journal_sendv and its structured fields. Identical
+    //! entries in a row are folded into one "repeated N times" entry per window, entries above
+    //! the rate are counted and reported in one summary. Entries that find the ring full are
+    //! dropped and counted as well.
+    class journal_writer
+    {
+    public:
+        //! Receives every entry to send, repeated is 0 or the count of a folded run.
+        using sink_fn = std::function<void(log_record const& record, unsigned repeated)>;
+
+        struct options {
+            std::size_t capacity{256};          //!< ring entries, rounded up to a power of two
+            unsigned rate{50};                  //!< entries per second, 0 for no limit
+            unsigned burst{200};                //!< entries in a row before the rate applies
+            std::uint64_t repeat_window{5000000};   //!< usec identical entries are folded
+        };
+
+        //! Starts the thread; the default sink sends to the journal.
+        //! @throws core::runtime_exception     Thrown when the eventfd cannot be created.
+        explicit journal_writer(options const& opts, sink_fn sink = {});
+        journal_writer();
+        //! Sends the remaining entries and stops the thread.
+        ~journal_writer();
+
+        journal_writer(journal_writer const&) = delete;
+        journal_writer& operator=(journal_writer const&) = delete;
+
+        //! Formats and queues an entry; may be called from any thread, never blocks.
+        void log(int priority, log_fields const& fields, char const* format, ...) noexcept
+            __attribute__((format(printf, 4, 5)));
+        void vlog(int priority, log_fields const& fields, char const* format, va_list args) noexcept;
+
+        //! Entries dropped because the ring was full.
+        std::uint64_t dropped() const noexcept;
+
+        //! Entries not sent because of the rate limit.
+        std::uint64_t suppressed() const noexcept;
+
+        //! Sends a record with sd_journal_sendv.
+        static void send(log_record const& record, unsigned repeated) noexcept;
+
+    private:
+        struct slot {
+            std::atomic<std::size_t> sequence;
+            log_record record;
+        };
+
+        void run() noexcept;
+        bool pop(log_record& record) noexcept;
+        void process(log_record const& record, std::uint64_t now) noexcept;
+        void emit(log_record const& record, std::uint64_t now) noexcept;
+        void end_run() noexcept;
+        //! Sends the number of entries lost since the last report when a token is available.
+        void report_losses(std::uint64_t now, bool force = false) noexcept;
+
+        options _options;
+        sink_fn _sink;
+        std::unique_ptr<slot[]> _slots;
+        std::size_t _mask;
+        int _fd{-1};
+        alignas(64) std::atomic<std::size_t> _head{0};     //!< next slot to write
+        alignas(64) std::atomic<bool> _wakeup{false};      //!< an eventfd write is pending
+        std::atomic<std::uint64_t> _dropped{0};
+        std::atomic<std::uint64_t> _suppressed{0};
+        std::atomic<bool> _stop{false};
+
+        // thread state
+        std::size_t _tail{0};
+        token_bucket _bucket;
+        log_record _last{};
+        bool _have_last{false};
+        unsigned _repeats{0};
+        std::uint64_t _run_start{0};
+        std::uint64_t _dropped_reported{0};
+        std::uint64_t _suppressed_reported{0};
+        std::thread _thread{};
+    };
+
+    //! Installs the writer used by log, nullptr reverts to synchronous sd_journal_sendv.
+    void set_journal(journal_writer* writer) noexcept;
+
+    //! Logs through the installed journal_writer.
+    void log(int priority, log_fields const& fields, char const* format, ...) noexcept
+        __attribute__((format(printf, 3, 4)));
+
+} // namespace core
@@ -0,0 +1,97 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct sd_event_source;
+
+namespace core {
+
+    //! Distribution of durations in microseconds over power-of-two buckets.
+    //! Bucket i counts durations below 2^i us, the last bucket all longer durations.
+    class latency_histogram
+    {
+    public:
+        static constexpr std::size_t bucket_count{26};
+
+        void record(std::uint64_t usec) noexcept;
+
+        std::uint64_t count() const noexcept;
+        std::uint64_t sum() const noexcept;
+        std::uint64_t max() const noexcept;
+        std::array<std::uint64_t, bucket_count> const& buckets() const noexcept;
+
+        //! Upper bound of the bucket that holds the quantile q in [0, 1], never above max().
+        std::uint64_t quantile(double q) const noexcept;
+
+        //! Exclusive upper bound of the bucket in microseconds, UINT64_MAX for the last bucket.
+        static std::uint64_t upper_bound(std::size_t bucket) noexcept;
+
+    private:
+        std::array<std::uint64_t, bucket_count> _buckets{};
+        std::uint64_t _count{0};
+        std::uint64_t _sum{0};
+        std::uint64_t _max{0};
+    };
+
+    //! Measures the busy time of every loop iteration and the lateness of timers.
+    //! The event_scheduler reports the duration of each handler it dispatches, an iteration
+    //! above the threshold is logged with its slowest handler.
+    class loop_monitor
+    {
+    public:
+        //! Iterations longer than usec are logged, 0 disables the log.
+        void set_threshold(std::uint64_t usec) noexcept;
+        std::uint64_t threshold() const noexcept;
+
+        //! Watchdog interval of the service, 0 if the watchdog is disabled.
+        void set_watchdog_interval(std::uint64_t usec) noexcept;
+
+        void begin_iteration() noexcept;
+        void end_iteration(std::uint64_t usec) noexcept;
+
+        //! Called after a handler of the source returned.
+        void handler_done(sd_event_source* s, std::uint64_t usec) noexcept;
+        //! Called before a timer is dispatched with the time it elapsed after its deadline.
+        void timer_dispatched(std::uint64_t lateness_usec) noexcept;
+
+        latency_histogram const& iterations() const noexcept;
+        latency_histogram const& lateness() const noexcept;
+        //! Number of iterations above the threshold.
+        std::uint64_t stalls() const noexcept;
+
+        //! One line summary for sd_notify STATUS.
+        std::string status() const;
+
+    private:
+        latency_histogram _iterations{};
+        latency_histogram _lateness{};
+        std::uint64_t _threshold{0};
+        std::uint64_t _watchdog_usec{0};
+        std::uint64_t _stalls{0};
+        std::uint64_t _slowest_usec{0};
+        bool _slowest_found{false};
+        std::array<char, 64> _slowest{};
+    };
+
+    //! Current CLOCK_MONOTONIC time in microseconds.
+    std::uint64_t monotonic_usec() noexcept;
+
+} // namespace core
@@ -0,0 +1,38 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <vector>
+
+namespace core {
+
+    //! Calls fn(i) for every i in [0, count) on up to std::thread::hardware_concurrency threads,
+    //! the calling thread included, and returns after all calls finished.
+    //! Indices are handed out in ascending order. Exceptions do not cross threads; the exception
+    //! thrown by fn(i) is returned at position i, positions of calls that returned are empty.
+    //! When a thread cannot be started the calls are shared among the threads started so far and
+    //! the calling thread.
+    std::vector<std::exception_ptr> for_each_parallel(std::size_t count, std::function<void(std::size_t)> const& fn);
+
+    //! Same as for_each_parallel but starts a thread for every index (up to max_threads), for
+    //! calls that block on I/O rather than use the CPU.
+    std::vector<std::exception_ptr> for_each_parallel(std::size_t count, std::size_t max_threads,
+                                                      std::function<void(std::size_t)> const& fn);
+
+} // namespace core
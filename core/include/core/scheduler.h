@@ -0,0 +1,108 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/sd_event_loop.h>
+#include <core/token_bucket.h>
+
+#include <systemd/sd-event.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace core {
+
+    class loop_monitor;
+
+    //! Priority classes of event sources; when sources of several classes are pending, the
+    //! realtime class is dispatched first and housekeeping last.
+    enum class priority_class {
+        realtime,       //!< hardware I/O and pulse timers
+        bus,            //!< DBus connections and requests
+        housekeeping,   //!< periodic checks, background work, statistics
+    };
+
+    //! Registers event sources in priority classes and enforces a rate limit per class.
+    //! All sources of a class share one token bucket. A source dispatched while its class has no
+    //! token left is disabled and enabled again as soon as a token is available, so a pending I/O
+    //! event or an elapsed timer is delayed but never lost.
+    //! The userdata of the sd_event_source belongs to the scheduler, callbacks get the userdata
+    //! passed to add_io, add_time or add_defer.
+    class event_scheduler
+    {
+    public:
+        explicit event_scheduler(sd_event_loop loop);
+        ~event_scheduler();
+
+        event_scheduler(event_scheduler const&) = delete;
+        event_scheduler& operator=(event_scheduler const&) = delete;
+
+        //! Returns the sd-event priority of the class.
+        static std::int64_t priority(priority_class cls) noexcept;
+
+        //! Limits the dispatches of all sources of the class; a rate of 0 removes the limit.
+        void set_rate_limit(priority_class cls, unsigned rate, unsigned burst);
+
+        //! Number of dispatches of the class delayed by its rate limit.
+        std::uint64_t throttled(priority_class cls) const noexcept;
+
+        //! Reports the duration of every dispatched handler and the lateness of timers to the
+        //! monitor; nullptr stops the reports.
+        void set_monitor(loop_monitor* monitor) noexcept;
+
+        //! Like sd_event_add_io, the source gets the priority of the class.
+        int add_io(priority_class cls, sd_event_source** s, int fd, std::uint32_t events,
+                   sd_event_io_handler_t callback, void* userdata);
+
+        //! Like sd_event_add_time, the source gets the priority of the class.
+        int add_time(priority_class cls, sd_event_source** s, clockid_t clock, std::uint64_t usec,
+                     std::uint64_t accuracy, sd_event_time_handler_t callback, void* userdata);
+
+        //! Like sd_event_add_defer, the source gets the priority of the class.
+        int add_defer(priority_class cls, sd_event_source** s, sd_event_handler_t callback, void* userdata);
+
+    private:
+        struct registration;
+
+        struct class_state {
+            token_bucket bucket{};
+            std::vector<registration*> parked{};
+            sd_event_source* resume_source{nullptr};
+            std::uint64_t throttled{0};
+        };
+
+        int add(registration* reg, sd_event_source* source, sd_event_source** s);
+        bool admit(registration& reg);
+        void park(registration& reg, std::uint64_t now);
+        void timer_lateness(registration& reg, std::uint64_t deadline);
+
+        template<typename Fn>
+        static int dispatch(registration& reg, Fn&& fn);
+
+        static int io_handler(sd_event_source* s, int fd, std::uint32_t revents, void* userdata);
+        static int time_handler(sd_event_source* s, std::uint64_t usec, void* userdata);
+        static int defer_handler(sd_event_source* s, void* userdata);
+        static int resume_handler(sd_event_source* s, std::uint64_t usec, void* userdata);
+        static void destroy_handler(void* userdata);
+
+        sd_event_loop _loop;
+        std::array<class_state, 3> _classes{};
+        std::vector<registration*> _registrations{};
+        loop_monitor* _monitor{nullptr};
+    };
+
+} // namespace core
@@ -0,0 +1,51 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstdint>
+
+namespace core {
+
+    //! Token bucket rate limiter on a microsecond clock.
+    //! Tokens are refilled continuously with rate tokens per second, at most burst tokens are saved.
+    //! The bucket starts full.
+    class token_bucket
+    {
+    public:
+        //! A rate of 0 disables the limit.
+        explicit token_bucket(unsigned rate = 0, unsigned burst = 1) noexcept;
+
+        bool unlimited() const noexcept;
+
+        //! Takes one token at time now.
+        //! @return Returns false when no token is available.
+        bool try_take(std::uint64_t now_usec) noexcept;
+
+        //! Returns the earliest time at which try_take succeeds again.
+        std::uint64_t next_token(std::uint64_t now_usec) const noexcept;
+
+    private:
+        void refill(std::uint64_t now_usec) noexcept;
+
+        static constexpr std::uint64_t token{1000000};  //!< a token in rate * usec units
+
+        std::uint64_t _rate;
+        std::uint64_t _capacity;    //!< burst tokens
+        std::uint64_t _level;       //!< saved tokens
+        std::uint64_t _last_usec{0};
+    };
+
+} // namespace core
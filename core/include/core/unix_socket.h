@@ -0,0 +1,37 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/scheduler.h>
+
+#include <systemd/sd-event.h>
+
+#include <string>
+
+namespace core {
+
+    //! Creates a non-blocking UNIX stream socket listening on path and watches it for
+    //! connections in the priority class.
+    //! A socket file left behind by a previous run is replaced. The socket file is created with
+    //! mode 0660, access is granted by its group. The caller owns the returned socket and the
+    //! source, and unlinks the path when it closes the socket.
+    //! @param what     names the socket in exception messages and the source description
+    //! @return Returns the listening socket.
+    //! @throws core::runtime_exception     Thrown when the socket cannot be set up, nothing is left open.
+    int listen_unix_socket(event_scheduler& scheduler, priority_class cls, std::string const& path, char const* what,
+                           sd_event_source** source, sd_event_io_handler_t callback, void* userdata);
+
+} // namespace core
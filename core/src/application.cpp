@@ -14,22 +14,39 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <core/application.h>
+#include <core/final.h>
 #include "sig_set_ctrl.h"
 
+#include <systemd/sd-daemon.h>
 #include <systemd/sd-event.h>
 
 #include <cassert>
+#include <limits>
 
 using namespace core;
 
+namespace {
+
+    //! Period of the STATUS notification to systemd.
+    constexpr std::uint64_t status_interval_usec{10000000};
+
+} // namespace
+
 application::application()
     : _sd_event_loop{sd_event_loop::default_loop()}
+    , _scheduler{_sd_event_loop}
+    , _tasks{_sd_event_loop}
 {
     assert(_sd_event_loop.get());
-
+    _scheduler.set_monitor(&_monitor);
+    set_journal(&_journal);
 }
 
-application::~application() = default;
+application::~application()
+{
+    stop_pools();
+    set_journal(nullptr);
+}
 
 void application::run()
 {
@@ -37,13 +54,107 @@ void application::run()
     // its dtor will restore the old signal state
     sig_set_ctrl ssc{_sd_event_loop};
 
+    core::final stop{[this](){stop_pools();}};
     pre_run();
     ssc.enable_watchdog();
-    ::sd_event_loop(_sd_event_loop.get());
+    start_status_updates();
+    core::final stop_status{[this](){_status_source = sd_event_source_unref(_status_source);}};
+    run_loop();
+    stop_pools();
     post_run();
 }
 
+int application::run_loop()
+{
+    // the steps of sd_event_run, only the dispatch step is busy time of the loop
+    auto event = _sd_event_loop.get();
+    while (sd_event_get_state(event) != SD_EVENT_FINISHED) {
+        auto r = sd_event_prepare(event);
+        if (r == 0) {
+            r = sd_event_wait(event, std::numeric_limits<std::uint64_t>::max());
+        }
+        if (r > 0) {
+            _monitor.begin_iteration();
+            auto const start = monotonic_usec();
+            r = sd_event_dispatch(event);
+            _monitor.end_iteration(monotonic_usec() - start);
+        }
+        if (r < 0) {
+            return r;
+        }
+    }
+    int code{0};
+    sd_event_get_exit_code(event, &code);
+    return code;
+}
+
+void application::start_status_updates()
+{
+    std::uint64_t watchdog_usec{0};
+    if (sd_watchdog_enabled(0, &watchdog_usec) > 0) {
+        _monitor.set_watchdog_interval(watchdog_usec);
+    }
+    std::uint64_t now{0};
+    auto r = sd_event_now(_sd_event_loop.get(), CLOCK_MONOTONIC, &now);
+    if (r >= 0) {
+        r = _scheduler.add_time(priority_class::housekeeping, &_status_source, CLOCK_MONOTONIC,
+                                now + status_interval_usec, status_interval_usec / 10,
+                                &application::gdc_status_timer_handler, this);
+    }
+    if (r >= 0) {
+        sd_event_source_set_description(_status_source, "loop-status");
+    }
+    else {
+        // without STATUS the service runs as before, the monitor is still available
+        _status_source = nullptr;
+    }
+}
+
+int application::gdc_status_timer_handler(sd_event_source* s, std::uint64_t usec, void* userdata)
+{
+    assert(userdata != nullptr);
+    auto app = static_cast<application*>(userdata);
+    sd_notifyf(0, "STATUS=%s", app->_monitor.status().c_str());
+    sd_event_source_set_time(s, usec + status_interval_usec);
+    sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+    return 0;
+}
+
 core::sd_event_loop const& application::get_sd_event() const
 {
     return _sd_event_loop;
 }
+
+event_scheduler& application::scheduler() noexcept
+{
+    return _scheduler;
+}
+
+journal_writer& application::journal() noexcept
+{
+    return _journal;
+}
+
+loop_monitor& application::monitor() noexcept
+{
+    return _monitor;
+}
+
+task_queue& application::tasks() noexcept
+{
+    return _tasks;
+}
+
+event_pool& application::create_pool(std::string const& name, std::size_t threads)
+{
+    _pools.push_back(std::make_unique<event_pool>(name, threads));
+    return *_pools.back();
+}
+
+void application::stop_pools() noexcept
+{
+    for (auto& pool : _pools) {
+        pool->stop();
+    }
+    _pools.clear();
+}
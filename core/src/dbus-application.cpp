@@ -16,13 +16,22 @@
 #include <core/dbus-application.h>
 #include <core/exception.h>
 #include <core/final.h>
+#include <core/unix_socket.h>
+
+#include <systemd/sd-journal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 using namespace core;
 
-dbus_application::dbus_application(DBusType dbus_type_, std::string connection_name_)
+dbus_application::dbus_application(DBusType dbus_type_, std::string connection_name_, std::string peer_socket_)
     : core::application{}
     , _dbus_type{dbus_type_}
     , _connection_name{std::move(connection_name_)}
+    , _peer_socket{std::move(peer_socket_)}
 {
     int r;
     if (_dbus_type == DBusType::Session) {
@@ -43,20 +52,33 @@ dbus_application::dbus_application(DBusType dbus_type_, std::string connection_n
         }
     }
 
+    if (!_peer_socket.empty()) {
+        // peers see this id as the bus id of the server
+        r = sd_id128_randomize(&_peer_server_id);
+        if (r < 0) {
+            throw core::runtime_exception{"cannot generate peer server id", r};
+        }
+    }
+
     unref_bus.reset();
 }
 
 void dbus_application::run()
 {
-    int r = sd_bus_attach_event(_sd_bus, get_sd_event().get(), 0);
+    int r = sd_bus_attach_event(_sd_bus, get_sd_event().get(), static_cast<int>(event_scheduler::priority(priority_class::bus)));
     if (r < 0) {
         throw core::runtime_exception{"unable to attach dbus to event loop", r};
     }
+    core::final close{[this](){close_peers();}};
+    if (!_peer_socket.empty()) {
+        listen_peers();
+    }
     application::run();
 }
 
 dbus_application::~dbus_application()
 {
+    close_peers();
     sd_bus_unref(_sd_bus);
 }
 
@@ -65,3 +87,121 @@ sd_bus* dbus_application::bus() const
     return _sd_bus;
 }
 
+std::vector<sd_bus*> const& dbus_application::peers() const
+{
+    return _peers;
+}
+
+int dbus_application::add_object_vtable(sd_bus_slot** slot, char const* path, char const* interface,
+                                        sd_bus_vtable const* vtable, void* userdata)
+{
+    auto r = sd_bus_add_object_vtable(_sd_bus, slot, path, interface, vtable, userdata);
+    if (r < 0) {
+        return r;
+    }
+    _vtables.push_back(object_vtable{path, interface, vtable, userdata});
+    for (auto peer : _peers) {
+        r = sd_bus_add_object_vtable(peer, nullptr, path, interface, vtable, userdata);
+        if (r < 0) {
+            sd_journal_print(LOG_ERR, "Unable to register %s on peer connection (%s)", interface, strerror(-r));
+        }
+    }
+    return 0;
+}
+
+void dbus_application::listen_peers()
+{
+    _peer_listen_fd = listen_unix_socket(scheduler(), priority_class::bus, _peer_socket, "peer",
+                                         &_peer_listen_source, &dbus_application::accept_peer_handler, this);
+}
+
+void dbus_application::close_peers()
+{
+    for (auto peer : _peers) {
+        sd_bus_detach_event(peer);
+        sd_bus_flush_close_unref(peer);
+    }
+    _peers.clear();
+    _peer_listen_source = sd_event_source_unref(_peer_listen_source);
+    if (_peer_listen_fd >= 0) {
+        close(_peer_listen_fd);
+        _peer_listen_fd = -1;
+        unlink(_peer_socket.c_str());
+    }
+}
+
+int dbus_application::accept_peer_handler(sd_event_source */*s*/, int fd, uint32_t /*revents*/, void *userdata)
+{
+    auto app = reinterpret_cast<dbus_application*>(userdata);
+    for (;;) {
+        auto peer_fd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (peer_fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                sd_journal_print(LOG_WARNING, "Unable to accept peer connection (%s)", strerror(errno));
+            }
+            if (errno != EINTR) {
+                return 0;
+            }
+            continue;
+        }
+        auto r = app->add_peer(peer_fd);
+        if (r < 0) {
+            sd_journal_print(LOG_WARNING, "Unable to set up peer connection (%s)", strerror(-r));
+        }
+    }
+}
+
+int dbus_application::add_peer(int fd)
+{
+    sd_bus* peer{nullptr};
+    auto r = sd_bus_new(&peer);
+    if (r < 0) {
+        close(fd);
+        return r;
+    }
+    core::final unref_peer{[&peer](){sd_bus_flush_close_unref(peer);}};
+    r = sd_bus_set_fd(peer, fd, fd);
+    if (r < 0) {
+        close(fd);
+        return r;
+    }
+    r = sd_bus_set_server(peer, 1, _peer_server_id);
+    if (r >= 0) {
+        r = sd_bus_negotiate_fds(peer, 1);
+    }
+    if (r >= 0) {
+        r = sd_bus_start(peer);
+    }
+    if (r >= 0) {
+        // sd-bus synthesizes this signal when the peer hangs up
+        r = sd_bus_match_signal(peer, nullptr, nullptr, "/org/freedesktop/DBus/Local", "org.freedesktop.DBus.Local",
+                                "Disconnected", &dbus_application::peer_disconnected_handler, this);
+    }
+    for (auto it = _vtables.begin(); r >= 0 && it != _vtables.end(); ++it) {
+        r = sd_bus_add_object_vtable(peer, nullptr, it->path.c_str(), it->interface.c_str(), it->vtable, it->userdata);
+    }
+    if (r >= 0) {
+        r = sd_bus_attach_event(peer, get_sd_event().get(), static_cast<int>(event_scheduler::priority(priority_class::bus)));
+    }
+    if (r < 0) {
+        return r;
+    }
+    _peers.push_back(peer);
+    unref_peer.reset();
+    return 0;
+}
+
+int dbus_application::peer_disconnected_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    auto app = reinterpret_cast<dbus_application*>(userdata);
+    auto peer = sd_bus_message_get_bus(m);
+    auto it = std::find(app->_peers.begin(), app->_peers.end(), peer);
+    if (it != app->_peers.end()) {
+        app->_peers.erase(it);
+        // sd-bus holds its own reference while it dispatches this signal
+        sd_bus_detach_event(peer);
+        sd_bus_unref(peer);
+    }
+    return 0;
+}
+
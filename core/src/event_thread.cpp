@@ -0,0 +1,225 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/event_thread.h>
+#include <core/exception.h>
+
+#include <systemd/sd-journal.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+
+using namespace core;
+
+task_queue::task_queue(core::sd_event_loop loop, std::int64_t priority)
+    : _loop{std::move(loop)}
+{
+    _fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_fd < 0) {
+        throw core::runtime_exception{"cannot create task queue eventfd", errno};
+    }
+    auto r = sd_event_add_io(_loop.get(), &_source, _fd, EPOLLIN, &task_queue::gdc_wakeup_handler, this);
+    if (r >= 0) {
+        r = sd_event_source_set_priority(_source, priority);
+    }
+    if (r < 0) {
+        sd_event_source_unref(_source);
+        close(_fd);
+        throw core::runtime_exception{"unable to watch task queue eventfd", r};
+    }
+}
+
+task_queue::~task_queue()
+{
+    sd_event_source_unref(_source);
+    close(_fd);
+    for (auto n = _head.exchange(nullptr); n != nullptr;) {
+        std::unique_ptr<node> dropped{n};
+        n = n->next;
+    }
+}
+
+void task_queue::post(task t)
+{
+    auto n = new node{std::move(t), _head.load(std::memory_order_relaxed)};
+    while (!_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    // the loop reads the eventfd before it takes the list, a task pushed to an empty list is never missed
+    if (n->next == nullptr) {
+        std::uint64_t one{1};
+        if (write(_fd, &one, sizeof(one)) < 0) {
+            // the counter cannot overflow, the wake-up of a pending write is enough
+        }
+    }
+}
+
+void task_queue::run_pending()
+{
+    std::uint64_t count{0};
+    if (read(_fd, &count, sizeof(count)) < 0) {
+        // EAGAIN, a previous call already took the tasks of this wake-up
+    }
+    // the list is in reverse posting order
+    node* list{nullptr};
+    for (auto n = _head.exchange(nullptr, std::memory_order_acquire); n != nullptr;) {
+        auto next = n->next;
+        n->next = list;
+        list = n;
+        n = next;
+    }
+    while (list != nullptr) {
+        std::unique_ptr<node> n{list};
+        list = list->next;
+        try {
+            n->fn();
+        }
+        catch (std::exception const& e) {
+            sd_journal_print(LOG_ERR, "Posted task failed: %s", e.what());
+        }
+        catch (...) {
+            sd_journal_print(LOG_ERR, "Posted task failed");
+        }
+    }
+}
+
+int task_queue::gdc_wakeup_handler(sd_event_source */*s*/, int /*fd*/, uint32_t /*revents*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    static_cast<task_queue*>(userdata)->run_pending();
+    return 0;
+}
+
+event_thread::event_thread(std::string name)
+    : _name{std::move(name)}
+{
+    std::promise<void> started;
+    auto ready = started.get_future();
+    _thread = std::thread{[this, &started]() { run(started); }};
+    try {
+        ready.get();
+    }
+    catch (...) {
+        _thread.join();
+        throw;
+    }
+}
+
+event_thread::~event_thread()
+{
+    stop();
+}
+
+void event_thread::run(std::promise<void>& started)
+{
+    // the signals belong to the signal sources of the main loop
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+    pthread_setname_np(pthread_self(), _name.substr(0, 15).c_str());
+
+    try {
+        // the loop is created on its thread, sd-event binds a loop to the thread that runs it
+        _loop = std::make_unique<core::sd_event_loop>(core::sd_event_loop::create());
+        _tasks = std::make_unique<task_queue>(*_loop, SD_EVENT_PRIORITY_IMPORTANT);
+    }
+    catch (...) {
+        _tasks.reset();
+        _loop.reset();
+        started.set_exception(std::current_exception());
+        return;
+    }
+    started.set_value();
+
+    auto r = ::sd_event_loop(_loop->get());
+    if (r < 0) {
+        sd_journal_print(LOG_ERR, "Event loop of thread %s failed (%s)", _name.c_str(), strerror(-r));
+    }
+}
+
+void event_thread::post(task_queue::task t)
+{
+    _tasks->post(std::move(t));
+}
+
+void event_thread::stop()
+{
+    if (!_thread.joinable()) {
+        return;
+    }
+    assert(_thread.get_id() != std::this_thread::get_id());
+    auto event = _loop->get();
+    _tasks->post([event]() { sd_event_exit(event, 0); });
+    _thread.join();
+}
+
+core::sd_event_loop const& event_thread::loop() const noexcept
+{
+    return *_loop;
+}
+
+std::string const& event_thread::name() const noexcept
+{
+    return _name;
+}
+
+event_pool::event_pool(std::string const& name, std::size_t threads)
+{
+    threads = std::max<std::size_t>(threads, 1);
+    _threads.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        _threads.push_back(std::make_unique<event_thread>(name + "-" + std::to_string(i)));
+    }
+}
+
+event_pool::~event_pool()
+{
+    stop();
+}
+
+std::size_t event_pool::size() const noexcept
+{
+    return _threads.size();
+}
+
+event_thread& event_pool::operator[](std::size_t index) noexcept
+{
+    return *_threads[index];
+}
+
+void event_pool::post(task_queue::task t)
+{
+    auto i = _next.fetch_add(1, std::memory_order_relaxed) % _threads.size();
+    _threads[i]->post(std::move(t));
+}
+
+void event_pool::stop()
+{
+    // every thread leaves its loop before the first is joined
+    for (auto& t : _threads) {
+        auto event = t->loop().get();
+        t->post([event]() { sd_event_exit(event, 0); });
+    }
+    for (auto& t : _threads) {
+        t->stop();
+    }
+}
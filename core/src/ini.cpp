@@ -16,8 +16,10 @@
 #include <core/ini.h>
 
 #include <algorithm>
-#include <regex>
-#include <sstream>
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
 
 // taken from https://stackoverflow.com/questions/216823/whats-the-best-way-to-trim-stdstring
 void core::ini::ltrim(std::string &s) {
@@ -47,37 +49,76 @@ void core::ini::trim_quotes(std::string& s)
     }
 }
 
-std::pair<std::string, int> core::ini::read_line_ext(std::istream& input)
-{
-    std::stringstream ss;
-    int line_count{0};
-    bool extend;
-    if (input.eof()) {
-        return std::make_pair(std::string{}, 0);
-    }
-    do {
-        std::string line;
-        std::getline(input, line);
-        if (input.bad() || (input.fail() && !input.eof())) {
-            throw std::runtime_error{"input stream bad"};
-        }
-        core::ini::trim(line);
-        if (!input.eof() || !line.empty()) {
-            ++line_count;
-        }
-        if (!line.empty() && line.back() == '\\') {
-            line = line.substr(0, line.size()-1);
-            if (input.eof()) {
-                throw std::runtime_error{"unexpected end-of-file"};
-            }
-            extend = true;
+namespace {
+
+    bool is_space(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+    }
+
+    std::string_view trim_view(std::string_view s)
+    {
+        while (!s.empty() && is_space(s.front())) {
+            s.remove_prefix(1);
         }
-        else {
-            extend = false;
+        while (!s.empty() && is_space(s.back())) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    std::string_view trim_quotes_view(std::string_view s)
+    {
+        if (s.size() > 1 && (
+                (s.front() == '"' && s.back() == '"') || (s.front() == '\'' && s.back() == '\''))) {
+            s = s.substr(1, s.size()-2);
+        }
+        return s;
+    }
+
+    //! Implementation of read_line_ext that reads into caller provided buffers.
+    //! The buffers are reused between calls, so they only allocate when a longer line is read.
+    template<typename String>
+    int read_line_ext_into(std::istream& input, String& result, String& line)
+    {
+        int line_count{0};
+        bool extend;
+        result.clear();
+        if (input.eof()) {
+            return 0;
         }
-        ss << line;
-    } while(extend);
-    return std::make_pair(ss.str(), line_count);
+        do {
+            std::getline(input, line);
+            if (input.bad() || (input.fail() && !input.eof())) {
+                throw std::runtime_error{"input stream bad"};
+            }
+            auto trimmed = trim_view(line);
+            if (!input.eof() || !trimmed.empty()) {
+                ++line_count;
+            }
+            if (!trimmed.empty() && trimmed.back() == '\\') {
+                trimmed.remove_suffix(1);
+                if (input.eof()) {
+                    throw std::runtime_error{"unexpected end-of-file"};
+                }
+                extend = true;
+            }
+            else {
+                extend = false;
+            }
+            result.append(trimmed.data(), trimmed.size());
+        } while(extend);
+        return line_count;
+    }
+
+} // namespace
+
+std::pair<std::string, int> core::ini::read_line_ext(std::istream& input)
+{
+    std::string result;
+    std::string line;
+    int line_count = read_line_ext_into(input, result, line);
+    return std::make_pair(std::move(result), line_count);
 };
 
 // ----------------------------------------------------------------------------
@@ -86,44 +127,87 @@ std::pair<std::string, int> core::ini::read_line_ext(std::istream& input)
 
 namespace {
 
-    core::ini::section process_section_header(std::string const& line, int line_number, bool remove_quotes)
+    bool is_section_name_char(char ch)
     {
-        static const std::regex section_regex{R"(\[([A-Za-z0-9_\-:]+)(\s*=\s*(.*))?\])"};
-
-        core::ini::section section{};
-        section.line_number = line_number;
-        std::smatch base_match;
-        if (!std::regex_match(line, base_match, section_regex) || base_match.size() < 2) {
-            throw core::ini::parse_exception{line_number, line};
-        }
-        section.name = base_match[1];
-        if (base_match.size() > 3) {
-            section.value = base_match[3];
-            if (remove_quotes) {
-                core::ini::trim_quotes(section.value);
-            }
+        return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')
+            || ch == '_' || ch == '-' || ch == ':';
+    }
+
+    bool is_property_name_char(char ch)
+    {
+        return is_section_name_char(ch) || ch == '.';
+    }
+
+    //! Splits the leading name of the line, the name consists of characters accepted by is_name_char.
+    template<typename Pred>
+    std::string_view take_name(std::string_view& s, Pred is_name_char)
+    {
+        std::size_t n{0};
+        while (n < s.size() && is_name_char(s[n])) {
+            ++n;
         }
-        return section;
+        auto name = s.substr(0, n);
+        s.remove_prefix(n);
+        return name;
     }
 
-    core::ini::property process_property(std::string const& line, int line_number, bool remove_quotes)
+    //! Removes the assignment operator '=' including surrounding whitespaces.
+    //! @return Returns false when s does not start with an optionally white space prefixed '='.
+    bool take_assignment(std::string_view& s)
     {
-        static const std::regex property_regex{R"(\s*([a-zA-Z0-9_\.\-:]+)\s*=\s*(.+)?)"};
+        while (!s.empty() && is_space(s.front())) {
+            s.remove_prefix(1);
+        }
+        if (s.empty() || s.front() != '=') {
+            return false;
+        }
+        s.remove_prefix(1);
+        while (!s.empty() && is_space(s.front())) {
+            s.remove_prefix(1);
+        }
+        return true;
+    }
 
-        core::ini::property property{};
-        property.line_number = line_number;
-        std::smatch base_match;
-        if (!std::regex_match(line, base_match, property_regex) || base_match.size() < 3) {
-            throw core::ini::parse_exception{line_number, line};
+    std::pmr::string make_string(std::string_view s, std::pmr::memory_resource* resource)
+    {
+        return std::pmr::string{s, std::pmr::polymorphic_allocator<char>{resource}};
+    }
+
+    //! Parses a section header: '[' name ( '=' value )? ']'
+    core::ini::section process_section_header(std::string_view line, int line_number, bool remove_quotes,
+                                              std::pmr::memory_resource* resource)
+    {
+        if (line.size() < 2 || line.front() != '[' || line.back() != ']') {
+            throw core::ini::parse_exception{line_number, std::string{line}};
         }
-        property.name = base_match[1];
-        if (base_match.size() > 2) {
-            property.value = base_match[2];
+        auto rest = line.substr(1, line.size() - 2);
+        auto name = take_name(rest, is_section_name_char);
+        if (name.empty() || (!rest.empty() && !take_assignment(rest))) {
+            throw core::ini::parse_exception{line_number, std::string{line}};
         }
         if (remove_quotes) {
-            core::ini::trim_quotes(property.value);
+            rest = trim_quotes_view(rest);
         }
-        return property;
+        return core::ini::section{
+            {make_string(name, resource), make_string(rest, resource), line_number},
+            std::pmr::vector<core::ini::property>{resource},
+            core::ini::name_index{resource}
+        };
+    }
+
+    //! Parses a property: name '=' value?
+    core::ini::property process_property(std::string_view line, int line_number, bool remove_quotes,
+                                         std::pmr::memory_resource* resource)
+    {
+        auto rest = line;
+        auto name = take_name(rest, is_property_name_char);
+        if (name.empty() || !take_assignment(rest)) {
+            throw core::ini::parse_exception{line_number, std::string{line}};
+        }
+        if (remove_quotes) {
+            rest = trim_quotes_view(rest);
+        }
+        return core::ini::property{make_string(name, resource), make_string(rest, resource), line_number};
     }
 
 } // namespace
@@ -132,8 +216,11 @@ core::ini::file::file() = default;
 
 core::ini::file::~file() = default;
 
-core::ini::file::file(std::istream& input, bool remove_value_quotes)
-    : core::ini::file::file{}
+core::ini::file::file(std::istream& input, bool remove_value_quotes, std::pmr::memory_resource* resource)
+    : _sections{resource}
+    , _section_index{resource}
+    , _section_groups{resource}
+    , _section_order{resource}
 {
     if (input.fail() || input.bad()) {
         throw std::runtime_error{"input file not readable"};
@@ -141,38 +228,263 @@ core::ini::file::file(std::istream& input, bool remove_value_quotes)
 
     int line_number{1};
     int lc;
-    std::string line;
+    std::pmr::string line{resource};
+    std::pmr::string buffer{resource};
     core::ini::section* current_section{nullptr};
     while(input.good()) {
-        std::tie(line, lc) = read_line_ext(input);
+        lc = read_line_ext_into(input, line, buffer);
         if (line.empty() || line.front() == '#') {
+            line_number += lc;
             continue;
         }
         else if (line.front() == '[') {
-            _sections.push_back(process_section_header(line, line_number, remove_value_quotes));
+            _sections.push_back(process_section_header(line, line_number, remove_value_quotes, resource));
             current_section = &_sections.back();
         }
         else {
             if (!current_section) {
-                _sections.push_back(core::ini::section{}); // section with empty name == "root" section
+                // section with empty name == "root" section
+                _sections.push_back(core::ini::section{{make_string({}, resource), make_string({}, resource), 0},
+                                                       std::pmr::vector<core::ini::property>{resource},
+                                                       core::ini::name_index{resource}});
                 current_section = &_sections.back();
             }
-            current_section->properties.push_back(process_property(line, line_number, remove_value_quotes));
+            current_section->properties.push_back(process_property(line, line_number, remove_value_quotes, resource));
         }
         line_number += lc;
     }
 }
 
-std::vector<core::ini::section> const& core::ini::file::sections() const
+std::pmr::vector<core::ini::section> const& core::ini::file::sections() const
 {
     return _sections;
 }
 
+std::vector<core::ini::section const*> core::ini::file::sections(std::string_view name) const
+{
+    std::vector<section const*> result;
+    if (_section_index.built() && _section_order.size() == _sections.size()) {
+        auto group = _section_index.find(name, [this](std::size_t g) -> std::string_view {
+            return _sections[_section_order[_section_groups[g].first]].name;
+        });
+        if (group != name_index::npos) {
+            auto [offset, count] = _section_groups[group];
+            result.reserve(count);
+            for (auto i = offset; i < offset + count; ++i) {
+                result.push_back(&_sections[_section_order[i]]);
+            }
+        }
+        return result;
+    }
+    for (auto const& s : _sections) {
+        if (s.name == name) {
+            result.push_back(&s);
+        }
+    }
+    return result;
+}
+
+void core::ini::file::build_index()
+{
+    auto resource = _sections.get_allocator().resource();
+    for (auto& s : _sections) {
+        s.build_index();
+    }
+
+    // the index members already carry the resource of the file and are rebuilt in place, a
+    // polymorphic_allocator is not propagated by assignment
+
+    // group the section positions by name, keeping the file order within a group
+    std::pmr::vector<std::uint32_t> group_of{_sections.size(), resource};
+    _section_groups.clear();
+    name_index first_of_name{resource};
+    first_of_name.build(_sections.size(), [this](std::size_t i) -> std::string_view {return _sections[i].name;});
+    for (std::size_t i = 0; i < _sections.size(); ++i) {
+        auto first = first_of_name.find(_sections[i].name,
+                                        [this](std::size_t j) -> std::string_view {return _sections[j].name;});
+        if (first == i) {
+            group_of[i] = static_cast<std::uint32_t>(_section_groups.size());
+            _section_groups.emplace_back(0, 0);
+        }
+        else {
+            group_of[i] = group_of[first];
+        }
+        ++_section_groups[group_of[i]].second;
+    }
+    std::uint32_t offset{0};
+    for (auto& g : _section_groups) {
+        g.first = offset;
+        offset += g.second;
+        g.second = 0;
+    }
+    _section_order.assign(_sections.size(), 0);
+    for (std::size_t i = 0; i < _sections.size(); ++i) {
+        auto& g = _section_groups[group_of[i]];
+        _section_order[g.first + g.second] = static_cast<std::uint32_t>(i);
+        ++g.second;
+    }
+
+    // the group index maps a name to the group, the group's first section provides the name
+    _section_index.build(_section_groups.size(), [this](std::size_t g) -> std::string_view {
+        return _sections[_section_order[_section_groups[g].first]].name;
+    });
+}
+
+core::ini::file core::ini::merge_files(std::vector<file>&& list_of_files)
+{
+    file merged{};
+    section root_section{};
+    std::size_t section_count{0};
+    for (auto& f : list_of_files) {
+        section_count += f._sections.size();
+        if (!f._sections.empty() && f._sections[0].name.empty()) {
+            auto& properties = f._sections[0].properties;
+            root_section.properties.insert(root_section.properties.end(),
+                                           std::make_move_iterator(properties.begin()),
+                                           std::make_move_iterator(properties.end()));
+        }
+    }
+    merged._sections.reserve(section_count + 1);
+    if (!root_section.properties.empty()) {
+        merged._sections.push_back(std::move(root_section));
+    }
+    for (auto& f : list_of_files) {
+        for (auto& s : f._sections) {
+            if (!s.name.empty()) {
+                merged._sections.push_back(std::move(s));
+            }
+        }
+        f._sections.clear();
+    }
+    return merged;
+}
+
+// ----------------------------------------------------------------------------
+// section
+// ----------------------------------------------------------------------------
+void core::ini::section::build_index()
+{
+    index.build(properties.size(), [this](std::size_t i) -> std::string_view {return properties[i].name;});
+}
+
+core::ini::property const* core::ini::section::find(std::string_view name) const
+{
+    if (index.built() && index.size() == properties.size()) {
+        auto pos = index.find(name, [this](std::size_t i) -> std::string_view {return properties[i].name;});
+        return pos == name_index::npos ? nullptr : &properties[pos];
+    }
+    for (auto const& p : properties) {
+        if (p.name == name) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+
+    [[noreturn]] void throw_value_error(core::ini::property const& p)
+    {
+        throw core::ini::parse_exception{p.line_number,
+                                         std::string{std::string_view{p.name}}.append(" = ").append(p.value)};
+    }
+
+    template<typename T>
+    std::optional<T> get_number(core::ini::section const& s, std::string_view name)
+    {
+        auto p = s.find(name);
+        if (!p) {
+            return std::nullopt;
+        }
+        T value{};
+        auto first = p->value.data();
+        auto last = first + p->value.size();
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        if (ec != std::errc{} || ptr != last || first == last) {
+            throw_value_error(*p);
+        }
+        return value;
+    }
+
+} // namespace
+
+template<>
+std::optional<std::string> core::ini::section::get<std::string>(std::string_view name) const
+{
+    auto p = find(name);
+    if (!p) {
+        return std::nullopt;
+    }
+    return std::string{std::string_view{p->value}};
+}
+
+template<>
+std::optional<bool> core::ini::section::get<bool>(std::string_view name) const
+{
+    auto p = find(name);
+    if (!p) {
+        return std::nullopt;
+    }
+    if (p->value == "true") {
+        return true;
+    }
+    if (p->value == "false") {
+        return false;
+    }
+    throw_value_error(*p);
+}
+
+template<>
+std::optional<int> core::ini::section::get<int>(std::string_view name) const
+{
+    return get_number<int>(*this, name);
+}
+
+template<>
+std::optional<unsigned> core::ini::section::get<unsigned>(std::string_view name) const
+{
+    return get_number<unsigned>(*this, name);
+}
+
+// ----------------------------------------------------------------------------
+// name_index
+// ----------------------------------------------------------------------------
+core::ini::name_index::name_index(std::pmr::memory_resource* resource)
+    : _slots{resource}
+{}
+
+std::uint32_t core::ini::name_index::hash(std::string_view name)
+{
+    // FNV-1a
+    std::uint32_t h{2166136261u};
+    for (char c : name) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void core::ini::name_index::clear()
+{
+    _slots.clear();
+    _size = 0;
+}
+
+std::size_t core::ini::name_index::size() const
+{
+    return _size;
+}
+
+bool core::ini::name_index::built() const
+{
+    return !_slots.empty();
+}
+
 // ----------------------------------------------------------------------------
 // parse_exception
 // ----------------------------------------------------------------------------
-core::ini::parse_exception::parse_exception(int line_number, std::string expr)
-    : _expression{std::move(expr)}, _line_number{line_number}
+core::ini::parse_exception::parse_exception(int line_number, std::string expr, std::string source)
+    : _expression{std::move(expr)}, _line_number{line_number}, _source{std::move(source)}
 {}
 
 core::ini::parse_exception::~parse_exception() = default;
@@ -191,3 +503,8 @@ int core::ini::parse_exception::line_number() const noexcept
 {
     return _line_number;
 }
+
+std::string const& core::ini::parse_exception::source() const noexcept
+{
+    return _source;
+}
@@ -0,0 +1,316 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/journal.h>
+#include <core/exception.h>
+#include <core/loop_monitor.h>
+
+#include <systemd/sd-journal.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+using namespace core;
+
+namespace {
+
+    std::atomic<journal_writer*> installed{nullptr};
+
+    void copy_field(char* dest, std::size_t size, char const* src) noexcept
+    {
+        if (src == nullptr) {
+            dest[0] = '\0';
+            return;
+        }
+        auto n = strnlen(src, size - 1);
+        std::memcpy(dest, src, n);
+        dest[n] = '\0';
+    }
+
+    void format_record(log_record& record, int priority, log_fields const& fields,
+                       char const* format, va_list args) noexcept
+    {
+        record.priority = priority;
+        record.error = fields.error;
+        copy_field(record.line, sizeof(record.line), fields.line);
+        copy_field(record.chip, sizeof(record.chip), fields.chip);
+        vsnprintf(record.message, sizeof(record.message), format, args);
+    }
+
+} // namespace
+
+bool core::operator==(log_record const& a, log_record const& b) noexcept
+{
+    return a.priority == b.priority && a.error == b.error && std::strcmp(a.line, b.line) == 0
+        && std::strcmp(a.chip, b.chip) == 0 && std::strcmp(a.message, b.message) == 0;
+}
+
+journal_writer::journal_writer()
+    : journal_writer{options{}}
+{}
+
+journal_writer::journal_writer(options const& opts, sink_fn sink)
+    : _options{opts}
+    , _sink{sink ? std::move(sink) : sink_fn{&journal_writer::send}}
+    , _bucket{opts.rate, opts.burst}
+{
+    std::size_t capacity{2};
+    while (capacity < _options.capacity) {
+        capacity *= 2;
+    }
+    _slots.reset(new slot[capacity]);
+    _mask = capacity - 1;
+    for (std::size_t i = 0; i < capacity; ++i) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_fd < 0) {
+        throw runtime_exception{"cannot create journal eventfd", errno};
+    }
+    _thread = std::thread{&journal_writer::run, this};
+}
+
+journal_writer::~journal_writer()
+{
+    _stop = true;
+    std::uint64_t one{1};
+    (void)::write(_fd, &one, sizeof(one));
+    _thread.join();
+    ::close(_fd);
+}
+
+void journal_writer::log(int priority, log_fields const& fields, char const* format, ...) noexcept
+{
+    va_list args;
+    va_start(args, format);
+    vlog(priority, fields, format, args);
+    va_end(args);
+}
+
+void journal_writer::vlog(int priority, log_fields const& fields, char const* format, va_list args) noexcept
+{
+    // bounded multi-producer ring, a slot is free when its sequence equals the write position
+    auto pos = _head.load(std::memory_order_relaxed);
+    slot* s;
+    for (;;) {
+        s = &_slots[pos & _mask];
+        auto seq = s->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+    format_record(s->record, priority, fields, format, args);
+    s->sequence.store(pos + 1, std::memory_order_release);
+
+    if (!_wakeup.exchange(true)) {
+        std::uint64_t one{1};
+        (void)::write(_fd, &one, sizeof(one));
+    }
+}
+
+std::uint64_t journal_writer::dropped() const noexcept
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t journal_writer::suppressed() const noexcept
+{
+    return _suppressed.load(std::memory_order_relaxed);
+}
+
+void journal_writer::send(log_record const& record, unsigned repeated) noexcept
+{
+    char message[sizeof(record.message) + 40];
+    char priority[16];
+    char line[sizeof(record.line) + 8];
+    char chip[sizeof(record.chip) + 8];
+    char error[24];
+    char repeats[24];
+    iovec iov[6];
+    int n{0};
+    auto add = [&iov, &n](char* buf, int len) {
+        iov[n].iov_base = buf;
+        iov[n].iov_len = static_cast<std::size_t>(std::max(len, 0));
+        ++n;
+    };
+    if (repeated > 0) {
+        add(message, snprintf(message, sizeof(message), "MESSAGE=%s (repeated %u times)", record.message, repeated));
+        add(repeats, snprintf(repeats, sizeof(repeats), "REPEATED=%u", repeated));
+    }
+    else {
+        add(message, snprintf(message, sizeof(message), "MESSAGE=%s", record.message));
+    }
+    add(priority, snprintf(priority, sizeof(priority), "PRIORITY=%i", record.priority));
+    if (record.line[0] != '\0') {
+        add(line, snprintf(line, sizeof(line), "LINE=%s", record.line));
+    }
+    if (record.chip[0] != '\0') {
+        add(chip, snprintf(chip, sizeof(chip), "CHIP=%s", record.chip));
+    }
+    if (record.error != 0) {
+        add(error, snprintf(error, sizeof(error), "ERRNO=%i", record.error));
+    }
+    sd_journal_sendv(iov, n);
+}
+
+void journal_writer::run() noexcept
+{
+    // the signals belong to the signal sources of the main loop
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+    pthread_setname_np(pthread_self(), "journal");
+
+    log_record record;
+    for (;;) {
+        // reset before draining, a later log writes the eventfd again
+        std::uint64_t count;
+        (void)::read(_fd, &count, sizeof(count));
+        _wakeup.store(false);
+        while (pop(record)) {
+            process(record, monotonic_usec());
+        }
+        auto now = monotonic_usec();
+        if (_repeats > 0 && now - _run_start >= _options.repeat_window) {
+            end_run();
+            _have_last = false;
+        }
+        report_losses(now);
+        if (_stop) {
+            break;
+        }
+
+        // wake up for the end of a run of repeats or when a token for the loss report is due
+        int timeout{-1};
+        if (_repeats > 0) {
+            timeout = static_cast<int>((_run_start + _options.repeat_window - now) / 1000 + 1);
+        }
+        if (suppressed() > _suppressed_reported || dropped() > _dropped_reported) {
+            auto wait = static_cast<int>((_bucket.next_token(now) - now) / 1000 + 1);
+            timeout = timeout < 0 ? wait : std::min(timeout, wait);
+        }
+        pollfd pfd{_fd, POLLIN, 0};
+        ::poll(&pfd, 1, timeout);
+    }
+
+    // entries logged up to the stop are sent
+    while (pop(record)) {
+        process(record, monotonic_usec());
+    }
+    end_run();
+    report_losses(monotonic_usec(), true);
+}
+
+bool journal_writer::pop(log_record& record) noexcept
+{
+    auto& s = _slots[_tail & _mask];
+    if (s.sequence.load(std::memory_order_acquire) != _tail + 1) {
+        return false;
+    }
+    record = s.record;
+    s.sequence.store(_tail + _mask + 1, std::memory_order_release);
+    ++_tail;
+    return true;
+}
+
+void journal_writer::process(log_record const& record, std::uint64_t now) noexcept
+{
+    if (_have_last && now - _run_start < _options.repeat_window && record == _last) {
+        ++_repeats;
+        return;
+    }
+    end_run();
+    _last = record;
+    _have_last = true;
+    _run_start = now;
+    emit(record, now);
+}
+
+void journal_writer::emit(log_record const& record, std::uint64_t now) noexcept
+{
+    if (!_bucket.try_take(now)) {
+        _suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _sink(record, 0);
+}
+
+void journal_writer::end_run() noexcept
+{
+    // the count of a run is sent regardless of the rate, it replaces the entries it folded
+    if (_repeats > 0) {
+        _sink(_last, _repeats);
+        _repeats = 0;
+    }
+}
+
+void journal_writer::report_losses(std::uint64_t now, bool force) noexcept
+{
+    auto const suppressed = this->suppressed();
+    auto const dropped = this->dropped();
+    if (suppressed == _suppressed_reported && dropped == _dropped_reported) {
+        return;
+    }
+    if (!_bucket.try_take(now) && !force) {
+        return;
+    }
+    log_record report{LOG_WARNING, 0, {}, {}, {}};
+    snprintf(report.message, sizeof(report.message),
+             "%llu journal entries suppressed by the rate limit, %llu dropped on a full ring",
+             static_cast<unsigned long long>(suppressed - _suppressed_reported),
+             static_cast<unsigned long long>(dropped - _dropped_reported));
+    _suppressed_reported = suppressed;
+    _dropped_reported = dropped;
+    _sink(report, 0);
+}
+
+void core::set_journal(journal_writer* writer) noexcept
+{
+    installed.store(writer);
+}
+
+void core::log(int priority, log_fields const& fields, char const* format, ...) noexcept
+{
+    va_list args;
+    va_start(args, format);
+    if (auto writer = installed.load(); writer != nullptr) {
+        writer->vlog(priority, fields, format, args);
+    }
+    else {
+        log_record record;
+        format_record(record, priority, fields, format, args);
+        journal_writer::send(record, 0);
+    }
+    va_end(args);
+}
@@ -0,0 +1,197 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/loop_monitor.h>
+#include <core/journal.h>
+
+#include <systemd/sd-event.h>
+#include <syslog.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+using namespace core;
+
+namespace {
+
+    std::string format_usec(std::uint64_t usec)
+    {
+        char buf[32];
+        if (usec < 1000) {
+            snprintf(buf, sizeof(buf), "%" PRIu64 "us", usec);
+        }
+        else if (usec < 1000000) {
+            snprintf(buf, sizeof(buf), "%.1fms", static_cast<double>(usec) / 1e3);
+        }
+        else {
+            snprintf(buf, sizeof(buf), "%.2fs", static_cast<double>(usec) / 1e6);
+        }
+        return buf;
+    }
+
+} // namespace
+
+void latency_histogram::record(std::uint64_t usec) noexcept
+{
+    std::size_t bucket = usec == 0 ? 0 : static_cast<std::size_t>(64 - __builtin_clzll(usec));
+    ++_buckets[std::min(bucket, bucket_count - 1)];
+    ++_count;
+    _sum += usec;
+    _max = std::max(_max, usec);
+}
+
+std::uint64_t latency_histogram::count() const noexcept
+{
+    return _count;
+}
+
+std::uint64_t latency_histogram::sum() const noexcept
+{
+    return _sum;
+}
+
+std::uint64_t latency_histogram::max() const noexcept
+{
+    return _max;
+}
+
+std::array<std::uint64_t, latency_histogram::bucket_count> const& latency_histogram::buckets() const noexcept
+{
+    return _buckets;
+}
+
+std::uint64_t latency_histogram::quantile(double q) const noexcept
+{
+    if (_count == 0) {
+        return 0;
+    }
+    auto const rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(_count))));
+    std::uint64_t seen{0};
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += _buckets[i];
+        if (seen >= rank) {
+            return std::min(upper_bound(i), _max);
+        }
+    }
+    return _max;
+}
+
+std::uint64_t latency_histogram::upper_bound(std::size_t bucket) noexcept
+{
+    return bucket + 1 < bucket_count ? std::uint64_t{1} << bucket : std::numeric_limits<std::uint64_t>::max();
+}
+
+void loop_monitor::set_threshold(std::uint64_t usec) noexcept
+{
+    _threshold = usec;
+}
+
+std::uint64_t loop_monitor::threshold() const noexcept
+{
+    return _threshold;
+}
+
+void loop_monitor::set_watchdog_interval(std::uint64_t usec) noexcept
+{
+    _watchdog_usec = usec;
+}
+
+void loop_monitor::begin_iteration() noexcept
+{
+    _slowest_usec = 0;
+    _slowest_found = false;
+}
+
+void loop_monitor::end_iteration(std::uint64_t usec) noexcept
+{
+    _iterations.record(usec);
+    if (_threshold == 0 || usec <= _threshold) {
+        return;
+    }
+    ++_stalls;
+    if (_slowest_found) {
+        core::log(LOG_WARNING, {}, "Event loop stalled for %s, slowest handler %s took %s",
+                         format_usec(usec).c_str(), _slowest.data(), format_usec(_slowest_usec).c_str());
+    }
+    else {
+        // sd-bus and signal sources are not dispatched by the scheduler
+        core::log(LOG_WARNING, {}, "Event loop stalled for %s outside of scheduled handlers",
+                         format_usec(usec).c_str());
+    }
+}
+
+void loop_monitor::handler_done(sd_event_source* s, std::uint64_t usec) noexcept
+{
+    if (_slowest_found && usec <= _slowest_usec) {
+        return;
+    }
+    _slowest_found = true;
+    _slowest_usec = usec;
+    char const* description{nullptr};
+    if (sd_event_source_get_description(s, &description) >= 0 && description != nullptr) {
+        snprintf(_slowest.data(), _slowest.size(), "%s", description);
+    }
+    else {
+        snprintf(_slowest.data(), _slowest.size(), "%p", static_cast<void*>(s));
+    }
+}
+
+void loop_monitor::timer_dispatched(std::uint64_t lateness_usec) noexcept
+{
+    _lateness.record(lateness_usec);
+}
+
+latency_histogram const& loop_monitor::iterations() const noexcept
+{
+    return _iterations;
+}
+
+latency_histogram const& loop_monitor::lateness() const noexcept
+{
+    return _lateness;
+}
+
+std::uint64_t loop_monitor::stalls() const noexcept
+{
+    return _stalls;
+}
+
+std::string loop_monitor::status() const
+{
+    std::string s{"Loop p99 "};
+    s.append(format_usec(_iterations.quantile(0.99)))
+        .append(" max ").append(format_usec(_iterations.max()))
+        .append(", timers late p99 ").append(format_usec(_lateness.quantile(0.99)))
+        .append(" max ").append(format_usec(_lateness.max()))
+        .append(", ").append(std::to_string(_stalls)).append(" stalls");
+    if (_watchdog_usec > 0) {
+        // the watchdog is pinged from the loop, an iteration as long as the interval kills the service
+        auto used = std::min(_iterations.max(), _watchdog_usec) * 100 / _watchdog_usec;
+        s.append(", watchdog headroom ").append(std::to_string(100 - used)).append("%");
+    }
+    return s;
+}
+
+std::uint64_t core::monotonic_usec() noexcept
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000 + static_cast<std::uint64_t>(ts.tv_nsec) / 1000;
+}
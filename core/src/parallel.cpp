@@ -0,0 +1,62 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+
+std::vector<std::exception_ptr> core::for_each_parallel(std::size_t count,
+                                                        std::function<void(std::size_t)> const& fn)
+{
+    return for_each_parallel(count, std::max(1u, std::thread::hardware_concurrency()), fn);
+}
+
+std::vector<std::exception_ptr> core::for_each_parallel(std::size_t count, std::size_t max_threads,
+                                                        std::function<void(std::size_t)> const& fn)
+{
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    auto thread_count = std::min(count, std::max<std::size_t>(1, max_threads));
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (std::size_t t = 1; t < thread_count; ++t) {
+        try {
+            threads.emplace_back(worker);
+        }
+        catch (std::system_error&) {
+            // out of threads, the running workers and this thread take the remaining indices
+            break;
+        }
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return errors;
+}
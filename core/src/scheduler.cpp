@@ -0,0 +1,280 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/scheduler.h>
+#include <core/loop_monitor.h>
+
+#include <algorithm>
+#include <cassert>
+
+using namespace core;
+
+struct event_scheduler::registration
+{
+    event_scheduler* scheduler;
+    priority_class cls;
+    sd_event_io_handler_t io;
+    sd_event_time_handler_t time;
+    sd_event_handler_t defer;
+    void* userdata;
+    sd_event_source* source{nullptr};
+    int resume{SD_EVENT_OFF};       //!< enable mode restored when the class has tokens again
+};
+
+namespace {
+
+    std::size_t index(priority_class cls)
+    {
+        return static_cast<std::size_t>(cls);
+    }
+
+    template<typename T>
+    void erase(std::vector<T*>& v, T* reg)
+    {
+        auto it = std::find(v.begin(), v.end(), reg);
+        if (it != v.end()) {
+            v.erase(it);
+        }
+    }
+
+} // namespace
+
+event_scheduler::event_scheduler(sd_event_loop loop)
+    : _loop{std::move(loop)}
+{}
+
+event_scheduler::~event_scheduler()
+{
+    // sources may outlive the scheduler, they are dispatched without limit then
+    for (auto reg : _registrations) {
+        reg->scheduler = nullptr;
+    }
+    for (auto& c : _classes) {
+        for (auto reg : c.parked) {
+            sd_event_source_set_enabled(reg->source, reg->resume);
+            reg->resume = SD_EVENT_OFF;
+        }
+        sd_event_source_unref(c.resume_source);
+    }
+}
+
+std::int64_t event_scheduler::priority(priority_class cls) noexcept
+{
+    switch (cls) {
+        case priority_class::realtime:
+            return SD_EVENT_PRIORITY_IMPORTANT;
+        case priority_class::bus:
+            return SD_EVENT_PRIORITY_NORMAL;
+        case priority_class::housekeeping:
+            break;
+    }
+    return SD_EVENT_PRIORITY_IDLE;
+}
+
+void event_scheduler::set_rate_limit(priority_class cls, unsigned rate, unsigned burst)
+{
+    _classes[index(cls)].bucket = token_bucket{rate, burst};
+}
+
+std::uint64_t event_scheduler::throttled(priority_class cls) const noexcept
+{
+    return _classes[index(cls)].throttled;
+}
+
+void event_scheduler::set_monitor(loop_monitor* monitor) noexcept
+{
+    _monitor = monitor;
+}
+
+int event_scheduler::add_io(priority_class cls, sd_event_source** s, int fd, std::uint32_t events,
+                            sd_event_io_handler_t callback, void* userdata)
+{
+    auto reg = new registration{this, cls, callback, nullptr, nullptr, userdata};
+    sd_event_source* source{nullptr};
+    auto r = sd_event_add_io(_loop.get(), &source, fd, events, &event_scheduler::io_handler, reg);
+    return r < 0 ? (delete reg, r) : add(reg, source, s);
+}
+
+int event_scheduler::add_time(priority_class cls, sd_event_source** s, clockid_t clock, std::uint64_t usec,
+                              std::uint64_t accuracy, sd_event_time_handler_t callback, void* userdata)
+{
+    auto reg = new registration{this, cls, nullptr, callback, nullptr, userdata};
+    sd_event_source* source{nullptr};
+    auto r = sd_event_add_time(_loop.get(), &source, clock, usec, accuracy, &event_scheduler::time_handler, reg);
+    return r < 0 ? (delete reg, r) : add(reg, source, s);
+}
+
+int event_scheduler::add_defer(priority_class cls, sd_event_source** s, sd_event_handler_t callback, void* userdata)
+{
+    auto reg = new registration{this, cls, nullptr, nullptr, callback, userdata};
+    sd_event_source* source{nullptr};
+    auto r = sd_event_add_defer(_loop.get(), &source, &event_scheduler::defer_handler, reg);
+    return r < 0 ? (delete reg, r) : add(reg, source, s);
+}
+
+int event_scheduler::add(registration* reg, sd_event_source* source, sd_event_source** s)
+{
+    assert(s != nullptr);
+    reg->source = source;
+    auto r = sd_event_source_set_destroy_callback(source, &event_scheduler::destroy_handler);
+    if (r < 0) {
+        sd_event_source_unref(source);
+        delete reg;
+        return r;
+    }
+    _registrations.push_back(reg);
+    r = sd_event_source_set_priority(source, priority(reg->cls));
+    if (r < 0) {
+        sd_event_source_unref(source);
+        return r;
+    }
+    *s = source;
+    return 0;
+}
+
+bool event_scheduler::admit(registration& reg)
+{
+    if (reg.scheduler == nullptr) {
+        return true;
+    }
+    auto& c = _classes[index(reg.cls)];
+    if (c.bucket.unlimited()) {
+        return true;
+    }
+    std::uint64_t now{0};
+    sd_event_now(_loop.get(), CLOCK_MONOTONIC, &now);
+    if (c.bucket.try_take(now)) {
+        return true;
+    }
+    park(reg, now);
+    return false;
+}
+
+void event_scheduler::park(registration& reg, std::uint64_t now)
+{
+    auto& c = _classes[index(reg.cls)];
+    int enabled{SD_EVENT_OFF};
+    sd_event_source_get_enabled(reg.source, &enabled);
+    // a oneshot source is already disabled while it is dispatched
+    reg.resume = enabled == SD_EVENT_OFF ? SD_EVENT_ONESHOT : enabled;
+    sd_event_source_set_enabled(reg.source, SD_EVENT_OFF);
+    c.parked.push_back(&reg);
+    ++c.throttled;
+
+    auto const next = c.bucket.next_token(now);
+    int r;
+    if (c.resume_source == nullptr) {
+        // an accuracy of 0 would select the default of 250ms
+        r = sd_event_add_time(_loop.get(), &c.resume_source, CLOCK_MONOTONIC, next, 1,
+                              &event_scheduler::resume_handler, &c);
+        if (r >= 0) {
+            r = sd_event_source_set_priority(c.resume_source, priority(reg.cls));
+        }
+    }
+    else {
+        r = sd_event_source_set_time(c.resume_source, next);
+        if (r >= 0) {
+            r = sd_event_source_set_enabled(c.resume_source, SD_EVENT_ONESHOT);
+        }
+    }
+    if (r < 0) {
+        // without the timer the sources would stay disabled, they are resumed right away instead
+        resume_handler(nullptr, now, &c);
+    }
+}
+
+template<typename Fn>
+int event_scheduler::dispatch(registration& reg, Fn&& fn)
+{
+    auto scheduler = reg.scheduler;
+    if (scheduler == nullptr) {
+        return fn();
+    }
+    if (!scheduler->admit(reg)) {
+        return 0;
+    }
+    auto monitor = scheduler->_monitor;
+    if (monitor == nullptr) {
+        return fn();
+    }
+    // the reference keeps the source, and with it reg, alive if the handler releases it
+    auto source = sd_event_source_ref(reg.source);
+    auto const start = monotonic_usec();
+    auto r = fn();
+    monitor->handler_done(source, monotonic_usec() - start);
+    sd_event_source_unref(source);
+    return r;
+}
+
+void event_scheduler::timer_lateness(registration& reg, std::uint64_t deadline)
+{
+    clockid_t clock{CLOCK_MONOTONIC};
+    std::uint64_t accuracy{0};
+    std::uint64_t now{0};
+    if (sd_event_source_get_time_clock(reg.source, &clock) < 0
+        || sd_event_source_get_time_accuracy(reg.source, &accuracy) < 0
+        || sd_event_now(_loop.get(), clock, &now) < 0) {
+        return;
+    }
+    // a timer dispatched within the accuracy it asked for is on time
+    _monitor->timer_dispatched(now > deadline + accuracy ? now - deadline - accuracy : 0);
+}
+
+int event_scheduler::io_handler(sd_event_source* s, int fd, std::uint32_t revents, void* userdata)
+{
+    auto reg = static_cast<registration*>(userdata);
+    return dispatch(*reg, [&]() { return reg->io(s, fd, revents, reg->userdata); });
+}
+
+int event_scheduler::time_handler(sd_event_source* s, std::uint64_t usec, void* userdata)
+{
+    auto reg = static_cast<registration*>(userdata);
+    return dispatch(*reg, [&]() {
+        if (reg->scheduler != nullptr && reg->scheduler->_monitor != nullptr) {
+            reg->scheduler->timer_lateness(*reg, usec);
+        }
+        return reg->time(s, usec, reg->userdata);
+    });
+}
+
+int event_scheduler::defer_handler(sd_event_source* s, void* userdata)
+{
+    auto reg = static_cast<registration*>(userdata);
+    return dispatch(*reg, [&]() { return reg->defer(s, reg->userdata); });
+}
+
+int event_scheduler::resume_handler(sd_event_source* /*s*/, std::uint64_t /*usec*/, void* userdata)
+{
+    auto c = static_cast<class_state*>(userdata);
+    // the sources take their tokens when they are dispatched, those without one are parked again
+    auto parked = std::move(c->parked);
+    c->parked.clear();
+    for (auto reg : parked) {
+        auto resume = reg->resume;
+        reg->resume = SD_EVENT_OFF;
+        sd_event_source_set_enabled(reg->source, resume);
+    }
+    return 0;
+}
+
+void event_scheduler::destroy_handler(void* userdata)
+{
+    auto reg = static_cast<registration*>(userdata);
+    if (reg->scheduler != nullptr) {
+        erase(reg->scheduler->_registrations, reg);
+        erase(reg->scheduler->_classes[index(reg->cls)].parked, reg);
+    }
+    delete reg;
+}
@@ -0,0 +1,70 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/token_bucket.h>
+
+#include <algorithm>
+
+using namespace core;
+
+token_bucket::token_bucket(unsigned rate, unsigned burst) noexcept
+    : _rate{rate}
+    , _capacity{std::max(burst, 1u) * token}
+    , _level{_capacity}
+{}
+
+bool token_bucket::unlimited() const noexcept
+{
+    return _rate == 0;
+}
+
+void token_bucket::refill(std::uint64_t now_usec) noexcept
+{
+    if (now_usec <= _last_usec) {
+        return;
+    }
+    auto const elapsed = now_usec - _last_usec;
+    _last_usec = now_usec;
+    auto const missing = _capacity - _level;
+    // compared by division, the product may overflow after a long idle time
+    if (elapsed >= missing / _rate + 1) {
+        _level = _capacity;
+    }
+    else {
+        _level += elapsed * _rate;
+    }
+}
+
+bool token_bucket::try_take(std::uint64_t now_usec) noexcept
+{
+    if (unlimited()) {
+        return true;
+    }
+    refill(now_usec);
+    if (_level < token) {
+        return false;
+    }
+    _level -= token;
+    return true;
+}
+
+std::uint64_t token_bucket::next_token(std::uint64_t now_usec) const noexcept
+{
+    if (unlimited() || _level >= token) {
+        return now_usec;
+    }
+    auto const next = _last_usec + (token - _level + _rate - 1) / _rate;
+    return std::max(next, now_usec);
+}
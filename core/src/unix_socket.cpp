@@ -0,0 +1,70 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <core/unix_socket.h>
+#include <core/exception.h>
+#include <core/final.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+int core::listen_unix_socket(event_scheduler& scheduler, priority_class cls, std::string const& path,
+                             char const* what, sd_event_source** source, sd_event_io_handler_t callback,
+                             void* userdata)
+{
+    std::string const name{what};
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw core::runtime_exception{name + " socket path too long", ENAMETOOLONG};
+    }
+    std::memcpy(addr.sun_path, path.data(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        throw core::runtime_exception{"cannot create " + name + " socket", errno};
+    }
+    core::final close_fd{[fd](){ ::close(fd); }};
+    // a socket left behind by a previous run would make bind fail
+    unlink(path.c_str());
+    // only owner and group may connect, access is granted by the group of the socket
+    auto mask = umask(0117);
+    auto r = bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+    umask(mask);
+    if (r < 0) {
+        throw core::runtime_exception{"cannot bind " + name + " socket " + path, errno};
+    }
+    core::final unlink_path{[&path](){ unlink(path.c_str()); }};
+    if (listen(fd, SOMAXCONN) < 0) {
+        throw core::runtime_exception{"cannot listen on " + name + " socket " + path, errno};
+    }
+    r = scheduler.add_io(cls, source, fd, EPOLLIN, callback, userdata);
+    if (r >= 0) {
+        r = sd_event_source_set_description(*source, (name + "-accept").c_str());
+    }
+    if (r < 0) {
+        *source = sd_event_source_unref(*source);
+        throw core::runtime_exception{"unable to watch " + name + " socket", r};
+    }
+    unlink_path.reset();
+    close_fd.reset();
+    return fd;
+}
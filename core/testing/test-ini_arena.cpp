@@ -0,0 +1,201 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <doctest/doctest.h>
+#include <core/ini.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    bool count_allocations{false};
+    std::size_t allocation_count{0};
+
+    //! Counts the global heap allocations during its lifetime.
+    class allocation_counter {
+    public:
+        allocation_counter()
+        {
+            allocation_count = 0;
+            count_allocations = true;
+        }
+
+        ~allocation_counter()
+        {
+            count_allocations = false;
+        }
+
+        std::size_t stop()
+        {
+            count_allocations = false;
+            return allocation_count;
+        }
+    };
+
+    std::string make_ini(int section_count)
+    {
+        std::ostringstream txt;
+        txt << "root-property = 'root'\n";
+        for (int i = 0; i < section_count; ++i) {
+            txt << "# gpio line " << i << "\n"
+                << "[gpio = gpiochip0-" << i << "]\n"
+                << "name = \"a rather long line name that does not fit into small strings " << i << "\"\n"
+                << "consumer = wire\\\n   ctrl\n"
+                << "init-level = inactive\n"
+                << "active-level = high\n\n";
+        }
+        return txt.str();
+    }
+
+} // namespace
+
+// GCC >= 11 reports malloc/free in replaced new/delete as mismatched when they get inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size)
+{
+    if (count_allocations) {
+        ++allocation_count;
+    }
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// std::pmr::new_delete_resource allocates with the aligned variants
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (count_allocations) {
+        ++allocation_count;
+    }
+    auto align = static_cast<std::size_t>(alignment);
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+TEST_CASE("ini-file parsed into arena without heap allocations")
+{
+    for (int section_count : {1, 100, 5000}) {
+        auto text = make_ini(section_count);
+        std::istringstream istr{text};
+        std::vector<std::byte> buffer(text.size() * 16 + 65536);
+        std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+
+        allocation_counter counter;
+        core::ini::file f{istr, true, &arena};
+        auto allocations = counter.stop();
+
+        CHECK_EQ(allocations, 0);
+        REQUIRE_EQ(f.sections().size(), section_count + 1);
+        CHECK_EQ(f.sections()[0].properties[0].value, "root");
+        auto const& last = f.sections().back();
+        CHECK_EQ(last.name, "gpio");
+        CHECK_EQ(std::string_view{last.value}, "gpiochip0-" + std::to_string(section_count - 1));
+        REQUIRE_EQ(last.properties.size(), 4);
+        CHECK_EQ(last.properties[1].value, "wirectrl");
+    }
+}
+
+TEST_CASE("ini-file index built in arena without heap allocations")
+{
+    for (int section_count : {1, 100, 5000}) {
+        auto text = make_ini(section_count);
+        std::istringstream istr{text};
+        std::vector<std::byte> buffer(text.size() * 24 + 65536);
+        std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+        core::ini::file f{istr, true, &arena};
+
+        allocation_counter counter;
+        f.build_index();
+        auto allocations = counter.stop();
+
+        CHECK_EQ(allocations, 0);
+        auto const& last = f.sections().back();
+        auto p = last.find("consumer");
+        REQUIRE_NE(p, nullptr);
+        CHECK_EQ(p->value, "wirectrl");
+        CHECK_EQ(last.find("unknown"), nullptr);
+        auto gpios = f.sections("gpio");
+        REQUIRE_EQ(gpios.size(), section_count);
+        CHECK_EQ(gpios.back(), &last);
+        CHECK(f.sections("unknown").empty());
+    }
+}
+
+TEST_CASE("ini-file heap allocations with growing arena")
+{
+    auto text = make_ini(5000);
+    std::istringstream istr{text};
+    std::pmr::monotonic_buffer_resource arena{};
+
+    allocation_counter counter;
+    core::ini::file f{istr, true, &arena};
+    auto allocations = counter.stop();
+
+    // the arena grows geometrically, the number of allocations does not depend on the number of lines
+    CHECK_LT(allocations, 64);
+    CHECK_EQ(f.sections().size(), 5001);
+}
+
+TEST_CASE("ini-file copy does not depend on arena")
+{
+    auto text = make_ini(10);
+    core::ini::file copy{};
+    {
+        std::istringstream istr{text};
+        std::pmr::monotonic_buffer_resource arena{};
+        core::ini::file f{istr, true, &arena};
+        copy = f;
+    }
+    REQUIRE_EQ(copy.sections().size(), 11);
+    CHECK_EQ(copy.sections()[10].value, "gpiochip0-9");
+    CHECK_EQ(copy.sections()[10].line_number, 75);
+}
@@ -17,7 +17,9 @@
 #include <doctest/doctest.h>
 #include <core/ini.h>
 
+#include <memory_resource>
 #include <sstream>
+#include <vector>
 
 TEST_CASE("ini-file empty")
 {
@@ -64,7 +66,7 @@ pull-resistor =
     CHECK_EQ(gpio_section.value, "0-17");
     CHECK_EQ(gpio_section.properties.size(), 6);
     CHECK_EQ(gpio_section.properties[5].name, "pull-resistor");
-    CHECK_EQ(gpio_section.properties[5].value, std::string{});
+    CHECK_EQ(gpio_section.properties[5].value, "");
 }
 
 TEST_CASE("ini-file merge")
@@ -109,3 +111,49 @@ consumer = "asdd" #default is wirectrl
     CHECK_EQ(merged.sections()[2].name, "gpio");
     CHECK_EQ(merged.sections()[2].properties.size(), 2);
 }
+
+TEST_CASE("ini-file merge by moving sections")
+{
+    const char* txt1 = "root = 1\n[gpio = 0-1]\nname = a\n[dbus]\n";
+    const char* txt2 = "root = 2\n[gpio = 0-2]\nname = b\n";
+
+    std::istringstream istr1{txt1};
+    std::istringstream istr2{txt2};
+    std::pmr::monotonic_buffer_resource arena{};
+    std::vector<core::ini::file> files;
+    files.emplace_back(istr1, true, &arena);
+    files.emplace_back(istr2, true, &arena);
+
+    auto copied = core::ini::merge_files(files);
+    auto merged = core::ini::merge_files(std::move(files));
+
+    REQUIRE_EQ(merged.sections().size(), 4);
+    REQUIRE_EQ(copied.sections().size(), 4);
+    for (std::size_t i = 0; i < merged.sections().size(); ++i) {
+        CHECK_EQ(merged.sections()[i].name, copied.sections()[i].name);
+        CHECK_EQ(merged.sections()[i].value, copied.sections()[i].value);
+        CHECK_EQ(merged.sections()[i].properties.size(), copied.sections()[i].properties.size());
+    }
+    CHECK_EQ(merged.sections()[0].properties.size(), 2);
+    CHECK_EQ(merged.sections()[3].value, "0-2");
+    // moved sections keep the memory resource they were parsed into, copies use the default resource
+    CHECK_EQ(merged.sections()[3].properties[0].name.get_allocator().resource(), &arena);
+    CHECK_EQ(copied.sections()[3].properties[0].name.get_allocator().resource(),
+             std::pmr::get_default_resource());
+}
+
+TEST_CASE("ini-file parse_exception")
+{
+    std::istringstream istr{"[dbus]\n\n# comment\nconnection-id\n"};
+    try {
+        core::ini::file f{istr};
+        FAIL("expected parse_exception");
+    }
+    catch (core::ini::parse_exception& e) {
+        CHECK_EQ(e.line_number(), 4);
+        CHECK_EQ(e.expression(), "connection-id");
+        CHECK(e.source().empty());
+    }
+    core::ini::parse_exception e{3, "x", "/etc/wirectrl/conf.d/10-lines.conf"};
+    CHECK_EQ(e.source(), "/etc/wirectrl/conf.d/10-lines.conf");
+}
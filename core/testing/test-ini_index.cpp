@@ -0,0 +1,121 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <doctest/doctest.h>
+#include <core/ini.h>
+
+#include <sstream>
+
+namespace {
+
+    const char* index_txt =
+R"ini(
+[dbus]
+connection-id = "de.titnc.pi.wirectrl"
+use-session-bus = false
+
+[gpio = 0-17]
+name = "AV-Receiver"
+line = 17
+offset = -3
+name = "duplicate"
+
+[scene = off]
+AV-Receiver = inactive
+
+[gpio = 0-18]
+name = "Light"
+use-session-bus = maybe
+line = 18x
+)ini";
+
+    enum class level { active, inactive };
+
+} // namespace
+
+TEST_CASE("ini-file section index")
+{
+    std::istringstream istr{index_txt};
+    core::ini::file f{istr};
+
+    auto unindexed = f.sections("gpio");
+    f.build_index();
+    auto gpios = f.sections("gpio");
+    REQUIRE_EQ(gpios.size(), 2);
+    CHECK_EQ(gpios, unindexed);
+    CHECK_EQ(gpios[0]->value, "0-17");
+    CHECK_EQ(gpios[1]->value, "0-18");
+    CHECK_EQ(f.sections("dbus").size(), 1);
+    CHECK_EQ(f.sections("scene").size(), 1);
+    CHECK(f.sections("unknown").empty());
+
+    auto copy = f;
+    REQUIRE_EQ(copy.sections("gpio").size(), 2);
+    CHECK_EQ(copy.sections("gpio")[1], &copy.sections()[3]);
+}
+
+TEST_CASE("ini-file property index")
+{
+    std::istringstream istr{index_txt};
+    core::ini::file f{istr};
+    f.build_index();
+
+    auto const& gpio = f.sections()[1];
+    REQUIRE(gpio.find("name"));
+    CHECK_EQ(gpio.find("name")->value, "AV-Receiver"); // first of duplicates
+    CHECK_EQ(gpio.find("line")->value, "17");
+    CHECK_FALSE(gpio.find("consumer"));
+
+    // changing the properties invalidates the index, find falls back to linear search
+    auto changed = gpio;
+    changed.properties.push_back(core::ini::property{"consumer", "wirectrl", 42});
+    REQUIRE(changed.find("consumer"));
+    CHECK_EQ(changed.find("consumer")->line_number, 42);
+}
+
+TEST_CASE("ini-file typed accessors")
+{
+    std::istringstream istr{index_txt};
+    core::ini::file f{istr};
+    f.build_index();
+
+    auto const& dbus = f.sections()[0];
+    auto const& gpio = f.sections()[1];
+    auto const& bad_gpio = f.sections()[3];
+
+    CHECK_EQ(dbus.get<std::string>("connection-id"), std::string{"de.titnc.pi.wirectrl"});
+    CHECK_EQ(dbus.get<bool>("use-session-bus"), false);
+    CHECK_EQ(dbus.get<bool>("missing", true), true);
+    CHECK_FALSE(dbus.get<bool>("missing").has_value());
+    CHECK_EQ(gpio.get<unsigned>("line"), 17u);
+    CHECK_EQ(gpio.get<int>("offset"), -3);
+    CHECK_EQ(f.sections()[2].get_enum<level>("AV-Receiver", {{"active", level::active},
+                                                             {"inactive", level::inactive}}, level::active),
+             level::inactive);
+
+    try {
+        bad_gpio.get<unsigned>("line");
+        FAIL("expected parse_exception");
+    }
+    catch (core::ini::parse_exception& e) {
+        CHECK_EQ(e.line_number(), 18);
+        CHECK_EQ(e.expression(), "line = 18x");
+    }
+    CHECK_THROWS_AS(bad_gpio.get<bool>("use-session-bus"), core::ini::parse_exception);
+    CHECK_THROWS_AS(gpio.get<unsigned>("offset"), core::ini::parse_exception);
+    CHECK_THROWS_AS(bad_gpio.get_enum<level>("name", {{"active", level::active}}, level::active),
+                    core::ini::parse_exception);
+}
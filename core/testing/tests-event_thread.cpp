@@ -0,0 +1,105 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/event_thread.h>
+
+#include <systemd/sd-event.h>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST_CASE("event_thread runs posted tasks in order on its thread")
+{
+    core::event_thread worker{"test-worker"};
+    CHECK_EQ(worker.name(), "test-worker");
+
+    std::vector<int> order;
+    std::promise<std::thread::id> id;
+    for (int i = 0; i < 100; ++i) {
+        worker.post([&order, i]() { order.push_back(i); });
+    }
+    worker.post([&id]() { id.set_value(std::this_thread::get_id()); });
+    bool const other_thread = id.get_future().get() != std::this_thread::get_id();
+    CHECK(other_thread);
+
+    worker.post([]() { throw std::runtime_error{"ignored"}; });
+    worker.post([&order]() { order.push_back(100); });
+    worker.stop();
+    REQUIRE_EQ(order.size(), 101);
+    for (int i = 0; i <= 100; ++i) {
+        CHECK_EQ(order[static_cast<std::size_t>(i)], i);
+    }
+    worker.stop();
+}
+
+TEST_CASE("task_queue accepts tasks from many threads")
+{
+    auto loop = core::sd_event_loop::create();
+    core::task_queue queue{loop};
+    std::atomic<int> done{0};
+    constexpr int per_thread = 1000;
+    constexpr int threads = 4;
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < threads; ++t) {
+        producers.emplace_back([&]() {
+            for (int i = 0; i < per_thread; ++i) {
+                queue.post([&]() {
+                    if (++done == threads * per_thread) {
+                        sd_event_exit(loop.get(), 0);
+                    }
+                });
+            }
+        });
+    }
+    CHECK_GE(sd_event_loop(loop.get()), 0);
+    for (auto& p : producers) {
+        p.join();
+    }
+    CHECK_EQ(done.load(), threads * per_thread);
+}
+
+TEST_CASE("event_pool distributes tasks and posts results back")
+{
+    auto loop = core::sd_event_loop::create();
+    core::task_queue results{loop};
+    std::set<std::thread::id> ids;
+    int remaining = 8;
+    {
+        core::event_pool pool{"test-pool", 4};
+        REQUIRE_EQ(pool.size(), 4);
+        CHECK_EQ(pool[3].name(), "test-pool-3");
+        for (int i = 0; i < remaining; ++i) {
+            pool.post([&]() {
+                auto id = std::this_thread::get_id();
+                results.post([&, id]() {
+                    ids.insert(id);
+                    if (--remaining == 0) {
+                        sd_event_exit(loop.get(), 0);
+                    }
+                });
+            });
+        }
+        CHECK_GE(sd_event_loop(loop.get()), 0);
+    }
+    CHECK_EQ(remaining, 0);
+    CHECK_EQ(ids.size(), 4);
+    CHECK_EQ(ids.count(std::this_thread::get_id()), 0);
+}
@@ -0,0 +1,151 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/journal.h>
+
+#include <syslog.h>
+
+#include <future>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct entry {
+        int priority;
+        int error;
+        std::string line;
+        std::string chip;
+        std::string message;
+        unsigned repeated;
+    };
+
+    struct collector {
+        std::mutex m;
+        std::vector<entry> entries;
+
+        core::journal_writer::sink_fn sink()
+        {
+            return [this](core::log_record const& r, unsigned repeated) {
+                std::lock_guard<std::mutex> lock{m};
+                entries.push_back({r.priority, r.error, r.line, r.chip, r.message, repeated});
+            };
+        }
+    };
+
+} // namespace
+
+TEST_CASE("journal_writer sends entries in order with their fields")
+{
+    collector c;
+    {
+        core::journal_writer writer{{}, c.sink()};
+        writer.log(LOG_ERR, {"relay1", "gpiochip0", 5}, "cannot set %s to %i", "relay1", 1);
+        writer.log(LOG_INFO, {}, "plain");
+        writer.log(LOG_WARNING, {"relay2", nullptr, 0}, "second");
+    }
+    REQUIRE_EQ(c.entries.size(), 3);
+    CHECK_EQ(c.entries[0].priority, LOG_ERR);
+    CHECK_EQ(c.entries[0].error, 5);
+    CHECK_EQ(c.entries[0].line, "relay1");
+    CHECK_EQ(c.entries[0].chip, "gpiochip0");
+    CHECK_EQ(c.entries[0].message, "cannot set relay1 to 1");
+    CHECK_EQ(c.entries[1].message, "plain");
+    CHECK(c.entries[1].line.empty());
+    CHECK_EQ(c.entries[2].line, "relay2");
+    CHECK(c.entries[2].chip.empty());
+    CHECK_EQ(c.entries[2].repeated, 0);
+}
+
+TEST_CASE("journal_writer folds identical entries into a count")
+{
+    collector c;
+    {
+        core::journal_writer writer{{}, c.sink()};
+        for (int i = 0; i < 5; ++i) {
+            writer.log(LOG_ERR, {"relay1", nullptr, 16}, "busy");
+        }
+        writer.log(LOG_ERR, {"relay1", nullptr, 16}, "other");
+    }
+    REQUIRE_EQ(c.entries.size(), 3);
+    CHECK_EQ(c.entries[0].message, "busy");
+    CHECK_EQ(c.entries[0].repeated, 0);
+    CHECK_EQ(c.entries[1].message, "busy");
+    CHECK_EQ(c.entries[1].repeated, 4);
+    CHECK_EQ(c.entries[2].message, "other");
+}
+
+TEST_CASE("journal_writer reports entries above the rate")
+{
+    collector c;
+    std::uint64_t suppressed;
+    {
+        core::journal_writer::options opts;
+        opts.rate = 1;
+        opts.burst = 3;
+        core::journal_writer writer{opts, c.sink()};
+        for (int i = 0; i < 10; ++i) {
+            writer.log(LOG_ERR, {}, "entry %i", i);
+        }
+        // the first three are sent right away, a summary follows at the latest on shutdown
+        while (writer.suppressed() < 7) {
+            std::this_thread::yield();
+        }
+        suppressed = writer.suppressed();
+    }
+    CHECK_EQ(suppressed, 7);
+    REQUIRE_EQ(c.entries.size(), 4);
+    CHECK_EQ(c.entries[0].message, "entry 0");
+    CHECK_EQ(c.entries[2].message, "entry 2");
+    CHECK_EQ(c.entries[3].priority, LOG_WARNING);
+    CHECK_EQ(c.entries[3].message, "7 journal entries suppressed by the rate limit, 0 dropped on a full ring");
+}
+
+TEST_CASE("journal_writer drops entries on a full ring")
+{
+    collector c;
+    std::promise<void> entered;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    auto sink = c.sink();
+    bool first{true};
+    {
+        core::journal_writer::options opts;
+        opts.capacity = 2;
+        core::journal_writer writer{opts, [&](core::log_record const& r, unsigned repeated) {
+            if (first) {
+                first = false;
+                entered.set_value();
+                released.wait();
+            }
+            sink(r, repeated);
+        }};
+        writer.log(LOG_ERR, {}, "blocked");
+        entered.get_future().wait();
+        for (int i = 0; i < 4; ++i) {
+            writer.log(LOG_ERR, {}, "entry %i", i);
+        }
+        CHECK_EQ(writer.dropped(), 2);
+        release.set_value();
+    }
+    REQUIRE_EQ(c.entries.size(), 4);
+    CHECK_EQ(c.entries[0].message, "blocked");
+    CHECK_EQ(c.entries[1].message, "entry 0");
+    CHECK_EQ(c.entries[2].message, "entry 1");
+    CHECK_EQ(c.entries[3].message, "0 journal entries suppressed by the rate limit, 2 dropped on a full ring");
+}
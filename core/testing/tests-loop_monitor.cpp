@@ -0,0 +1,98 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/loop_monitor.h>
+#include <core/scheduler.h>
+
+#include <systemd/sd-event.h>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+    int slow_timer(sd_event_source* s, std::uint64_t /*usec*/, void* /*userdata*/)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        return sd_event_exit(sd_event_source_get_event(s), 0);
+    }
+
+} // namespace
+
+TEST_CASE("latency_histogram buckets and quantiles")
+{
+    core::latency_histogram h;
+    CHECK_EQ(h.quantile(0.99), 0);
+
+    for (std::uint64_t usec = 0; usec < 100; ++usec) {
+        h.record(usec);
+    }
+    h.record(5000);
+    CHECK_EQ(h.count(), 101);
+    CHECK_EQ(h.max(), 5000);
+    CHECK_EQ(h.sum(), 4950 + 5000);
+    CHECK_EQ(h.buckets()[0], 1);
+    CHECK_EQ(h.buckets()[1], 1);
+    CHECK_EQ(h.buckets()[2], 2);
+    CHECK_EQ(h.buckets()[7], 36);
+    CHECK_EQ(h.buckets()[13], 1);
+    CHECK_EQ(h.quantile(0.5), 64);
+    CHECK_EQ(h.quantile(0.99), 128);
+    CHECK_EQ(h.quantile(1.0), 5000);
+
+    h.record(std::uint64_t{1} << 40);
+    CHECK_EQ(h.buckets()[core::latency_histogram::bucket_count - 1], 1);
+    CHECK_EQ(h.quantile(1.0), std::uint64_t{1} << 40);
+}
+
+TEST_CASE("loop_monitor counts stalls above the threshold")
+{
+    core::loop_monitor m;
+    m.begin_iteration();
+    m.end_iteration(1000000);
+    CHECK_EQ(m.stalls(), 0);
+
+    m.set_threshold(1000);
+    m.begin_iteration();
+    m.end_iteration(999);
+    m.begin_iteration();
+    m.end_iteration(2000);
+    CHECK_EQ(m.stalls(), 1);
+    CHECK_EQ(m.iterations().count(), 3);
+    CHECK_NE(m.status().find("1 stalls"), std::string::npos);
+    CHECK_EQ(m.status().find("watchdog"), std::string::npos);
+    m.set_watchdog_interval(4000000);
+    CHECK_NE(m.status().find("watchdog headroom 75%"), std::string::npos);
+}
+
+TEST_CASE("event_scheduler reports timer lateness to the monitor")
+{
+    auto loop = core::sd_event_loop::create();
+    core::loop_monitor monitor;
+    core::event_scheduler scheduler{loop};
+    scheduler.set_monitor(&monitor);
+
+    std::uint64_t now{0};
+    sd_event_now(loop.get(), CLOCK_MONOTONIC, &now);
+    sd_event_source* s{nullptr};
+    // the deadline passed 20ms ago, the accuracy of 1ms is on time
+    REQUIRE_GE(scheduler.add_time(core::priority_class::realtime, &s, CLOCK_MONOTONIC, now - 20000, 1000,
+                                  &slow_timer, nullptr), 0);
+    CHECK_GE(sd_event_loop(loop.get()), 0);
+    REQUIRE_EQ(monitor.lateness().count(), 1);
+    CHECK_GE(monitor.lateness().max(), 19000);
+    sd_event_source_unref(s);
+}
@@ -0,0 +1,75 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST_CASE("for_each_parallel calls every index once")
+{
+    std::vector<int> calls(1000, 0);
+    auto errors = core::for_each_parallel(calls.size(), [&calls](std::size_t i) {
+        ++calls[i];
+    });
+    CHECK_EQ(errors.size(), calls.size());
+    CHECK_EQ(std::count(calls.begin(), calls.end(), 1), 1000);
+    CHECK(std::none_of(errors.begin(), errors.end(), [](auto const& e) { return bool(e); }));
+
+    CHECK(core::for_each_parallel(0, [](std::size_t) { FAIL("not called"); }).empty());
+}
+
+TEST_CASE("for_each_parallel returns exceptions by index")
+{
+    auto errors = core::for_each_parallel(8, 8, [](std::size_t i) {
+        if (i % 3 == 1) {
+            throw std::runtime_error{std::to_string(i)};
+        }
+    });
+    REQUIRE_EQ(errors.size(), 8);
+    for (std::size_t i = 0; i < errors.size(); ++i) {
+        CHECK_EQ(bool(errors[i]), i % 3 == 1);
+    }
+    CHECK_THROWS_WITH(std::rethrow_exception(errors[4]), "4");
+}
+
+TEST_CASE("for_each_parallel runs blocking calls concurrently")
+{
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::mutex m;
+    std::set<std::thread::id> ids;
+    core::for_each_parallel(4, 4, [&](std::size_t) {
+        auto now = ++running;
+        for (auto prev = max_running.load(); prev < now && !max_running.compare_exchange_weak(prev, now);) {
+        }
+        {
+            std::lock_guard<std::mutex> lock{m};
+            ids.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        --running;
+    });
+    CHECK_EQ(ids.size(), 4);
+    CHECK_EQ(max_running.load(), 4);
+}
@@ -0,0 +1,139 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/scheduler.h>
+#include <core/token_bucket.h>
+
+#include <systemd/sd-event.h>
+
+#include <string>
+
+namespace {
+
+    struct recorder {
+        sd_event* event;
+        std::string calls{};
+        int remaining{0};
+
+        int record(char c)
+        {
+            calls += c;
+            return --remaining == 0 ? sd_event_exit(event, 0) : 0;
+        }
+    };
+
+    int record_a(sd_event_source* /*s*/, void* userdata)
+    {
+        return static_cast<recorder*>(userdata)->record('a');
+    }
+
+    int record_b(sd_event_source* /*s*/, void* userdata)
+    {
+        return static_cast<recorder*>(userdata)->record('b');
+    }
+
+    int record_c(sd_event_source* /*s*/, void* userdata)
+    {
+        return static_cast<recorder*>(userdata)->record('c');
+    }
+
+} // namespace
+
+TEST_CASE("token_bucket refills at its rate up to the burst")
+{
+    core::token_bucket unlimited;
+    CHECK(unlimited.unlimited());
+    CHECK(unlimited.try_take(0));
+    CHECK_EQ(unlimited.next_token(42), 42);
+
+    core::token_bucket bucket{10, 2};
+    CHECK_FALSE(bucket.unlimited());
+    CHECK(bucket.try_take(1000000));
+    CHECK(bucket.try_take(1000000));
+    CHECK_FALSE(bucket.try_take(1000000));
+    CHECK_EQ(bucket.next_token(1000000), 1100000);
+    CHECK_FALSE(bucket.try_take(1099999));
+    CHECK(bucket.try_take(1100000));
+    // a long pause refills no more than the burst
+    CHECK(bucket.try_take(100000000));
+    CHECK(bucket.try_take(100000000));
+    CHECK_FALSE(bucket.try_take(100000000));
+}
+
+TEST_CASE("event_scheduler dispatches classes by priority")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    recorder rec{loop.get(), {}, 3};
+
+    sd_event_source* sources[3]{};
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::housekeeping, &sources[0], &record_c, &rec), 0);
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::bus, &sources[1], &record_b, &rec), 0);
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::realtime, &sources[2], &record_a, &rec), 0);
+
+    CHECK_GE(sd_event_loop(loop.get()), 0);
+    CHECK_EQ(rec.calls, "abc");
+    for (auto s : sources) {
+        sd_event_source_unref(s);
+    }
+}
+
+TEST_CASE("event_scheduler delays dispatches beyond the class rate")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    scheduler.set_rate_limit(core::priority_class::realtime, 100, 2);
+    recorder rec{loop.get(), {}, 5};
+
+    sd_event_source* s{nullptr};
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::realtime, &s, &record_a, &rec), 0);
+    REQUIRE_GE(sd_event_source_set_enabled(s, SD_EVENT_ON), 0);
+
+    std::uint64_t start{0};
+    std::uint64_t end{0};
+    sd_event_now(loop.get(), CLOCK_MONOTONIC, &start);
+    CHECK_GE(sd_event_loop(loop.get()), 0);
+    sd_event_now(loop.get(), CLOCK_MONOTONIC, &end);
+
+    CHECK_EQ(rec.calls, "aaaaa");
+    CHECK_EQ(scheduler.throttled(core::priority_class::realtime), 3);
+    CHECK_EQ(scheduler.throttled(core::priority_class::bus), 0);
+    // three tokens beyond the burst take 10ms each
+    CHECK_GE(end - start, 30000);
+    sd_event_source_unref(s);
+}
+
+TEST_CASE("event_scheduler resumes oneshot sources once")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    scheduler.set_rate_limit(core::priority_class::bus, 1000, 1);
+    recorder rec{loop.get(), {}, 2};
+
+    sd_event_source* sources[2]{};
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::bus, &sources[0], &record_a, &rec), 0);
+    REQUIRE_GE(scheduler.add_defer(core::priority_class::bus, &sources[1], &record_b, &rec), 0);
+
+    CHECK_GE(sd_event_loop(loop.get()), 0);
+    CHECK_EQ(rec.calls.size(), 2);
+    CHECK_EQ(scheduler.throttled(core::priority_class::bus), 1);
+    for (auto s : sources) {
+        int enabled{SD_EVENT_ON};
+        sd_event_source_get_enabled(s, &enabled);
+        CHECK_EQ(enabled, SD_EVENT_OFF);
+        sd_event_source_unref(s);
+    }
+}
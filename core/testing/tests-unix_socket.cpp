@@ -0,0 +1,94 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include <core/exception.h>
+#include <core/unix_socket.h>
+
+#include <systemd/sd-event.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace {
+
+    int accept_one(sd_event_source* /*s*/, int fd, std::uint32_t /*revents*/, void* userdata)
+    {
+        auto client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client >= 0) {
+            ++*static_cast<int*>(userdata);
+            close(client);
+        }
+        return 0;
+    }
+
+} // namespace
+
+TEST_CASE("unix socket listens with group access and replaces a stale file")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    std::string const path{"/tmp/core-test-unix-" + std::to_string(::getpid()) + ".socket"};
+    std::ofstream{path} << "stale";
+
+    int accepted{0};
+    sd_event_source* source{nullptr};
+    auto fd = core::listen_unix_socket(scheduler, core::priority_class::housekeeping, path, "test", &source,
+                                       &accept_one, &accepted);
+    REQUIRE_GE(fd, 0);
+    REQUIRE_NE(source, nullptr);
+    char const* description{nullptr};
+    REQUIRE_GE(sd_event_source_get_description(source, &description), 0);
+    CHECK_EQ(std::string{description}, "test-accept");
+
+    struct stat st{};
+    REQUIRE_EQ(::stat(path.c_str(), &st), 0);
+    CHECK(S_ISSOCK(st.st_mode));
+    CHECK_EQ(st.st_mode & 0777, 0660);
+
+    auto client = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE_GE(client, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE_EQ(::connect(client, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    for (int i = 0; i < 100 && accepted == 0; ++i) {
+        REQUIRE_GE(sd_event_run(loop.get(), 10000), 0);
+    }
+    CHECK_EQ(accepted, 1);
+
+    ::close(client);
+    sd_event_source_unref(source);
+    ::close(fd);
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("unix socket path too long")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    sd_event_source* source{nullptr};
+    std::string const path(sizeof(sockaddr_un::sun_path), 'x');
+    CHECK_THROWS_AS(core::listen_unix_socket(scheduler, core::priority_class::housekeeping, "/tmp/" + path,
+                                             "test", &source, &accept_one, nullptr),
+                    core::runtime_exception);
+    CHECK_EQ(source, nullptr);
+}
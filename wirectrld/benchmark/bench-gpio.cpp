@@ -0,0 +1,170 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+// Compares writing GPIO output lines through libgpiod with the raw GPIO v2 uAPI backend.
+// Every iteration toggles all lines: line by line with libgpiod, line by line on a raw request
+// and as one batch on a raw request. Reports the time and the heap allocations per batch.
+// Meant to run against gpio-sim, e.g. as root:
+//   modprobe gpio-sim
+//   mkdir -p /sys/kernel/config/gpio-sim/bench/bank0
+//   echo 64 > /sys/kernel/config/gpio-sim/bench/bank0/num_lines
+//   echo 1 > /sys/kernel/config/gpio-sim/bench/live
+//   bench-gpio $(cat /sys/kernel/config/gpio-sim/bench/bank0/chip_name)
+// Usage: bench-gpio <chip> [lines] [iterations]
+#include "types.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+    std::size_t allocation_count{0};
+
+    struct result {
+        double seconds;
+        std::size_t allocations;
+    };
+
+    //! The lines of one chip; the lines are released before the chip.
+    struct bench_lines {
+        std::unique_ptr<gpio::chip> chip;
+        std::vector<gpio::gpio_line> lines{};
+    };
+
+    bench_lines make_lines(std::string const& chip_name, gpio::chip_backend backend, unsigned count)
+    {
+        bench_lines b{std::make_unique<gpio::chip>(chip_name, backend)};
+        b.lines.reserve(count);
+        for (unsigned i = 0; i < count; ++i) {
+            b.lines.emplace_back(*b.chip, i, "bench-gpio", gpio::level::inactive, gpio::active_level::active_high);
+        }
+        std::vector<gpio::gpio_line*> request;
+        for (auto& l : b.lines) {
+            request.push_back(&l);
+        }
+        for (auto const& failure : gpio::request_lines(request)) {
+            if (failure) {
+                std::fprintf(stderr, "request failed: %s (%i)\n", failure->message().c_str(), failure->error());
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        return b;
+    }
+
+    template<typename Write>
+    result measure(unsigned iterations, Write&& write)
+    {
+        auto allocations_before = allocation_count;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            write(i % 2 == 0 ? gpio::level::active : gpio::level::inactive);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        return result{std::chrono::duration<double>(stop - start).count(), allocation_count - allocations_before};
+    }
+
+    void report(char const* name, unsigned lines, unsigned iterations, result const& r)
+    {
+        std::printf("%-16s %6u %12.0f %16.2f\n", name, lines, r.seconds * 1e9 / iterations,
+                    static_cast<double>(r.allocations) / iterations);
+    }
+
+    void set_each(std::vector<gpio::gpio_line>& lines, gpio::level lev)
+    {
+        for (auto& l : lines) {
+            l.set_level(lev);
+        }
+    }
+
+} // namespace
+
+// Counting replacements of the global allocation functions.
+// GCC >= 11 reports malloc/free in replaced new/delete as mismatched when they get inlined.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: bench-gpio <chip> [lines] [iterations]\n");
+        return EXIT_FAILURE;
+    }
+    std::string chip_name{argv[1]};
+    unsigned count = argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 64u;
+    unsigned iterations = argc > 3 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 100000u;
+    if (count == 0 || count > 64) {
+        std::fprintf(stderr, "lines must be 1..64\n");
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%-16s %6s %12s %16s\n", "path", "lines", "ns/batch", "allocs/batch");
+    try {
+        {
+            auto b = make_lines(chip_name, gpio::chip_backend::gpiod, count);
+            report("gpiod", count, iterations, measure(iterations, [&](gpio::level lev) {
+                set_each(b.lines, lev);
+            }));
+        }
+        {
+            auto b = make_lines(chip_name, gpio::chip_backend::raw, count);
+            report("raw per line", count, iterations, measure(iterations, [&](gpio::level lev) {
+                set_each(b.lines, lev);
+            }));
+
+            auto const all = count == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << count) - 1;
+            report("raw batch", count, iterations, measure(iterations, [&](gpio::level lev) {
+                auto mask = all;
+                gpio::set_raw_levels(b.lines.data(), mask, lev == gpio::level::active ? all : 0);
+                if (mask != 0) {
+                    std::fprintf(stderr, "batch write failed\n");
+                    std::exit(EXIT_FAILURE);
+                }
+            }));
+        }
+    }
+    catch (gpio::gpio_exception& e) {
+        std::fprintf(stderr, "%s (%i)\n", e.message().c_str(), e.error());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -15,49 +15,1285 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "application.h"
 
-#include <systemd/sd-journal.h>
+#include <systemd/sd-event.h>
+
+#include <core/exception.h>
+#include <core/final.h>
+#include <core/journal.h>
+#include <core/parallel.h>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
 
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <iterator>
+#include <optional>
+
+#define WIRECTRL_INTERFACE          ("de.titnc.pi.wirectrl")
+
+// ----------------------------------------------------------------------------
+// application
+// ----------------------------------------------------------------------------
+application::application(configuration const& config)
+    : core::dbus_application{config.dbus.use_session_bus ? core::DBusType::Session : core::DBusType::System,
+                             config.dbus.connection_name, config.dbus.peer_socket}
+    , _object_name{config.dbus.object_name}
+    , _client_key{config.dbus.client_key}
+    , _verify_config{config.verify}
+    , _metrics_config{config.metrics}
+    , _lines{config.gpios, config.chips}
+    , _broadcast_lines{config.dbus.broadcast_lines}
+    , _authorization_ttl{std::uint64_t{config.dbus.authorization_ttl} * 1000000}
+    , _limiter{config.dbus.client_rate, config.dbus.client_burst}
+{
+    auto const& sc = config.scheduler;
+    scheduler().set_rate_limit(core::priority_class::realtime, sc.realtime.rate, sc.realtime.burst);
+    scheduler().set_rate_limit(core::priority_class::bus, sc.bus.rate, sc.bus.burst);
+    scheduler().set_rate_limit(core::priority_class::housekeeping, sc.housekeeping.rate, sc.housekeeping.burst);
+    monitor().set_threshold(std::uint64_t{sc.lag_threshold_ms} * 1000);
+
+    resolve_access(config.gpios);
+    resolve_scenes(config.scenes);
+    resolve_rules(config.rules);
+    _line_toggles.assign(_lines.size(), 0);
+    core::log(LOG_INFO, {}, "%zu GPIO lines on %zu chips, line table %zu bytes", _lines.size(),
+              _lines.chip_count(), _lines.memory_usage());
+}
+
+application::~application() = default;
+
+void application::pre_run()
+{
+    // the interface is registered first, so lines not requested eagerly do not delay it
+    setup_dbus_interface();
+    setup_gpio();
+    setup_rules();
+    setup_verify();
+    setup_metrics();
+}
+
+void application::post_run()
+{
+    _metrics_server.reset();
+    _warmup_source = sd_event_source_unref(_warmup_source);
+    _verify_source = sd_event_source_unref(_verify_source);
+    for (auto& ctx : _input_sources) {
+        sd_event_source_unref(ctx.source);
+    }
+    _input_sources.clear();
+    for (auto& ctx : _rule_timers) {
+        sd_event_source_unref(ctx.source);
+    }
+    _rule_timers.clear();
+    _rules = rule_table{};
+    _client_watches.clear();
+    _polkit_changed_slot = sd_bus_slot_unref(_polkit_changed_slot);
+    _authorization_checks.clear();
+    for (auto& call : _suspended_calls) {
+        sd_bus_message_unref(call.msg);
+    }
+    _suspended_calls.clear();
+    _subscriptions.clear();
+    _fast_channels.clear();
+    sd_bus_slot_unref(_vtable_slot);
+    _vtable_slot = nullptr;
+    _scenes.clear();
+    _lines.clear();
+}
+
+namespace {
+
+    //! Denials and temporary authorizations (auth_admin_keep) are checked again after this time
+    //! at the latest; polkit does not tell how long a temporary authorization remains valid.
+    constexpr std::uint64_t authorization_recheck_usec{10000000};
+
+    //! Time a client has to answer an authentication dialog of polkit.
+    constexpr std::uint64_t interactive_check_timeout_usec{120000000};
+
+    //! Resident set size of the process in bytes, 0 if unknown.
+    std::uint64_t resident_memory()
+    {
+        // a single read of procfs, cheaper than parsing /proc/self/status
+        auto fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 0;
+        }
+        char buf[128];
+        auto n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n <= 0) {
+            return 0;
+        }
+        buf[n] = '\0';
+        unsigned long long size{0};
+        unsigned long long resident{0};
+        if (sscanf(buf, "%llu %llu", &size, &resident) != 2) {
+            return 0;
+        }
+        return std::uint64_t{resident} * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    //! Structured journal fields of a line and a GPIO error.
+    core::log_fields line_fields(line_table const& lines, std::size_t line, int error = 0)
+    {
+        return {lines.name(line), lines[line].chip().name().c_str(), error};
+    }
+
+    void log_request_failure(line_table const& lines, std::size_t line, gpio::gpio_exception const& e)
+    {
+        core::log(LOG_ERR, line_fields(lines, line, e.error()), "GPIO line setup failed %s (%s-%u): %s",
+                  lines.name(line), lines[line].chip().name().c_str(), lines[line].offset(), e.message().c_str());
+    }
+
+} // namespace
+
+void application::setup_gpio()
+{
+    // eager lines of different chips are requested concurrently
+    std::vector<std::vector<std::size_t>> eager_lines(_lines.chip_count());
+    bool warmup{false};
+    for (std::size_t c = 0; c < _lines.chip_count(); ++c) {
+        if (_lines.first(c + 1) - _lines.first(c) > 64) {
+            core::log(LOG_WARNING, {nullptr, _lines.chip(c).name().c_str()},
+                      "Only the first 64 lines of chip %s are addressable by set_mask", _lines.chip(c).name().c_str());
+        }
+        for (auto i = _lines.first(c); i < _lines.first(c + 1); ++i) {
+            auto const mode = _lines.request_mode(i);
+            if (mode == gpio::request_mode::eager || _lines[i].direction() == gpio::direction::input) {
+                // input lines are always requested at startup, their edges drive the rules
+                eager_lines[c].push_back(i);
+            }
+            else if (mode == gpio::request_mode::lazy) {
+                warmup = true;
+            }
+        }
+    }
+
+    // chip open and line requests block on the chip, so each chip gets its own thread;
+    // errors are logged here, on the main thread
+    std::vector<std::optional<gpio::gpio_exception>> failures(_lines.size());
+    auto errors = core::for_each_parallel(eager_lines.size(), eager_lines.size(), [&](std::size_t c) {
+        std::vector<gpio::gpio_line*> lines;
+        lines.reserve(eager_lines[c].size());
+        for (auto i : eager_lines[c]) {
+            lines.push_back(&_lines[i]);
+        }
+        auto chip_failures = gpio::request_lines(lines);
+        for (std::size_t l = 0; l < chip_failures.size(); ++l) {
+            failures[eager_lines[c][l]] = std::move(chip_failures[l]);
+        }
+    });
+    for (std::size_t i = 0; i < failures.size(); ++i) {
+        if (failures[i]) {
+            ++_gpio_errors;
+            log_request_failure(_lines, i, *failures[i]);
+        }
+    }
+    for (auto const& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+    // input lines took their level from the hardware
+    _lines.sync_levels();
+
+    if (warmup) {
+        // housekeeping: the warm-up pass yields to every DBus request
+        auto r = scheduler().add_defer(core::priority_class::housekeeping, &_warmup_source,
+                                       &application::gdc_warmup_handler, this);
+        if (r >= 0) {
+            r = sd_event_source_set_description(_warmup_source, "gpio-warmup");
+        }
+        if (r < 0) {
+            core::log(LOG_WARNING, {nullptr, nullptr, -r},
+                      "GPIO warm-up pass not started, lazy lines are requested on first use (%s)", strerror(-r));
+            _warmup_source = sd_event_source_unref(_warmup_source);
+        }
+    }
+}
+
+int application::gdc_warmup_handler(sd_event_source */*s*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    return app->warmup_next_line();
+}
+
+int application::warmup_next_line()
+{
+    while (_warmup_next < _lines.size()
+           && (_lines.request_mode(_warmup_next) != gpio::request_mode::lazy
+               || _lines[_warmup_next].state() != gpio::line_state::pending)) {
+        ++_warmup_next;
+    }
+    if (_warmup_next == _lines.size()) {
+        sd_event_source_set_enabled(_warmup_source, SD_EVENT_OFF);
+        core::log(LOG_INFO, {}, "GPIO warm-up pass finished");
+        return 0;
+    }
+
+    auto& line = _lines[_warmup_next];
+    try {
+        line.request();
+    }
+    catch(gpio::gpio_exception& e) {
+        ++_gpio_errors;
+        log_request_failure(_lines, _warmup_next, e);
+        line_changed(_warmup_next);
+    }
+    flush_line_changes("line_states");
+    ++_warmup_next;
+    return 0;
+}
+
+void application::resolve_scenes(std::vector<scene_configuration> const& scenes)
+{
+    for (auto const& sc : scenes) {
+        if (std::any_of(_scenes.begin(), _scenes.end(), [&sc](scene const& s) {return s.name == sc.name;})) {
+            core::log(LOG_ERR, {}, "Scene %s configured more than once, using the first one", sc.name.c_str());
+            continue;
+        }
+        std::vector<std::pair<std::size_t, gpio::level>> levels;
+        levels.reserve(sc.levels.size());
+        scene s{sc.name, {}, {}, 0};
+        for (auto const& [name, lev] : sc.levels) {
+            auto i = _lines.find(name);
+            if (i == line_table::npos || _lines[i].direction() != gpio::direction::output) {
+                core::log(LOG_ERR, {name.c_str()}, "Scene %s refers to unknown or input line %s", sc.name.c_str(),
+                          name.c_str());
+                continue;
+            }
+            levels.emplace_back(i, lev);
+            s.actions |= _access.line(i);
+        }
+        // the lines of a chip are consecutive, so ordered by line a scene is written chip by chip;
+        // a line named twice takes the level given last
+        std::stable_sort(levels.begin(), levels.end(), [](auto const& a, auto const& b) {
+            return a.first < b.first;
+        });
+        for (auto const& [i, lev] : levels) {
+            auto const chip = static_cast<std::uint32_t>(_lines.chip_of(i));
+            auto const bit = i - _lines.first(chip);
+            if (bit >= 64) {
+                s.levels.emplace_back(i, lev);
+                continue;
+            }
+            if (s.masks.empty() || s.masks.back().chip != chip) {
+                s.masks.push_back({chip, 0, 0});
+            }
+            auto const flag = std::uint64_t{1} << bit;
+            s.masks.back().mask |= flag;
+            if (lev == gpio::level::active) {
+                s.masks.back().values |= flag;
+            }
+            else {
+                s.masks.back().values &= ~flag;
+            }
+        }
+        _scenes.push_back(std::move(s));
+    }
+}
+
+void application::resolve_access(std::vector<gpio_configuration> const& gpios)
+{
+    for (auto const& gc : gpios) {
+        auto i = _lines.find(gc.name);
+        if (gc.access.empty() || i == line_table::npos) {
+            continue;
+        }
+        auto const chip = _lines.chip_of(i);
+        _access.require(i, chip, i - _lines.first(chip), gc.access);
+    }
+}
+
+void application::resolve_rules(std::vector<rule_configuration> const& rule_configs)
+{
+    std::vector<rule_table::rule> rules;
+    rules.reserve(rule_configs.size());
+    for (auto const& rc : rule_configs) {
+        auto input = _lines.find(rc.input);
+        auto output = _lines.find(rc.output);
+        if (input == line_table::npos || _lines[input].direction() != gpio::direction::input
+            || output == line_table::npos || _lines[output].direction() != gpio::direction::output) {
+            core::log(LOG_ERR, {rc.output.c_str()}, "Rule %s -> %s ignored, requires a configured input and output line",
+                      rc.input.c_str(), rc.output.c_str());
+            continue;
+        }
+        rules.push_back({input, {output, rc.edge, rc.level, rc.duration_ms}});
+    }
+    _rules = rule_table{rules, _lines.size()};
+}
+
+void application::setup_rules()
+{
+    _rule_timers.assign(_rules.size(), event_context{this, 0, nullptr});
+    for (std::size_t i = 0; i < _rule_timers.size(); ++i) {
+        _rule_timers[i].index = i;
+    }
+
+    // edge events are dispatched before bus messages and housekeeping
+    std::size_t input_count{0};
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        if (_lines[i].direction() == gpio::direction::input && _lines[i].state() == gpio::line_state::ready) {
+            ++input_count;
+        }
+    }
+    _input_sources.reserve(input_count);
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        auto const& line = _lines[i];
+        if (line.direction() != gpio::direction::input || line.state() != gpio::line_state::ready) {
+            continue;
+        }
+        auto& ctx = _input_sources.emplace_back(event_context{this, i, nullptr});
+        auto r = scheduler().add_io(core::priority_class::realtime, &ctx.source, line.event_fd(), EPOLLIN,
+                                    &application::gdc_input_event_handler, &ctx);
+        if (r >= 0) {
+            r = sd_event_source_set_description(ctx.source, (std::string{"input:"} + _lines.name(i)).c_str());
+        }
+        if (r < 0) {
+            core::log(LOG_ERR, line_fields(_lines, i, -r), "Unable to watch input line %s (%s)", _lines.name(i),
+                      strerror(-r));
+            throw std::runtime_error{"Unable to watch input line"};
+        }
+    }
+}
+
+int application::gdc_input_event_handler(sd_event_source */*s*/, int /*fd*/, uint32_t /*revents*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto ctx = reinterpret_cast<event_context*>(userdata);
+    ctx->app->handle_input_event(*ctx);
+    return 0;
+}
+
+void application::handle_input_event(event_context& input)
+{
+    gpio::level lev;
+    try {
+        lev = _lines[input.index].read_event();
+    }
+    catch (gpio::gpio_exception& e) {
+        ++_gpio_errors;
+        core::log(LOG_ERR, line_fields(_lines, input.index, e.error()),
+                  "Reading edge event of %s failed, line not watched anymore. (%s, %s)",
+                  _lines.name(input.index), e.message().c_str(), strerror(e.error()));
+        sd_event_source_set_enabled(input.source, SD_EVENT_OFF);
+        return;
+    }
+
+    level_changed(input.index);
+    auto [first, last] = _rules.actions(input.index);
+    for (auto i = first; i < last; ++i) {
+        auto const& action = _rules[i];
+        if (!rule_table::triggers(action.edge, lev)) {
+            continue;
+        }
+        try {
+            if (_lines[action.output].set_level(action.level)) {
+                level_changed(action.output);
+            }
+        }
+        catch (gpio::gpio_exception& e) {
+            ++_gpio_errors;
+            core::log(LOG_ERR, line_fields(_lines, action.output, e.error()),
+                      "GPIOD exception while executing rule %s -> %s. (%s, %i, %s)",
+                      _lines.name(input.index), _lines.name(action.output),
+                      e.message().c_str(), e.error(), strerror(e.error()));
+            continue;
+        }
+        if (action.duration_ms > 0) {
+            arm_rule_timer(i);
+        }
+    }
+    flush_line_changes();
+}
+
+void application::arm_rule_timer(std::size_t action)
+{
+    auto& timer = _rule_timers[action];
+    std::uint64_t now{0};
+    auto r = sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    auto when = now + std::uint64_t{_rules[action].duration_ms} * 1000;
+    if (r >= 0 && timer.source == nullptr) {
+        // accuracy of 1us, the default accuracy of sd-event is 250ms
+        r = scheduler().add_time(core::priority_class::realtime, &timer.source, CLOCK_MONOTONIC, when, 1,
+                                 &application::gdc_rule_timer_handler, &timer);
+        if (r >= 0) {
+            r = sd_event_source_set_description(timer.source,
+                                                (std::string{"rule:"} + _lines.name(_rules[action].output)).c_str());
+        }
+    }
+    else if (r >= 0) {
+        // a new edge while the timer is pending restarts the duration
+        r = sd_event_source_set_time(timer.source, when);
+        if (r >= 0) {
+            r = sd_event_source_set_enabled(timer.source, SD_EVENT_ONESHOT);
+        }
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, line_fields(_lines, _rules[action].output, -r), "Unable to arm rule timer for %s (%s)",
+                  _lines.name(_rules[action].output), strerror(-r));
+    }
+}
+
+int application::gdc_rule_timer_handler(sd_event_source */*s*/, uint64_t /*usec*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto ctx = reinterpret_cast<event_context*>(userdata);
+    auto app = ctx->app;
+    auto const& action = app->_rules[ctx->index];
+    auto& line = app->_lines[action.output];
+    try {
+        auto lev = action.level == gpio::level::active ? gpio::level::inactive : gpio::level::active;
+        if (line.set_level(lev)) {
+            app->level_changed(action.output);
+            app->flush_line_changes();
+        }
+    }
+    catch (gpio::gpio_exception& e) {
+        ++app->_gpio_errors;
+        core::log(LOG_ERR, line_fields(app->_lines, action.output, e.error()),
+                  "GPIOD exception while ending rule action on %s. (%s, %i, %s)",
+                  app->_lines.name(action.output), e.message().c_str(), e.error(), strerror(e.error()));
+    }
+    return 0;
+}
+
+void application::setup_verify()
+{
+    if (_verify_config.interval_ms == 0) {
+        return;
+    }
+    std::uint64_t now{0};
+    auto interval = std::uint64_t{_verify_config.interval_ms} * 1000;
+    auto r = sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    if (r >= 0) {
+        // a generous accuracy lets sd-event coalesce the read-back with other wake-ups
+        r = scheduler().add_time(core::priority_class::housekeeping, &_verify_source, CLOCK_MONOTONIC,
+                                 now + interval, interval / 10, &application::gdc_verify_timer_handler, this);
+    }
+    if (r >= 0) {
+        r = sd_event_source_set_description(_verify_source, "gpio-verify");
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to set up GPIO read-back timer (%s)", strerror(-r));
+        throw std::runtime_error{"Unable to set up GPIO read-back timer"};
+    }
+}
+
+int application::gdc_verify_timer_handler(sd_event_source *s, uint64_t usec, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    app->verify_lines();
+    sd_event_source_set_time(s, usec + std::uint64_t{app->_verify_config.interval_ms} * 1000);
+    sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+    return 0;
+}
+
+unsigned application::verify_lines()
+{
+    _drifts.clear();
+    for (std::size_t c = 0; c < _lines.chip_count(); ++c) {
+        for (auto i = _lines.first(c); i < _lines.first(c + 1); ++i) {
+            auto& line = _lines[i];
+            if (line.state() != gpio::line_state::ready || line.direction() == gpio::direction::input) {
+                continue;
+            }
+            try {
+                auto actual = line.read_level();
+                if (actual != line.level()) {
+                    _drifts.push_back({i, actual});
+                }
+            }
+            catch (gpio::gpio_exception& e) {
+                ++_gpio_errors;
+                // the chip is most likely gone, skip its remaining lines in this pass
+                core::log(LOG_ERR, {nullptr, _lines.chip(c).name().c_str(), e.error()},
+                          "GPIO read-back failed on chip %s: %s (%s)",
+                          _lines.chip(c).name().c_str(), e.message().c_str(), strerror(e.error()));
+                break;
+            }
+        }
+    }
+    if (_drifts.empty()) {
+        return 0;
+    }
+
+    _drift_count += _drifts.size();
+    for (auto const& d : _drifts) {
+        auto& line = _lines[d.line];
+        core::log(LOG_WARNING, line_fields(_lines, d.line), "GPIO line %s drifted from %s to %s%s", _lines.name(d.line),
+                  line.level() == gpio::level::active ? "active" : "inactive",
+                  d.actual == gpio::level::active ? "active" : "inactive",
+                  _verify_config.reassert ? ", re-asserting" : "");
+        if (_verify_config.reassert) {
+            try {
+                line.reassert();
+            }
+            catch (gpio::gpio_exception& e) {
+                ++_gpio_errors;
+                core::log(LOG_ERR, line_fields(_lines, d.line, e.error()),
+                          "GPIOD exception while re-asserting line %s. (%s, %i, %s)",
+                          _lines.name(d.line), e.message().c_str(), e.error(), strerror(e.error()));
+            }
+        }
+    }
+    emit_line_drift(dbus_application::bus());
+    for (auto peer : dbus_application::peers()) {
+        emit_line_drift(peer);
+    }
+    emit_properties_changed("drift_count");
+    return static_cast<unsigned>(_drifts.size());
+}
+
+void application::emit_line_drift(sd_bus* bus)
+{
+    sd_bus_message* msg{nullptr};
+    core::final unref_msg{[&msg](){sd_bus_message_unref(msg);}};
+    auto r = sd_bus_message_new_signal(bus, &msg, _object_name.c_str(),
+                                       WIRECTRL_INTERFACE, "line_drift");
+    if (r >= 0) {
+        r = sd_bus_message_open_container(msg, 'a', "(sii)");
+    }
+    for (auto const& d : _drifts) {
+        if (r < 0) {
+            break;
+        }
+        r = sd_bus_message_append(msg, "(sii)", _lines.name(d.line),
+                                  _lines.level(d.line) == gpio::level::active ? 1 : 0,
+                                  d.actual == gpio::level::active ? 1 : 0);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(msg);
+    }
+    if (r >= 0) {
+        r = sd_bus_send(nullptr, msg, nullptr);
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to emit signal 'line_drift' (%s)", strerror(-r));
+    }
+}
+
+int application::gdc_verify_lines_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::verify_lines)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return sd_bus_reply_method_return(m, "u", app->verify_lines());
+}
+
+int application::gdc_get_property_drift_count(sd_bus */*bus*/, const char */*path*/,
+                                              const char */*interface*/,
+                                              const char */*property*/,
+                                              sd_bus_message *reply,
+                                              void *userdata,
+                                              sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    return sd_bus_message_append(reply, "t", app->_drift_count);
+}
+
+int application::gdc_get_property_loop_status(sd_bus */*bus*/, const char */*path*/,
+                                              const char */*interface*/,
+                                              const char */*property*/,
+                                              sd_bus_message *reply,
+                                              void *userdata,
+                                              sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    return sd_bus_message_append(reply, "s", app->monitor().status().c_str());
+}
+
+int application::gdc_get_property_loop_histogram(sd_bus */*bus*/, const char */*path*/,
+                                                 const char */*interface*/,
+                                                 const char *property,
+                                                 sd_bus_message *reply,
+                                                 void *userdata,
+                                                 sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    auto const& histogram = strcmp(property, "timer_lateness") == 0 ? app->monitor().lateness()
+                                                                     : app->monitor().iterations();
+    // (exclusive upper bound in us, count) of the non-empty buckets
+    auto r = sd_bus_message_open_container(reply, 'a', "(tt)");
+    for (std::size_t i = 0; r >= 0 && i < histogram.buckets().size(); ++i) {
+        if (histogram.buckets()[i] > 0) {
+            r = sd_bus_message_append(reply, "(tt)", core::latency_histogram::upper_bound(i), histogram.buckets()[i]);
+        }
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(reply);
+    }
+    return r;
+}
+
+void application::emit_properties_changed(char const* property, char const* other_property)
+{
+    sd_bus_emit_properties_changed(dbus_application::bus(),
+                                   _object_name.c_str(),
+                                   WIRECTRL_INTERFACE,
+                                   property,
+                                   other_property,
+                                   nullptr);
+    for (auto peer : dbus_application::peers()) {
+        sd_bus_emit_properties_changed(peer,
+                                       _object_name.c_str(),
+                                       WIRECTRL_INTERFACE,
+                                       property,
+                                       other_property,
+                                       nullptr);
+    }
+}
+
+void application::line_changed(std::size_t line)
+{
+    _lines.sync_level(line);
+    if (std::find(_changed_lines.begin(), _changed_lines.end(), line) == _changed_lines.end()) {
+        _changed_lines.push_back(line);
+    }
+}
+
+void application::setup_metrics()
+{
+    if (_metrics_config.socket.empty()) {
+        return;
+    }
+    static constexpr char const* method_names[] = {"set_line", "set_mask", "open_fast_channel", "apply_scene",
+                                                   "subscribe", "unsubscribe", "verify_lines", "configure_line"};
+    static_assert(std::size(method_names) == std::tuple_size_v<decltype(_requests)>);
+
+    // names and labels are formatted once, a scrape only formats the values that changed
+    auto& page = _metrics_page;
+    auto& samples = _metrics_samples;
+    auto family = page.add_family("wirectrl_requests", "counter", "DBus method calls.");
+    samples.requests = page.sample_count();
+    for (auto method : method_names) {
+        page.add_sample(family, std::string{"wirectrl_requests_total{method=\""} + method + "\"}");
+    }
+    family = page.add_family("wirectrl_request_duration_seconds", "histogram", "Duration of DBus method calls.");
+    samples.durations = page.sample_count();
+    for (auto method : method_names) {
+        page.add_histogram(family, "wirectrl_request_duration_seconds", std::string{"method=\""} + method + "\"");
+    }
+    family = page.add_family("wirectrl_line_toggles", "counter", "Level changes of a line.");
+    samples.toggles = page.sample_count();
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        page.add_sample(family, "wirectrl_line_toggles_total{line=\"" + metrics_page::escape(_lines.name(i)) + "\"}");
+    }
+    family = page.add_family("wirectrl_gpio_errors", "counter", "Failed GPIO requests, reads and writes.");
+    samples.gpio_errors = page.add_sample(family, "wirectrl_gpio_errors_total");
+    family = page.add_family("wirectrl_rejected_calls", "counter", "DBus method calls above the client rate limit.");
+    samples.rejected_calls = page.add_sample(family, "wirectrl_rejected_calls_total");
+    family = page.add_family("wirectrl_loop_iteration_seconds", "histogram", "Busy time of event loop iterations.");
+    samples.iterations = page.add_histogram(family, "wirectrl_loop_iteration_seconds", {});
+    family = page.add_family("wirectrl_timer_lateness_seconds", "histogram", "Dispatch of timers behind their deadline.");
+    samples.lateness = page.add_histogram(family, "wirectrl_timer_lateness_seconds", {});
+    family = page.add_family("wirectrl_loop_stalls", "counter", "Event loop iterations above the lag threshold.");
+    samples.stalls = page.add_sample(family, "wirectrl_loop_stalls_total");
+    family = page.add_family("process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+    samples.rss = page.add_sample(family, "process_resident_memory_bytes");
+
+    try {
+        _metrics_server = std::make_unique<metrics_server>(scheduler(), _metrics_config.socket,
+                                                           [this]() -> std::string const& { return render_metrics(); });
+    }
+    catch (core::runtime_exception& e) {
+        core::log(LOG_ERR, {}, "Metrics not served: %s", e.what());
+    }
+}
+
+std::string const& application::render_metrics()
+{
+    auto& page = _metrics_page;
+    auto const& samples = _metrics_samples;
+    for (std::size_t i = 0; i < _requests.size(); ++i) {
+        page.set(samples.requests + i, _requests[i].count);
+        page.set_histogram(samples.durations + i * metrics_page::histogram_samples, _requests[i].duration);
+    }
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        page.set(samples.toggles + i, _line_toggles[i]);
+    }
+    page.set(samples.gpio_errors, _gpio_errors);
+    page.set(samples.rejected_calls, _limiter.rejected());
+    page.set_histogram(samples.iterations, monitor().iterations());
+    page.set_histogram(samples.lateness, monitor().lateness());
+    page.set(samples.stalls, monitor().stalls());
+    page.set(samples.rss, resident_memory());
+    return page.render();
+}
+
+void application::level_changed(std::size_t line)
+{
+    ++_line_toggles[line];
+    line_changed(line);
+}
+
+void application::flush_line_changes(char const* other_property)
+{
+    if (_changed_lines.empty()) {
+        if (other_property != nullptr) {
+            emit_properties_changed(other_property);
+        }
+        return;
+    }
+    if (_broadcast_lines) {
+        emit_properties_changed("lines", other_property);
+    }
+    else if (other_property != nullptr) {
+        emit_properties_changed(other_property);
+    }
+    _subscriptions.for_each_changed(_changed_lines, [this](std::string const& owner, std::vector<std::size_t> const& lines) {
+        send_lines_changed(owner, lines);
+    });
+    _changed_lines.clear();
+}
+
+void application::send_lines_changed(std::string const& destination, std::vector<std::size_t> const& lines)
+{
+    sd_bus_message* msg{nullptr};
+    core::final unref_msg{[&msg](){sd_bus_message_unref(msg);}};
+    auto r = sd_bus_message_new_signal(dbus_application::bus(), &msg, _object_name.c_str(),
+                                       WIRECTRL_INTERFACE, "lines_changed");
+    if (r >= 0) {
+        // unicast, only the subscriber is woken up
+        r = sd_bus_message_set_destination(msg, destination.c_str());
+    }
+    if (r >= 0) {
+        r = sd_bus_message_open_container(msg, 'a', "(si)");
+    }
+    for (auto it = lines.begin(); r >= 0 && it != lines.end(); ++it) {
+        r = sd_bus_message_append(msg, "(si)", _lines.name(*it), _lines.level(*it) == gpio::level::active ? 1 : 0);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(msg);
+    }
+    if (r >= 0) {
+        r = sd_bus_send(nullptr, msg, nullptr);
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to send signal 'lines_changed' to %s (%s)",
+                  destination.c_str(), strerror(-r));
+    }
+}
+
+int application::gdc_subscribe_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::subscribe)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_subscribe_handler(m, ret_error);
+}
+
+int application::dbus_subscribe_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    auto sender = sd_bus_message_get_sender(msg);
+    if (sender == nullptr) {
+        sd_bus_error_set_const(ret_error, "NotSupported", "Subscriptions require a bus name");
+        return -ENOTSUP;
+    }
+
+    if (_subscriptions.count(sender) >= subscription_table::max_per_owner
+        || _subscriptions.size() >= subscription_table::max_total) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_LIMITS_EXCEEDED, "Too many subscriptions");
+        return -EBUSY;
+    }
+
+    // an empty array subscribes to all lines
+    std::vector<bool> lines(_lines.size(), false);
+    auto r = sd_bus_message_enter_container(msg, 'a', "s");
+    bool any{false};
+    while (r >= 0) {
+        char const* name{nullptr};
+        r = sd_bus_message_read(msg, "s", &name);
+        if (r <= 0) {
+            break;
+        }
+        auto index = _lines.find(name);
+        if (index == line_table::npos) {
+            sd_bus_error_set_const(ret_error, "LineNameNotFound", "Line name is not configured");
+            return -EINVAL;
+        }
+        lines[index] = true;
+        any = true;
+    }
+    if (r >= 0) {
+        r = sd_bus_message_exit_container(msg);
+    }
+    if (r < 0) {
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Client request 'subscribe' with invalid arguments (%i, %s)",
+                  -r, strerror(-r));
+        return r;
+    }
+    if (!any) {
+        lines.assign(_lines.size(), true);
+    }
+
+    r = watch_client(sender);
+    if (r < 0) {
+        return r;
+    }
+    auto id = _subscriptions.add(sender, std::move(lines));
+    return sd_bus_reply_method_return(msg, "u", id);
+}
+
+int application::watch_client(char const* name)
+{
+    if (_client_watches.count(name) != 0) {
+        return 0;
+    }
+    auto bus = dbus_application::bus();
+    std::unique_ptr<client_watch> watch{new client_watch{this, name, nullptr, nullptr}};
+    auto const rule = "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus',"
+                      "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='" + watch->name + "'";
+    auto r = sd_bus_add_match_async(bus, &watch->match, rule.c_str(), &application::gdc_name_owner_changed_handler,
+                                    &application::gdc_client_watch_installed_handler, watch.get());
+    if (r >= 0) {
+        // the bus handles both calls in order, a client that left before the match was installed
+        // has no owner anymore
+        r = sd_bus_call_method_async(bus, &watch->owner_check, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                     "org.freedesktop.DBus", "NameHasOwner",
+                                     &application::gdc_client_owner_handler, watch.get(), "s", name);
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to watch client %s (%s)", name, strerror(-r));
+        return r;
+    }
+    _client_watches.emplace(watch->name, std::move(watch));
+    return 0;
+}
+
+void application::forget_client(std::string const& name)
+{
+    _subscriptions.forget(name);
+    _fast_channels.erase(std::remove_if(_fast_channels.begin(), _fast_channels.end(), [&name](auto const& ctx) {
+        return ctx->channel.owner() == name;
+    }), _fast_channels.end());
+    _limiter.forget(name);
+    _client_uids.erase(name);
+    auto& lookups = _client_uid_lookups;
+    lookups.erase(std::remove_if(lookups.begin(), lookups.end(), [&name](auto const& l) {
+        return l->client == name;
+    }), lookups.end());
+    forget_authorizations(name);
+    _client_watches.erase(name);
+}
+
+int application::gdc_client_watch_installed_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto watch = reinterpret_cast<client_watch*>(userdata);
+    if (sd_bus_message_is_method_error(m, nullptr)) {
+        // the next call of the client installs the watch again
+        core::log(LOG_WARNING, {nullptr, nullptr, sd_bus_message_get_errno(m)}, "Unable to watch client %s",
+                  watch->name.c_str());
+        watch->app->_client_watches.erase(std::string{watch->name});
+    }
+    return 0;
+}
+
+int application::gdc_client_owner_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto watch = reinterpret_cast<client_watch*>(userdata);
+    watch->owner_check = sd_bus_slot_unref(watch->owner_check);
+    int has_owner{1};
+    if (!sd_bus_message_is_method_error(m, nullptr) && sd_bus_message_read(m, "b", &has_owner) >= 0
+        && has_owner == 0) {
+        watch->app->forget_client(std::string{watch->name});
+    }
+    return 0;
+}
+
+application::client_watch::~client_watch()
+{
+    sd_bus_slot_unref(owner_check);
+    sd_bus_slot_unref(match);
+}
+
+int application::gdc_unsubscribe_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::unsubscribe)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_unsubscribe_handler(m, ret_error);
+}
+
+int application::dbus_unsubscribe_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    std::uint32_t id{0};
+    auto r = sd_bus_message_read(msg, "u", &id);
+    if (r < 0) {
+        return r;
+    }
+    auto sender = sd_bus_message_get_sender(msg);
+    if (sender == nullptr || !_subscriptions.remove(id, sender)) {
+        sd_bus_error_set_const(ret_error, "SubscriptionNotFound", "No such subscription of the caller");
+        return -EINVAL;
+    }
+    return sd_bus_reply_method_return(msg, "");
+}
+
+int application::gdc_name_owner_changed_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto watch = reinterpret_cast<client_watch*>(userdata);
+    char const* name{nullptr};
+    char const* old_owner{nullptr};
+    char const* new_owner{nullptr};
+    if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) < 0
+        || new_owner == nullptr || new_owner[0] != '\0') {
+        return 0;
+    }
+    watch->app->forget_client(name);
+    return 0;
+}
+
+int application::admit_client(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    if (!_limiter.enabled()) {
+        return 0;
+    }
+    // the bucket of a bus name is dropped when the client leaves
+    if (auto sender = sd_bus_message_get_sender(msg); sender != nullptr && watch_client(sender) < 0) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Unable to watch the client");
+        return -EIO;
+    }
+    std::uint64_t now{0};
+    sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    if (_limiter.admit(client_id(msg), now)) {
+        return 0;
+    }
+    sd_bus_error_set_const(ret_error, SD_BUS_ERROR_LIMITS_EXCEEDED, "Call rate of the client exceeded");
+    return -EBUSY;
+}
+
+std::string application::client_id(sd_bus_message* msg)
+{
+    auto sender = sd_bus_message_get_sender(msg);
+    if (sender != nullptr && _client_key == client_identity::sender) {
+        return sender;
+    }
+    if (sender != nullptr) {
+        auto it = _client_uids.find(sender);
+        if (it != _client_uids.end()) {
+            return "uid:" + std::to_string(it->second);
+        }
+        // the bus driver is not asked synchronously, the first calls count for the bus name
+        lookup_client_uid(sender);
+        return sender;
+    }
+    // peer connections carry the credentials of the peer, no round trip is needed
+    sd_bus_creds* creds{nullptr};
+    uid_t uid{0};
+    auto r = sd_bus_query_sender_creds(msg, SD_BUS_CREDS_EUID, &creds);
+    if (r >= 0) {
+        r = sd_bus_creds_get_euid(creds, &uid);
+    }
+    sd_bus_creds_unref(creds);
+    if (r < 0) {
+        return "unknown";
+    }
+    return "uid:" + std::to_string(uid);
+}
+
+void application::lookup_client_uid(char const* client)
+{
+    auto& lookups = _client_uid_lookups;
+    if (lookups.size() >= max_client_uid_lookups
+        || std::any_of(lookups.begin(), lookups.end(), [client](auto const& l){return l->client == client;})) {
+        return;
+    }
+    std::unique_ptr<client_uid_lookup> lookup{new client_uid_lookup{this, client, nullptr}};
+    auto r = sd_bus_call_method_async(dbus_application::bus(), &lookup->slot, "org.freedesktop.DBus",
+                                      "/org/freedesktop/DBus", "org.freedesktop.DBus", "GetConnectionUnixUser",
+                                      &application::gdc_client_uid_reply_handler, lookup.get(), "s", client);
+    if (r < 0) {
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Unable to look up the user of %s (%s)", client, strerror(-r));
+        return;
+    }
+    lookups.push_back(std::move(lookup));
+}
+
+int application::gdc_client_uid_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto lookup = reinterpret_cast<client_uid_lookup*>(userdata);
+    auto app = lookup->app;
+    std::uint32_t uid{0};
+    // on an error the next call of the client asks again
+    if (!sd_bus_message_is_method_error(m, nullptr) && sd_bus_message_read(m, "u", &uid) >= 0) {
+        app->_client_uids.emplace(lookup->client, static_cast<uid_t>(uid));
+    }
+    auto& lookups = app->_client_uid_lookups;
+    lookups.erase(std::find_if(lookups.begin(), lookups.end(), [lookup](auto const& l){return l.get() == lookup;}));
+    return 0;
+}
+
+int application::authorize(sd_bus_message* msg, dbus_method method, action_set actions, sd_bus_error* ret_error)
+{
+    if (actions == 0) {
+        return 0;
+    }
+    auto sender = sd_bus_message_get_sender(msg);
+    if (sender == nullptr) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_ACCESS_DENIED, "Restricted lines require a bus name");
+        return -EACCES;
+    }
+    // cached decisions are dropped when the client leaves
+    if (watch_client(sender) < 0) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Unable to watch the client");
+        return -EIO;
+    }
+    std::uint64_t now{0};
+    sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    std::string client{sender};
+    auto res = _authorizations.check(client, actions, now);
+    if (res.granted()) {
+        return 0;
+    }
+    if (res.denied != 0) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_ACCESS_DENIED, "Client is not authorized for the lines");
+        return -EACCES;
+    }
+    if (_suspended_calls.size() >= max_suspended_calls) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_LIMITS_EXCEEDED, "Too many calls waiting for authorization");
+        return -EBUSY;
+    }
+    auto const interactive = sd_bus_message_get_allow_interactive_authorization(msg) > 0;
+    for (auto rest = res.unknown; rest != 0; rest &= rest - 1) {
+        auto r = check_authorization(client, static_cast<std::size_t>(__builtin_ctzll(rest)), interactive);
+        if (r < 0) {
+            sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Unable to check authorization");
+            return r;
+        }
+    }
+    _suspended_calls.push_back({sd_bus_message_ref(msg), method, std::move(client)});
+    return 1;
+}
+
+int application::check_authorization(std::string const& client, std::size_t action, bool interactive)
+{
+    auto bus = dbus_application::bus();
+    sd_bus_message* msg{nullptr};
+    core::final unref_msg{[&msg](){sd_bus_message_unref(msg);}};
+    auto r = sd_bus_message_new_method_call(bus, &msg, "org.freedesktop.PolicyKit1", "/org/freedesktop/PolicyKit1/Authority",
+                                            "org.freedesktop.PolicyKit1.Authority", "CheckAuthorization");
+    if (r >= 0) {
+        // the subject is the bus name, polkit looks up its process and session
+        r = sd_bus_message_append(msg, "(sa{sv})s", "system-bus-name", 1u, "name", "s", client.c_str(),
+                                  _access.name(action).c_str());
+    }
+    if (r >= 0) {
+        r = sd_bus_message_append(msg, "a{ss}us", 0u, interactive ? 1u : 0u, "");
+    }
+    std::unique_ptr<authorization_check> check{new authorization_check{this, client, action, nullptr}};
+    if (r >= 0) {
+        r = sd_bus_call_async(bus, &check->slot, msg, &application::gdc_authorization_reply_handler, check.get(),
+                              interactive ? interactive_check_timeout_usec : 0);
+    }
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to check authorization of %s for %s (%s)",
+                  client.c_str(), _access.name(action).c_str(), strerror(-r));
+        // like an error reply, a denial until the recheck keeps callers from sending a check each
+        std::uint64_t now{0};
+        sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+        _authorizations.store(client, action, false, now + authorization_recheck_usec);
+        return r;
+    }
+    _authorizations.begin(client, action_set{1} << action);
+    _authorization_checks.push_back(std::move(check));
+    return 0;
+}
+
+int application::gdc_authorization_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto check = reinterpret_cast<authorization_check*>(userdata);
+    auto app = check->app;
+    auto const& action = app->_access.name(check->action);
+
+    // reply (bba{ss}): is_authorized, is_challenge, details
+    int authorized{0};
+    int challenge{0};
+    bool temporary{false};
+    if (sd_bus_message_is_method_error(m, nullptr)) {
+        // an error reply need not carry a message
+        auto error = sd_bus_message_get_error(m);
+        char const* reason{"unknown error"};
+        if (error != nullptr && error->message != nullptr) {
+            reason = error->message;
+        }
+        else if (error != nullptr && error->name != nullptr) {
+            reason = error->name;
+        }
+        core::log(LOG_WARNING, {nullptr, nullptr, sd_bus_message_get_errno(m)}, "Polkit check of %s for %s failed (%s)",
+                  check->client.c_str(), action.c_str(), reason);
+    }
+    else {
+        auto r = sd_bus_message_enter_container(m, 'r', "bba{ss}");
+        if (r >= 0) {
+            r = sd_bus_message_read(m, "bb", &authorized, &challenge);
+        }
+        if (r >= 0) {
+            r = sd_bus_message_enter_container(m, 'a', "{ss}");
+        }
+        while (r > 0) {
+            char const* key{nullptr};
+            char const* value{nullptr};
+            r = sd_bus_message_read(m, "{ss}", &key, &value);
+            if (r > 0 && std::strcmp(key, "polkit.temporary_authorization_id") == 0) {
+                temporary = true;
+            }
+        }
+        if (r < 0) {
+            core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Invalid polkit reply for %s (%s)", check->client.c_str(), strerror(-r));
+            authorized = 0;
+        }
+    }
+    if (authorized == 0) {
+        core::log(LOG_NOTICE, {}, "Client %s is not authorized for %s", check->client.c_str(), action.c_str());
+    }
 
-// ----------------------------------------------------------------------------
-// application
-// ----------------------------------------------------------------------------
-application::application(configuration const& config)
-    : core::dbus_application{config.dbus.use_session_bus ? core::DBusType::Session : core::DBusType::System,
-                             config.dbus.connection_name}
-    , _config{config}
-{}
+    std::uint64_t now{0};
+    sd_event_now(app->get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    auto const ttl = authorized != 0 && !temporary ? app->_authorization_ttl
+                                                   : std::min(app->_authorization_ttl, authorization_recheck_usec);
+    app->_authorizations.store(check->client, check->action, authorized != 0, now + ttl);
 
-application::~application() = default;
+    auto client = check->client;
+    auto& checks = app->_authorization_checks;
+    checks.erase(std::find_if(checks.begin(), checks.end(), [check](auto const& c){return c.get() == check;}));
+    app->resume_calls(client);
+    return 0;
+}
 
-void application::pre_run()
+int application::gdc_polkit_changed_handler(sd_bus_message */*m*/, void *userdata, sd_bus_error */*ret_error*/)
 {
-    setup_gpio();
-    setup_dbus_interface();
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    app->_authorizations.invalidate();
+    return 0;
 }
 
-void application::post_run()
+void application::resume_calls(std::string const& client)
 {
-    sd_bus_slot_unref(_vtable_slot);
-    _vtable_slot = nullptr;
-    _gpios.clear();
+    // calls suspended again while they are dispatched are appended to _suspended_calls
+    std::vector<suspended_call> calls;
+    auto split = std::stable_partition(_suspended_calls.begin(), _suspended_calls.end(),
+                                       [&client](suspended_call const& call) { return call.client != client; });
+    std::move(split, _suspended_calls.end(), std::back_inserter(calls));
+    _suspended_calls.erase(split, _suspended_calls.end());
+
+    for (auto& call : calls) {
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        auto r = sd_bus_message_rewind(call.msg, true);
+        if (r >= 0) {
+            switch (call.method) {
+                case dbus_method::set_line:
+                    r = dbus_set_line_handler(call.msg, &error);
+                    break;
+                case dbus_method::set_mask:
+                    r = dbus_set_mask_handler(call.msg, &error);
+                    break;
+                case dbus_method::apply_scene:
+                    r = dbus_apply_scene_handler(call.msg, &error);
+                    break;
+                case dbus_method::configure_line:
+                    r = dbus_configure_line_handler(call.msg, &error);
+                    break;
+                default:
+                    r = -EINVAL;
+                    break;
+            }
+        }
+        if (r < 0) {
+            r = sd_bus_error_is_set(&error) ? sd_bus_reply_method_error(call.msg, &error)
+                                            : sd_bus_reply_method_errno(call.msg, r, nullptr);
+            if (r < 0) {
+                core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to reply to a call of %s (%s)", client.c_str(),
+                          strerror(-r));
+            }
+        }
+        sd_bus_error_free(&error);
+        sd_bus_message_unref(call.msg);
+    }
 }
 
-void application::setup_gpio()
+void application::forget_authorizations(std::string const& client)
 {
-    for (auto const& g : _config.gpios) {
-        try {
-            _gpios.emplace_back(g.name, g.gpio_chip_name, g.gpio_line_id,
-                                g.consumer, g.initial_level, g.active_level);
+    _authorizations.forget(client);
+    auto& checks = _authorization_checks;
+    checks.erase(std::remove_if(checks.begin(), checks.end(), [&client](auto const& c) {
+        return c->client == client;
+    }), checks.end());
+    auto& calls = _suspended_calls;
+    calls.erase(std::remove_if(calls.begin(), calls.end(), [&client](suspended_call const& call) {
+        if (call.client != client) {
+            return false;
         }
-        catch(gpio::gpio_exception& e) {
-            sd_journal_print(LOG_ERR, "GPIO line setup failed %s (%s-%i): %s", g.name.c_str(),
-                             g.gpio_chip_name.c_str(), g.gpio_line_id, e.message().c_str());
+        sd_bus_message_unref(call.msg);
+        return true;
+    }), calls.end());
+}
+
+application::authorization_check::~authorization_check()
+{
+    sd_bus_slot_unref(slot);
+}
+
+application::client_uid_lookup::~client_uid_lookup()
+{
+    sd_bus_slot_unref(slot);
+}
+
+int application::gdc_get_property_rejected_calls(sd_bus */*bus*/, const char */*path*/,
+                                                 const char */*interface*/,
+                                                 const char */*property*/,
+                                                 sd_bus_message *reply,
+                                                 void *userdata,
+                                                 sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    return sd_bus_message_append(reply, "t", app->_limiter.rejected());
+}
 
+int application::gdc_get_property_client_rejections(sd_bus */*bus*/, const char */*path*/,
+                                                    const char */*interface*/,
+                                                    const char */*property*/,
+                                                    sd_bus_message *reply,
+                                                    void *userdata,
+                                                    sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    auto r = sd_bus_message_open_container(reply, 'a', "(st)");
+    app->_limiter.for_each_rejected([&r, reply](std::string const& key, std::uint64_t count) {
+        if (r >= 0) {
+            r = sd_bus_message_append(reply, "(st)", key.c_str(), count);
         }
+    });
+    if (r >= 0) {
+        r = sd_bus_message_close_container(reply);
     }
+    return r;
 }
 
 int application::gdc_get_property_lines(sd_bus */*bus*/, const char */*path*/,
@@ -72,40 +1308,116 @@ int application::gdc_get_property_lines(sd_bus */*bus*/, const char */*path*/,
     return app->dbus_property_get_lines(reply, ret_error);
 }
 
-void application::setup_dbus_interface()
+int application::gdc_get_property_line_states(sd_bus */*bus*/, const char */*path*/,
+                                             const char */*interface*/,
+                                             const char */*property*/,
+                                             sd_bus_message *reply,
+                                             void *userdata,
+                                             sd_bus_error *ret_error)
 {
-#define WIRECTRL_INTERFACE          ("de.titnc.pi.wirectrl")
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    return app->dbus_property_get_line_states(reply, ret_error);
+}
+
+template<bool broadcast_lines>
+sd_bus_vtable const* application::interface_vtable()
+{
+    constexpr std::uint64_t lines_flags{broadcast_lines ? std::uint64_t{SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE} : 0};
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
     static const sd_bus_vtable _vtable[] = {
             SD_BUS_VTABLE_START(0),
-            SD_BUS_PROPERTY("lines", "a(si)", &application::gdc_get_property_lines,  0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+            SD_BUS_PROPERTY("lines", "a(si)", &application::gdc_get_property_lines,  0, lines_flags),
+            SD_BUS_PROPERTY("line_states", "a(ss)", &application::gdc_get_property_line_states,  0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+            SD_BUS_PROPERTY("drift_count", "t", &application::gdc_get_property_drift_count,  0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+            SD_BUS_PROPERTY("loop_status", "s", &application::gdc_get_property_loop_status,  0, 0),
+            SD_BUS_PROPERTY("loop_iterations", "a(tt)", &application::gdc_get_property_loop_histogram,  0, 0),
+            SD_BUS_PROPERTY("timer_lateness", "a(tt)", &application::gdc_get_property_loop_histogram,  0, 0),
+            SD_BUS_PROPERTY("rejected_calls", "t", &application::gdc_get_property_rejected_calls,  0, 0),
+            SD_BUS_PROPERTY("client_rejections", "a(st)", &application::gdc_get_property_client_rejections,  0, 0),
+            SD_BUS_PROPERTY("scenes", "as", &application::gdc_get_property_scenes,  0, SD_BUS_VTABLE_PROPERTY_CONST),
+            SD_BUS_PROPERTY("chips", "as", &application::gdc_get_property_chips,  0, SD_BUS_VTABLE_PROPERTY_CONST),
+            SD_BUS_PROPERTY("line_map", "a(suu)", &application::gdc_get_property_line_map,  0, SD_BUS_VTABLE_PROPERTY_CONST),
             SD_BUS_METHOD("set_line", "si", "i", &application::gdc_set_line_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("set_mask", "utt", "t", &application::gdc_set_mask_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("open_fast_channel", "", "hh", &application::gdc_open_fast_channel_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("apply_scene", "s", "u", &application::gdc_apply_scene_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("subscribe", "as", "u", &application::gdc_subscribe_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("unsubscribe", "u", "", &application::gdc_unsubscribe_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_SIGNAL("lines_changed", "a(si)", 0),
+            SD_BUS_METHOD("verify_lines", "", "u", &application::gdc_verify_lines_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_METHOD("configure_line", "sss", "", &application::gdc_configure_line_handler, SD_BUS_VTABLE_UNPRIVILEGED),
+            SD_BUS_SIGNAL("line_drift", "a(sii)", 0),
             SD_BUS_VTABLE_END
     };
 #pragma GCC diagnostic pop
+    return _vtable;
+}
+
+void application::setup_dbus_interface()
+{
 
-    auto r = sd_bus_add_object_vtable(dbus_application::bus(),  &_vtable_slot,
-                                 _config.dbus.object_name.c_str(),
-                                 WIRECTRL_INTERFACE,
-                                 _vtable,
-                                 this);
+    // registered on the bus and on the peer connections of the peer socket
+    auto r = dbus_application::add_object_vtable(&_vtable_slot,
+                                                 _object_name.c_str(),
+                                                 WIRECTRL_INTERFACE,
+                                                 _broadcast_lines ? interface_vtable<true>() : interface_vtable<false>(),
+                                                 this);
     if (r < 0) {
-        sd_journal_print(LOG_ERR, "Unable to register DBus interface for wirectrl (%s)", strerror(-r));
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to register DBus interface for wirectrl (%s)", strerror(-r));
         throw std::runtime_error{"Unable to register DBus interface"};
     }
+    // cached polkit decisions end with the client, see watch_client, and with changes reported by polkit
+    if (!_access.empty()) {
+        r = sd_bus_match_signal(dbus_application::bus(), &_polkit_changed_slot, "org.freedesktop.PolicyKit1",
+                                "/org/freedesktop/PolicyKit1/Authority", "org.freedesktop.PolicyKit1.Authority",
+                                "Changed", &application::gdc_polkit_changed_handler, this);
+        if (r < 0) {
+            core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to watch polkit changes (%s)", strerror(-r));
+            throw std::runtime_error{"Unable to watch polkit changes"};
+        }
+    }
 }
 
 namespace {
 
-    int encode_gpio_lines(sd_bus_message *msg, std::vector<gpio::gpio_line> const& gpios)
+    int encode_gpio_lines(sd_bus_message *msg, line_table const& lines)
     {
         int r = sd_bus_message_open_container(msg, 'a', "(si)");
         if (r < 0) {
             return r;
         }
-        for (auto const& gpio : gpios) {
-            r = sd_bus_message_append(msg, "(si)", gpio.name().c_str(), gpio.level() == gpio::level::active ? 1 : 0);
+        // chip by chip, the levels are read from the bitset of the chip
+        for (std::size_t c = 0; c < lines.chip_count(); ++c) {
+            auto const first = lines.first(c);
+            auto const* levels = lines.levels(c);
+            for (auto i = first; i < lines.first(c + 1); ++i) {
+                if (lines[i].state() == gpio::line_state::failed) {
+                    continue;
+                }
+                auto const bit = i - first;
+                r = sd_bus_message_append(msg, "(si)", lines.name(i), static_cast<int>((levels[bit / 64] >> (bit % 64)) & 1));
+                if (r < 0) {
+                    return r;
+                }
+            }
+        }
+        r = sd_bus_message_close_container(msg);
+        if (r < 0) {
+            return r;
+        }
+        return 1;
+    }
+
+    int encode_gpio_line_states(sd_bus_message *msg, line_table const& lines)
+    {
+        int r = sd_bus_message_open_container(msg, 'a', "(ss)");
+        if (r < 0) {
+            return r;
+        }
+        for (std::size_t i = 0; i < lines.size(); ++i) {
+            r = sd_bus_message_append(msg, "(ss)", lines.name(i), gpio::to_string(lines[i].state()));
             if (r < 0) {
                 return r;
             }
@@ -121,18 +1433,388 @@ namespace {
 
 int application::dbus_property_get_lines(sd_bus_message *reply, sd_bus_error */*ret_error*/)
 {
-    auto r = encode_gpio_lines(reply, _gpios);
+    auto r = encode_gpio_lines(reply, _lines);
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to fill property 'line' message (%s)", strerror(-r));
+    }
+    return r;
+}
+
+int application::dbus_property_get_line_states(sd_bus_message *reply, sd_bus_error */*ret_error*/)
+{
+    auto r = encode_gpio_line_states(reply, _lines);
+    if (r < 0) {
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to fill property 'line_states' message (%s)", strerror(-r));
+    }
+    return r;
+}
+
+int application::gdc_get_property_scenes(sd_bus */*bus*/, const char */*path*/,
+                                         const char */*interface*/,
+                                         const char */*property*/,
+                                         sd_bus_message *reply,
+                                         void *userdata,
+                                         sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    int r = sd_bus_message_open_container(reply, 'a', "s");
+    for (auto it = app->_scenes.begin(); r >= 0 && it != app->_scenes.end(); ++it) {
+        r = sd_bus_message_append(reply, "s", it->name.c_str());
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(reply);
+    }
+    return r;
+}
+
+int application::gdc_get_property_chips(sd_bus */*bus*/, const char */*path*/,
+                                        const char */*interface*/,
+                                        const char */*property*/,
+                                        sd_bus_message *reply,
+                                        void *userdata,
+                                        sd_bus_error */*ret_error*/)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    int r = sd_bus_message_open_container(reply, 'a', "s");
+    for (std::size_t c = 0; r >= 0 && c < app->_lines.chip_count(); ++c) {
+        r = sd_bus_message_append(reply, "s", app->_lines.chip(c).name().c_str());
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(reply);
+    }
+    return r;
+}
+
+int application::gdc_get_property_line_map(sd_bus */*bus*/, const char */*path*/,
+                                           const char */*interface*/,
+                                           const char */*property*/,
+                                           sd_bus_message *reply,
+                                           void *userdata,
+                                           sd_bus_error */*ret_error*/)
+{
+    // line name, index into 'chips' and bit of the line in the set_mask masks
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    int r = sd_bus_message_open_container(reply, 'a', "(suu)");
+    auto const& lines = app->_lines;
+    for (std::size_t c = 0; r >= 0 && c < lines.chip_count(); ++c) {
+        auto const first = lines.first(c);
+        for (std::size_t bit = 0; r >= 0 && first + bit < lines.first(c + 1) && bit < 64; ++bit) {
+            r = sd_bus_message_append(reply, "(suu)", lines.name(first + bit),
+                                      static_cast<std::uint32_t>(c), static_cast<std::uint32_t>(bit));
+        }
+    }
+    if (r >= 0) {
+        r = sd_bus_message_close_container(reply);
+    }
+    return r;
+}
+
+int application::gdc_set_mask_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::set_mask)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_set_mask_handler(m, ret_error);
+}
+
+mask_result application::set_mask(std::uint32_t chip, std::uint64_t mask, std::uint64_t values)
+{
+    mask_result result;
+    if (chip >= _lines.chip_count()) {
+        result.error = "Chip index out of range";
+        return result;
+    }
+    auto const first = _lines.first(chip);
+    auto const line_count = std::min<std::size_t>(_lines.first(chip + 1) - first, 64);
+    if (line_count < 64 && (mask >> line_count) != 0) {
+        result.error = "Mask addresses lines that are not configured";
+        return result;
+    }
+    if ((mask & ~_lines.output_mask(chip)) != 0) {
+        result.error = "Mask addresses input lines";
+        return result;
+    }
+
+    // lines of a raw chip are written with one ioctl, the others line by line
+    auto lines = _lines.chip_lines(chip);
+    auto remaining = mask;
+    result.changed = gpio::set_raw_levels(lines, remaining, values);
+    for (auto rest = result.changed; rest != 0; rest &= rest - 1) {
+        level_changed(first + static_cast<std::size_t>(__builtin_ctzll(rest)));
+    }
+    for (auto rest = remaining; rest != 0; rest &= rest - 1) {
+        auto const bit = static_cast<std::size_t>(__builtin_ctzll(rest));
+        auto const flag = std::uint64_t{1} << bit;
+        auto& line = lines[bit];
+        if (line.state() == gpio::line_state::failed) {
+            result.failed = true;
+            continue;
+        }
+        result.requested = result.requested || line.state() == gpio::line_state::pending;
+        try {
+            if (line.set_level((values & flag) != 0 ? gpio::level::active : gpio::level::inactive)) {
+                level_changed(first + bit);
+                result.changed |= flag;
+            }
+        }
+        catch(gpio::gpio_exception& e) {
+            ++_gpio_errors;
+            core::log(LOG_ERR, line_fields(_lines, first + bit, e.error()),
+                      "GPIOD exception while setting line %s by mask. (%s, %i, %s)",
+                      _lines.name(first + bit), e.message().c_str(), e.error(), strerror(e.error()));
+            result.failed = true;
+        }
+    }
+    return result;
+}
+
+int application::dbus_set_mask_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    std::uint32_t chip{0};
+    std::uint64_t mask{0};
+    std::uint64_t values{0};
+    auto r = sd_bus_message_read(msg, "utt", &chip, &mask, &values);
+    if (r < 0) {
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Client request 'set_mask' with invalid arguments (%i, %s)",
+                  -r, strerror(-r));
+        return r;
+    }
+    if (!_access.empty()) {
+        r = authorize(msg, dbus_method::set_mask, _access.mask(chip, mask), ret_error);
+        if (r != 0) {
+            return r;
+        }
+    }
+    auto result = set_mask(chip, mask, values);
+    if (result.error != nullptr) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_INVALID_ARGS, result.error);
+        return -EINVAL;
+    }
+    flush_line_changes(result.requested ? "line_states" : nullptr);
+    if (result.failed) {
+        sd_bus_error_set_const(ret_error, "GpiodError", "LibGpiod reported error on some lines of the mask");
+        return -EIO;
+    }
+    return sd_bus_reply_method_return(msg, "t", result.changed);
+}
+
+int application::gdc_open_fast_channel_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::open_fast_channel)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_open_fast_channel_handler(m, ret_error);
+}
+
+int application::dbus_open_fast_channel_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    auto sender = sd_bus_message_get_sender(msg);
+    if (sender == nullptr) {
+        sd_bus_error_set_const(ret_error, "NotSupported", "Fast channels require a bus name");
+        return -ENOTSUP;
+    }
+    if (_fast_channels.size() >= max_fast_channels) {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_LIMITS_EXCEEDED, "Too many fast channels");
+        return -EBUSY;
+    }
+    auto r = watch_client(sender);
+    if (r < 0) {
+        return r;
+    }
+
+    std::unique_ptr<fast_channel_context> ctx;
+    try {
+        ctx.reset(new fast_channel_context{this, fast_channel{sender}, nullptr});
+    }
+    catch (core::runtime_exception& e) {
+        core::log(LOG_ERR, {}, "Unable to open fast channel for %s: %s", sender, e.what());
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_FAILED, "Unable to open fast channel");
+        return -EIO;
+    }
+    // line writes from the channel are I/O like the edge events
+    r = scheduler().add_io(core::priority_class::realtime, &ctx->source, ctx->channel.eventfd(), EPOLLIN,
+                           &application::gdc_fast_channel_handler, ctx.get());
+    if (r >= 0) {
+        r = sd_event_source_set_description(ctx->source, "fast-channel");
+    }
     if (r < 0) {
-        sd_journal_print(LOG_ERR, "Unable to fill property 'line' message (%s, %i)",
-                         strerror(-r), -r);
+        core::log(LOG_ERR, {nullptr, nullptr, -r}, "Unable to watch fast channel of %s (%s)", sender, strerror(-r));
+        return r;
+    }
+    r = sd_bus_reply_method_return(msg, "hh", ctx->channel.memfd(), ctx->channel.eventfd());
+    if (r >= 0) {
+        core::log(LOG_INFO, {}, "Fast channel opened for %s", sender);
+        _fast_channels.push_back(std::move(ctx));
     }
     return r;
 }
 
+int application::gdc_fast_channel_handler(sd_event_source */*s*/, int /*fd*/, uint32_t /*revents*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto ctx = reinterpret_cast<fast_channel_context*>(userdata);
+    ctx->app->consume_fast_channel(*ctx);
+    return 0;
+}
+
+void application::consume_fast_channel(fast_channel_context& ctx)
+{
+    ctx.channel.acknowledge();
+    bool requested{false};
+    unsigned rejected{0};
+    unsigned unauthorized{0};
+    std::uint64_t now{0};
+    sd_event_now(get_sd_event().get(), CLOCK_MONOTONIC, &now);
+    auto valid = ctx.channel.consume([this, &ctx, now, &requested, &rejected, &unauthorized](fast_channel::command const& c) {
+        if (c.reserved != 0) {
+            ++rejected;
+            return;
+        }
+        // commands cannot wait for polkit, they are rejected until the decision is cached
+        if (auto actions = _access.empty() ? action_set{0} : _access.mask(c.chip, c.mask); actions != 0) {
+            auto res = _authorizations.check(ctx.channel.owner(), actions, now);
+            for (auto rest = res.unknown; rest != 0; rest &= rest - 1) {
+                check_authorization(ctx.channel.owner(), static_cast<std::size_t>(__builtin_ctzll(rest)), false);
+            }
+            if (!res.granted()) {
+                ++unauthorized;
+                return;
+            }
+        }
+        auto result = set_mask(c.chip, c.mask, c.values);
+        if (result.error != nullptr) {
+            ++rejected;
+        }
+        requested = requested || result.requested;
+    });
+    flush_line_changes(requested ? "line_states" : nullptr);
+    if (rejected > 0) {
+        core::log(LOG_WARNING, {}, "%u invalid commands on fast channel of %s",
+                  rejected, ctx.channel.owner().c_str());
+    }
+    if (unauthorized > 0) {
+        core::log(LOG_NOTICE, {}, "%u unauthorized commands on fast channel of %s",
+                  unauthorized, ctx.channel.owner().c_str());
+    }
+    if (!valid) {
+        core::log(LOG_WARNING, {}, "Fast channel of %s corrupted, closing it", ctx.channel.owner().c_str());
+        _fast_channels.erase(std::find_if(_fast_channels.begin(), _fast_channels.end(),
+                                          [&ctx](auto const& c){return c.get() == &ctx;}));
+    }
+}
+
+application::fast_channel_context::~fast_channel_context()
+{
+    sd_event_source_unref(source);
+}
+
+int application::gdc_apply_scene_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::apply_scene)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_apply_scene_handler(m, ret_error);
+}
+
+int application::dbus_apply_scene_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    char const* scene_name{nullptr};
+    auto r = sd_bus_message_read(msg, "s", &scene_name);
+    if (r < 0) {
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Client request 'apply_scene' with invalid arguments (%i, %s)",
+                  -r, strerror(-r));
+        return r;
+    }
+    auto scene = std::find_if(_scenes.begin(), _scenes.end(),
+                              [scene_name](struct scene const& s){return s.name == scene_name;});
+    if (scene == _scenes.end()) {
+        sd_bus_error_set_const(ret_error, "SceneNotFound", "Scene name is not configured");
+        return -EINVAL;
+    }
+    if (!_access.empty()) {
+        r = authorize(msg, dbus_method::apply_scene, scene->actions, ret_error);
+        if (r != 0) {
+            return r;
+        }
+    }
+
+    // only lines that differ from the scene are written, the lines of a chip at once
+    unsigned changed{0};
+    unsigned failed{0};
+    bool requested{false};
+    for (auto const& m : scene->masks) {
+        auto const first = _lines.first(m.chip);
+        auto write = m.mask;
+        for (auto same = m.mask & ~(_lines.levels(m.chip)[0] ^ m.values); same != 0; same &= same - 1) {
+            auto const bit = static_cast<std::size_t>(__builtin_ctzll(same));
+            if (_lines[first + bit].state() == gpio::line_state::ready) {
+                write &= ~(std::uint64_t{1} << bit);
+            }
+        }
+        if (write == 0) {
+            continue;
+        }
+        auto result = set_mask(m.chip, write, m.values);
+        changed += static_cast<unsigned>(__builtin_popcountll(result.changed));
+        requested = requested || result.requested;
+        if (result.failed || result.error != nullptr) {
+            ++failed;
+        }
+    }
+    for (auto const& [i, lev] : scene->levels) {
+        auto& line = _lines[i];
+        if (line.state() == gpio::line_state::failed) {
+            ++failed;
+            continue;
+        }
+        if (line.state() == gpio::line_state::ready && _lines.level(i) == lev) {
+            continue;
+        }
+        requested = requested || line.state() == gpio::line_state::pending;
+        try {
+            if (line.set_level(lev)) {
+                level_changed(i);
+                ++changed;
+            }
+        }
+        catch(gpio::gpio_exception& e) {
+            ++_gpio_errors;
+            core::log(LOG_ERR, line_fields(_lines, i, e.error()),
+                      "GPIOD exception while applying scene %s to line %s. (%s, %i, %s)",
+                      scene_name, _lines.name(i), e.message().c_str(), e.error(), strerror(e.error()));
+            ++failed;
+        }
+    }
+
+    // one notification for the whole scene
+    flush_line_changes(requested ? "line_states" : nullptr);
+    if (failed > 0) {
+        sd_bus_error_set_const(ret_error, "GpiodError", "LibGpiod reported error on some lines of the scene");
+        return -EIO;
+    }
+    return sd_bus_reply_method_return(msg, "u", changed);
+}
+
 int application::gdc_set_line_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     assert(userdata != nullptr);
     auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::set_line)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
     return app->dbus_set_line_handler(m, ret_error);
 }
 
@@ -146,8 +1828,8 @@ int application::dbus_set_line_handler(sd_bus_message* msg, sd_bus_error* ret_er
     int r;
     r = sd_bus_message_read(msg, "si", &line_name, &line_level);
     if (r < 0) {
-        sd_journal_print(LOG_WARNING, "Client request 'set_line' with invalid arguments (%i, %s)",
-                         -r, strerror(-r));
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Client request 'set_line' with invalid arguments (%i, %s)",
+                  -r, strerror(-r));
         return r;
     }
 
@@ -159,15 +1841,16 @@ int application::dbus_set_line_handler(sd_bus_message* msg, sd_bus_error* ret_er
         sd_bus_error_set_const(ret_error, "de.titnc.pi.wirectrl:set_line", "Invalid value for line name");
         return -EINVAL;
     }
+    if (!_access.empty()) {
+        r = authorize(msg, dbus_method::set_line, _access.line(_lines.find(line_name)), ret_error);
+        if (r != 0) {
+            return r;
+        }
+    }
 
     auto result = set_line(line_name, line_level == 0 ? gpio::level::inactive : gpio::level::active);
     switch (result) {
         case gpio_set_result::success:
-            sd_bus_emit_properties_changed(dbus_application::bus(),
-                                           _config.dbus.object_name.c_str(),
-                                           WIRECTRL_INTERFACE,
-                                           "lines",
-                                           nullptr);
             return sd_bus_reply_method_return(msg, "i", 0);
         case gpio_set_result::no_change:
             return sd_bus_reply_method_return(msg, "i", 1);
@@ -184,23 +1867,110 @@ int application::dbus_set_line_handler(sd_bus_message* msg, sd_bus_error* ret_er
 
 gpio_set_result application::set_line(std::string const& name, gpio::level lev)
 {
-    auto it = std::find_if(_gpios.begin(), _gpios.end(),
-                           [&name](gpio::gpio_line const& l){return l.name() == name;});
-    if (it == _gpios.end()) {
+    auto index = _lines.find(name);
+    if (index == line_table::npos || _lines[index].state() == gpio::line_state::failed) {
         return gpio_set_result::name_not_found;
     }
+    auto& line = _lines[index];
 
+    // the first use of a lazy or on-demand line requests it
+    bool const pending = line.state() == gpio::line_state::pending;
+    core::final notify{[this, pending](){
+        flush_line_changes(pending ? "line_states" : nullptr);
+    }};
     try {
-        if (!it->set_level(lev)) {
+        if (!line.set_level(lev)) {
             return gpio_set_result::no_change;
         }
+        level_changed(index);
         return gpio_set_result::success;
     }
     catch(gpio::gpio_exception& e) {
-        sd_journal_print(LOG_ERR, "GPIOD exception while setting line level. (%s, %i, %s)",
-                         e.message().c_str(), e.error(), strerror(e.error()));
+        ++_gpio_errors;
+        core::log(LOG_ERR, line_fields(_lines, index, e.error()),
+                  "GPIOD exception while setting line %s. (%s, %i, %s)",
+                  _lines.name(index), e.message().c_str(), e.error(), strerror(e.error()));
+        if (pending) {
+            line_changed(index);
+        }
         return gpio_set_result::gpiod_error;
     }
 }
 
+int application::gdc_configure_line_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    assert(userdata != nullptr);
+    auto app = reinterpret_cast<application*>(userdata);
+    request_scope scope{app->_requests[static_cast<std::size_t>(dbus_method::configure_line)]};
+    if (auto r = app->admit_client(m, ret_error); r < 0) {
+        return r;
+    }
+    return app->dbus_configure_line_handler(m, ret_error);
+}
+
+int application::dbus_configure_line_handler(sd_bus_message* msg, sd_bus_error* ret_error)
+{
+    char const* line_name{nullptr};
+    char const* active{nullptr};
+    char const* pull{nullptr};
+    auto r = sd_bus_message_read(msg, "sss", &line_name, &active, &pull);
+    if (r < 0) {
+        core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Client request 'configure_line' with invalid arguments (%i, %s)",
+                  -r, strerror(-r));
+        return r;
+    }
+    gpio::active_level al;
+    if (std::strcmp(active, "high") == 0) {
+        al = gpio::active_level::active_high;
+    }
+    else if (std::strcmp(active, "low") == 0) {
+        al = gpio::active_level::active_low;
+    }
+    else {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Invalid active level, must be high|low");
+        return -EINVAL;
+    }
+    gpio::pull_resistor pr;
+    if (std::strcmp(pull, "none") == 0) {
+        pr = gpio::pull_resistor::none;
+    }
+    else if (std::strcmp(pull, "up") == 0) {
+        pr = gpio::pull_resistor::up;
+    }
+    else if (std::strcmp(pull, "down") == 0) {
+        pr = gpio::pull_resistor::down;
+    }
+    else {
+        sd_bus_error_set_const(ret_error, SD_BUS_ERROR_INVALID_ARGS, "Invalid pull resistor, must be none|up|down");
+        return -EINVAL;
+    }
+    auto index = _lines.find(line_name);
+    if (index == line_table::npos || _lines[index].state() == gpio::line_state::failed) {
+        sd_bus_error_set_const(ret_error, "LineNameNotFound", "Line name is not configured or failed at setup");
+        return -EINVAL;
+    }
+    if (!_access.empty()) {
+        r = authorize(msg, dbus_method::configure_line, _access.line(index), ret_error);
+        if (r != 0) {
+            return r;
+        }
+    }
 
+    try {
+        _lines[index].reconfigure(al, pr);
+    }
+    catch (gpio::gpio_exception& e) {
+        ++_gpio_errors;
+        core::log(LOG_ERR, line_fields(_lines, index, e.error()),
+                  "GPIOD exception while reconfiguring line %s. (%s, %i, %s)",
+                  _lines.name(index), e.message().c_str(), e.error(), strerror(e.error()));
+        line_changed(index);
+        flush_line_changes("line_states");
+        sd_bus_error_set_const(ret_error, "GpiodError", "LibGpiod reported error");
+        return -EIO;
+    }
+    // the level of an input follows its active level
+    line_changed(index);
+    flush_line_changes();
+    return sd_bus_reply_method_return(msg, "");
+}
@@ -15,11 +15,22 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
+#include "authorization.h"
+#include "client_limiter.h"
 #include "config.h"
+#include "fast_channel.h"
+#include "line_table.h"
+#include "metrics.h"
+#include "rules.h"
+#include "subscriptions.h"
 #include "types.h"
 
 #include <core/dbus-application.h>
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 enum class gpio_set_result
@@ -30,6 +41,28 @@ enum class gpio_set_result
     gpiod_error,
 };
 
+//! Methods of the wirectrl interface, indexes the request metrics.
+enum class dbus_method : std::size_t
+{
+    set_line,
+    set_mask,
+    open_fast_channel,
+    apply_scene,
+    subscribe,
+    unsubscribe,
+    verify_lines,
+    configure_line,
+};
+
+//! Outcome of setting lines by chip mask.
+struct mask_result
+{
+    char const* error{nullptr};     //!< reason the mask was rejected, nothing was written then
+    std::uint64_t changed{0};       //!< lines whose level changed
+    bool requested{false};          //!< pending lines were requested
+    bool failed{false};             //!< lines could not be written
+};
+
 class application : public core::dbus_application
 {
 public:
@@ -46,18 +79,269 @@ protected:
 private:
     void setup_gpio();
     void setup_dbus_interface();
+    //! vtable of the wirectrl interface, 'lines' emits PropertiesChanged if broadcast_lines is set.
+    template<bool broadcast_lines>
+    static sd_bus_vtable const* interface_vtable();
+    //! Resolves the line names of the scenes and rules, the configuration is not kept.
+    void resolve_scenes(std::vector<scene_configuration> const& scenes);
+    void resolve_rules(std::vector<rule_configuration> const& rules);
+    //! Collects the polkit actions of the lines configured with 'access'.
+    void resolve_access(std::vector<gpio_configuration> const& gpios);
+    void setup_rules();
+
+    //! sd-event source of an input line or a rule timer and the index it belongs to.
+    struct event_context {
+        application* app;
+        std::size_t index;
+        sd_event_source* source;
+    };
+
+    static int gdc_input_event_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata);
+    //! Evaluates the rules of the input line directly in the edge event handler.
+    void handle_input_event(event_context& input);
+
+    static int gdc_rule_timer_handler(sd_event_source *s, uint64_t usec, void *userdata);
+    void arm_rule_timer(std::size_t action);
+
+    //! Emits one PropertiesChanged signal for the property and optionally a second one.
+    void emit_properties_changed(char const* property, char const* other_property = nullptr);
+
+    //! Records that the level of the line changed or that it left the 'lines' property and copies
+    //! the level of the line into the level bitset of the line table.
+    void line_changed(std::size_t line);
+    //! Counts the toggle of the line for the metrics and records it like line_changed.
+    void level_changed(std::size_t line);
+
+    //! Emits PropertiesChanged for 'lines' (if lines changed and broadcasts are enabled) and
+    //! other_property, and sends the signal 'lines_changed' to each subscriber of a changed line.
+    void flush_line_changes(char const* other_property = nullptr);
+    void send_lines_changed(std::string const& destination, std::vector<std::size_t> const& lines);
+
+    static int gdc_subscribe_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_subscribe_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+    static int gdc_unsubscribe_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_unsubscribe_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+    //! Watches the unique bus name of a client that has state in the application with a
+    //! NameOwnerChanged match on the name, so the daemon is not woken by other names.
+    int watch_client(char const* name);
+    //! Drops the subscriptions, fast channels, buckets and authorizations of a client that left
+    //! the bus, and its watch.
+    void forget_client(std::string const& name);
+    static int gdc_name_owner_changed_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    static int gdc_client_watch_installed_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    static int gdc_client_owner_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+
+    //! Requests the next pending line with request mode lazy, one line per event loop iteration.
+    static int gdc_warmup_handler(sd_event_source *s, void *userdata);
+    int warmup_next_line();
+
+    void setup_verify();
+
+    //! Reads back the level of every ready line, chip by chip, and reports lines whose hardware
+    //! level differs from the commanded level.
+    //! @return Returns the number of drifted lines.
+    unsigned verify_lines();
+    void emit_line_drift(sd_bus* bus);
+
+    static int gdc_verify_timer_handler(sd_event_source *s, uint64_t usec, void *userdata);
+
+    static int gdc_verify_lines_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+
+    static int gdc_get_property_drift_count(sd_bus*, const char*, const char*, const char*,
+                                            sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+
+    //! Loop health from the monitor of core::application: STATUS summary and histograms.
+    static int gdc_get_property_loop_status(sd_bus*, const char*, const char*, const char*,
+                                            sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+    static int gdc_get_property_loop_histogram(sd_bus*, const char*, const char*, const char* property,
+                                               sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
 
     static int gdc_get_property_lines(sd_bus*, const char*, const char*, const char*,
                                       sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
     int dbus_property_get_lines(sd_bus_message *reply, sd_bus_error *ret_error);
 
+    static int gdc_get_property_line_states(sd_bus*, const char*, const char*, const char*,
+                                            sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+    int dbus_property_get_line_states(sd_bus_message *reply, sd_bus_error *ret_error);
+
+    static int gdc_get_property_scenes(sd_bus*, const char*, const char*, const char*,
+                                       sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+
+    static int gdc_apply_scene_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_apply_scene_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+
+    static int gdc_get_property_chips(sd_bus*, const char*, const char*, const char*,
+                                      sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+    static int gdc_get_property_line_map(sd_bus*, const char*, const char*, const char*,
+                                         sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+
+    //! Numeric fast path: sets the lines of a chip addressed by bits of a mask.
+    static int gdc_set_mask_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_set_mask_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+    //! Sets the lines of the chip addressed by bits of mask; changes are recorded with line_changed.
+    mask_result set_mask(std::uint32_t chip, std::uint64_t mask, std::uint64_t values);
+
+    //! Shared memory ring of a client and its event source.
+    struct fast_channel_context {
+        application* app;
+        fast_channel channel;
+        sd_event_source* source;
+        ~fast_channel_context();
+    };
+    static int gdc_open_fast_channel_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_open_fast_channel_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+    static int gdc_fast_channel_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata);
+    void consume_fast_channel(fast_channel_context& ctx);
+
+    //! Checks that the caller of the method is authorized for the actions, a hash lookup when the
+    //! decisions are cached. Otherwise polkit is asked asynchronously and the call is suspended;
+    //! it is dispatched again when the answers arrived.
+    //! @return Returns 0 if the call is authorized, 1 if it was suspended, else a negative errno
+    //!         with ret_error set.
+    int authorize(sd_bus_message* msg, dbus_method method, action_set actions, sd_bus_error* ret_error);
+    //! Asks polkit whether the client is authorized for the action; a failed send is cached as a denial
+    //! until the recheck.
+    int check_authorization(std::string const& client, std::size_t action, bool interactive);
+    static int gdc_authorization_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    //! Drops the decisions when polkit reports changed authorizations.
+    static int gdc_polkit_changed_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    //! Dispatches the suspended calls of the client again.
+    void resume_calls(std::string const& client);
+    //! Drops the decisions, checks and suspended calls of a client that left the bus.
+    void forget_authorizations(std::string const& client);
+
     static int gdc_set_line_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
     int dbus_set_line_handler(sd_bus_message* msg, sd_bus_error* ret_error);
     gpio_set_result set_line(std::string const& name, gpio::level lev);
 
+    //! Changes active level and pull resistor of a line without releasing it where the backend allows.
+    static int gdc_configure_line_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    int dbus_configure_line_handler(sd_bus_message* msg, sd_bus_error* ret_error);
+
 private:
-    configuration _config;
-    std::vector<gpio::gpio_line> _gpios{};
+    std::string _object_name;
+    client_identity _client_key;
+    verify_configuration _verify_config;
+    metrics_configuration _metrics_config;
+    line_table _lines;
+
+    //! A line whose hardware level differs from the commanded level.
+    struct line_drift {
+        std::size_t line;
+        gpio::level actual;
+    };
+    std::vector<line_drift> _drifts{};
+
+    //! Levels of a scene for the first 64 lines of a chip, as arguments of set_mask.
+    struct scene_mask {
+        std::uint32_t chip;
+        std::uint64_t mask;
+        std::uint64_t values;
+    };
+    //! Scene with line names resolved to indices into _lines, ordered by chip.
+    struct scene {
+        std::string name;
+        std::vector<scene_mask> masks;
+        //! lines beyond the first 64 of their chip, written line by line
+        std::vector<std::pair<std::size_t, gpio::level>> levels;
+        action_set actions{0};      //!< polkit actions of the lines
+    };
+    std::vector<scene> _scenes{};
+
+    subscription_table _subscriptions{};
+    std::vector<std::size_t> _changed_lines{};
+    bool _broadcast_lines;      //!< PropertiesChanged is emitted for 'lines'
+    //! NameOwnerChanged match of a client and the check that the client is still on the bus.
+    struct client_watch {
+        application* app;
+        std::string name;
+        sd_bus_slot* match;
+        sd_bus_slot* owner_check;
+        ~client_watch();
+    };
+    std::unordered_map<std::string, std::unique_ptr<client_watch>> _client_watches{};
+
+    //! Takes a token of the caller's bucket before a method does any work.
+    //! @return Returns 0 if the call is admitted, else a negative errno with ret_error set to
+    //!         LimitsExceeded.
+    int admit_client(sd_bus_message* msg, sd_bus_error* ret_error);
+    //! Key of the caller's bucket, its unique bus name or "uid:<euid>".
+    //! The euid of a bus name is looked up asynchronously, until it is known the bus name is the key.
+    std::string client_id(sd_bus_message* msg);
+    //! Asks the bus driver for the euid of the bus name unless a lookup is in flight.
+    void lookup_client_uid(char const* client);
+    static int gdc_client_uid_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+    static int gdc_get_property_rejected_calls(sd_bus*, const char*, const char*, const char*,
+                                               sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+    static int gdc_get_property_client_rejections(sd_bus*, const char*, const char*, const char*,
+                                                  sd_bus_message *reply, void *userdata, sd_bus_error *ret_error);
+    //! Serves the metrics page if [metrics] names a socket.
+    void setup_metrics();
+    //! Copies the counters into the metrics page and renders it.
+    std::string const& render_metrics();
+
+    std::array<request_metrics, 8> _requests{};     //!< indexed by dbus_method
+    std::vector<std::uint64_t> _line_toggles{};     //!< indexed like _lines
+    std::uint64_t _gpio_errors{0};
+    metrics_page _metrics_page{};
+    //! first sample index of the metrics families in _metrics_page
+    struct {
+        std::size_t requests;
+        std::size_t durations;
+        std::size_t toggles;
+        std::size_t gpio_errors;
+        std::size_t rejected_calls;
+        std::size_t iterations;
+        std::size_t lateness;
+        std::size_t stalls;
+        std::size_t rss;
+    } _metrics_samples{};
+    std::unique_ptr<metrics_server> _metrics_server{};
+
+    access_policy _access{};
+    authorization_cache _authorizations{};
+    std::uint64_t _authorization_ttl;   //!< usec
+    //! CheckAuthorization call in flight.
+    struct authorization_check {
+        application* app;
+        std::string client;
+        std::size_t action;
+        sd_bus_slot* slot;
+        ~authorization_check();
+    };
+    std::vector<std::unique_ptr<authorization_check>> _authorization_checks{};
+    //! Method call waiting for polkit, it is answered when it is dispatched again.
+    struct suspended_call {
+        sd_bus_message* msg;
+        dbus_method method;
+        std::string client;
+    };
+    static constexpr std::size_t max_suspended_calls{64};
+    std::vector<suspended_call> _suspended_calls{};
+    sd_bus_slot* _polkit_changed_slot{nullptr};
+
+    client_limiter _limiter;
+    std::unordered_map<std::string, uid_t> _client_uids{};  //!< euid by unique bus name for client-key uid
+    //! GetConnectionUnixUser call in flight.
+    struct client_uid_lookup {
+        application* app;
+        std::string client;
+        sd_bus_slot* slot;
+        ~client_uid_lookup();
+    };
+    static constexpr std::size_t max_client_uid_lookups{64};
+    std::vector<std::unique_ptr<client_uid_lookup>> _client_uid_lookups{};
+
+    static constexpr std::size_t max_fast_channels{16};
+    std::vector<std::unique_ptr<fast_channel_context>> _fast_channels{};
+
+    rule_table _rules{};
+    std::vector<event_context> _input_sources{};
+    std::vector<event_context> _rule_timers{};  //!< one per rule action, the source is created on first use
+    std::uint64_t _drift_count{0};  //!< number of drifted lines detected since start
 
     sd_bus_slot* _vtable_slot{nullptr};
+    sd_event_source* _verify_source{nullptr};
+    sd_event_source* _warmup_source{nullptr};
+    std::size_t _warmup_next{0};    //!< index of the next line to look at in the warm-up pass
 };
\ No newline at end of file
@@ -0,0 +1,141 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "authorization.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void access_policy::require(std::size_t line, std::size_t chip, std::size_t bit, std::string const& action)
+{
+    auto it = std::find(_actions.begin(), _actions.end(), action);
+    if (it == _actions.end()) {
+        if (_actions.size() == max_actions) {
+            throw std::runtime_error{"Too many distinct access actions, at most 64 are supported."};
+        }
+        it = _actions.insert(_actions.end(), action);
+    }
+    auto const index = static_cast<std::size_t>(it - _actions.begin());
+
+    if (_lines.size() <= line) {
+        _lines.resize(line + 1, 0);
+    }
+    _lines[line] |= action_set{1} << index;
+
+    if (bit >= 64) {
+        return;
+    }
+    if (_chips.size() <= chip) {
+        _chips.resize(chip + 1);
+    }
+    auto& masks = _chips[chip];
+    auto m = std::find_if(masks.begin(), masks.end(), [index](chip_mask const& cm) { return cm.action == index; });
+    if (m == masks.end()) {
+        m = masks.insert(masks.end(), chip_mask{index, 0});
+    }
+    m->lines |= std::uint64_t{1} << bit;
+}
+
+bool access_policy::empty() const noexcept
+{
+    return _actions.empty();
+}
+
+std::string const& access_policy::name(std::size_t i) const
+{
+    return _actions.at(i);
+}
+
+action_set access_policy::line(std::size_t line) const noexcept
+{
+    return line < _lines.size() ? _lines[line] : 0;
+}
+
+action_set access_policy::mask(std::size_t chip, std::uint64_t mask) const noexcept
+{
+    action_set actions{0};
+    if (chip < _chips.size()) {
+        for (auto const& cm : _chips[chip]) {
+            if ((cm.lines & mask) != 0) {
+                actions |= action_set{1} << cm.action;
+            }
+        }
+    }
+    return actions;
+}
+
+authorization_cache::result authorization_cache::check(std::string const& client, action_set actions,
+                                                       std::uint64_t now_usec) const
+{
+    result res{};
+    auto it = _clients.find(client);
+    if (it == _clients.end()) {
+        res.unknown = actions;
+        return res;
+    }
+    auto const& c = it->second;
+    res.pending = actions & c.pending;
+    for (auto rest = actions & ~c.pending; rest != 0; rest &= rest - 1) {
+        auto const bit = rest & (~rest + 1);
+        auto const action = static_cast<std::size_t>(__builtin_ctzll(bit));
+        if ((c.granted & bit) != 0 && now_usec < c.expires[action]) {
+            continue;
+        }
+        if ((c.denied & bit) != 0 && now_usec < c.expires[action]) {
+            res.denied |= bit;
+        }
+        else {
+            res.unknown |= bit;
+        }
+    }
+    return res;
+}
+
+void authorization_cache::begin(std::string const& client, action_set actions)
+{
+    _clients[client].pending |= actions;
+}
+
+void authorization_cache::store(std::string const& client, std::size_t action, bool granted,
+                                std::uint64_t expires_usec)
+{
+    auto& c = _clients[client];
+    auto const bit = action_set{1} << action;
+    c.pending &= ~bit;
+    c.granted = granted ? c.granted | bit : c.granted & ~bit;
+    c.denied = granted ? c.denied & ~bit : c.denied | bit;
+    if (c.expires.size() <= action) {
+        c.expires.resize(action + 1, 0);
+    }
+    c.expires[action] = expires_usec;
+}
+
+void authorization_cache::forget(std::string const& client)
+{
+    _clients.erase(client);
+}
+
+void authorization_cache::invalidate() noexcept
+{
+    for (auto& c : _clients) {
+        c.second.granted = 0;
+        c.second.denied = 0;
+    }
+}
+
+std::size_t authorization_cache::clients() const noexcept
+{
+    return _clients.size();
+}
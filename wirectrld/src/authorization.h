@@ -0,0 +1,107 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! Set of polkit actions, bit n stands for action n of an access_policy.
+using action_set = std::uint64_t;
+
+//! Polkit actions that guard the lines, configured per line with 'access'.
+//! Lines without an action can be set by every client.
+class access_policy
+{
+public:
+    static constexpr std::size_t max_actions{64};
+
+    //! Restricts the line to clients authorized for the action.
+    //! @param chip     index of the chip of the line
+    //! @param bit      bit of the line in the masks of its chip, lines from 64 on have none
+    //! @throws std::runtime_error  Thrown when more than max_actions distinct actions are used.
+    void require(std::size_t line, std::size_t chip, std::size_t bit, std::string const& action);
+
+    bool empty() const noexcept;
+
+    //! Name of the action with index i.
+    std::string const& name(std::size_t i) const;
+
+    //! Actions required to set the line.
+    action_set line(std::size_t line) const noexcept;
+
+    //! Actions required to set the lines of the chip addressed by mask.
+    action_set mask(std::size_t chip, std::uint64_t mask) const noexcept;
+
+private:
+    struct chip_mask {
+        std::size_t action;
+        std::uint64_t lines;
+    };
+
+    std::vector<std::string> _actions{};
+    std::vector<action_set> _lines{};               //!< indexed like the line table
+    std::vector<std::vector<chip_mask>> _chips{};   //!< lines per action and chip
+};
+
+//! Polkit decisions per client and action.
+//! A decision is valid until it expires, the client leaves the bus or polkit reports a change.
+//! While a check is in flight the action is pending, so concurrent calls of the client wait for
+//! the same check.
+class authorization_cache
+{
+public:
+    //! Actions of a check that are not granted.
+    struct result {
+        action_set unknown{0};  //!< never checked or expired
+        action_set pending{0};  //!< check in flight
+        action_set denied{0};
+
+        bool granted() const noexcept
+        {
+            return (unknown | pending | denied) == 0;
+        }
+    };
+
+    //! Looks the client up once and classifies the actions.
+    result check(std::string const& client, action_set actions, std::uint64_t now_usec) const;
+
+    //! Marks the actions of the client as being checked.
+    void begin(std::string const& client, action_set actions);
+
+    //! Stores the decision of a check; the action is no longer pending.
+    void store(std::string const& client, std::size_t action, bool granted, std::uint64_t expires_usec);
+
+    //! Drops the decisions and pending checks of the client.
+    void forget(std::string const& client);
+
+    //! Drops all decisions, pending checks stay pending.
+    void invalidate() noexcept;
+
+    std::size_t clients() const noexcept;
+
+private:
+    struct client {
+        action_set pending{0};
+        action_set granted{0};
+        action_set denied{0};
+        std::vector<std::uint64_t> expires{};   //!< by action
+    };
+
+    std::unordered_map<std::string, client> _clients{};
+};
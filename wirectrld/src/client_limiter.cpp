@@ -0,0 +1,58 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "client_limiter.h"
+
+client_limiter::client_limiter(unsigned rate, unsigned burst)
+    : _rate{rate}
+    , _burst{burst}
+{}
+
+bool client_limiter::enabled() const noexcept
+{
+    return _rate > 0;
+}
+
+bool client_limiter::admit(std::string const& key, std::uint64_t now_usec)
+{
+    if (!enabled()) {
+        return true;
+    }
+    auto it = _clients.find(key);
+    if (it == _clients.end()) {
+        it = _clients.emplace(key, client{core::token_bucket{_rate, _burst}}).first;
+    }
+    if (it->second.bucket.try_take(now_usec)) {
+        return true;
+    }
+    ++it->second.rejected;
+    ++_rejected;
+    return false;
+}
+
+void client_limiter::forget(std::string const& key)
+{
+    _clients.erase(key);
+}
+
+std::uint64_t client_limiter::rejected() const noexcept
+{
+    return _rejected;
+}
+
+std::size_t client_limiter::clients() const noexcept
+{
+    return _clients.size();
+}
@@ -0,0 +1,69 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/token_bucket.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+//! Token bucket per DBus client that limits the method calls a client may make.
+//! Clients are identified by a key, their unique bus name or their UID. A client gets a
+//! bucket on its first call; buckets of unique names are dropped when the name vanishes.
+class client_limiter
+{
+public:
+    //! @param rate     calls per second of every client, 0 disables the limit
+    //! @param burst    calls a client may make in a row before the rate applies
+    client_limiter(unsigned rate, unsigned burst);
+
+    bool enabled() const noexcept;
+
+    //! Takes a token of the client; returns false and counts the rejection if it has none.
+    bool admit(std::string const& key, std::uint64_t now_usec);
+
+    //! Drops the bucket and the counter of the client.
+    void forget(std::string const& key);
+
+    //! Calls rejected since start, including those of forgotten clients.
+    std::uint64_t rejected() const noexcept;
+
+    //! Calls rejected per known client.
+    template<typename Fn>
+    void for_each_rejected(Fn&& fn) const
+    {
+        for (auto const& c : _clients) {
+            if (c.second.rejected > 0) {
+                fn(c.first, c.second.rejected);
+            }
+        }
+    }
+
+    std::size_t clients() const noexcept;
+
+private:
+    struct client {
+        core::token_bucket bucket;
+        std::uint64_t rejected{0};
+    };
+
+    unsigned _rate;
+    unsigned _burst;
+    std::uint64_t _rejected{0};
+    std::unordered_map<std::string, client> _clients{};
+};
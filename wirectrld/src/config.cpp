@@ -14,122 +14,268 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "config.h"
+#include "validators.h"
+
+#include <core/final.h>
+#include <core/parallel.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include <algorithm>
 #include <cstring>
+#include <exception>
 #include <fstream>
-#include <regex>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 #define ENVVAR_NAME_CONFIG      ("WIRECTRL_CONFIG_FILE")
 #define ETC_PATH_CONFIG         ("/etc/wirectrl/wirectrl.conf")
 #define HOME_PATH_CONFIG        ("/.wirectrl/wirectrl.conf")
 #define ENVVAR_HOME             ("HOME")
+#define FRAGMENT_DIR            ("conf.d")
+#define FRAGMENT_SUFFIX         (".conf")
 
 namespace {
 
-bool read_config_file(std::string const& path, core::ini::file &ini_file)
+bool is_readable(std::string const& path)
 {
     std::ifstream f(path);
-    if (!f.is_open()) {
-        return false;
+    return f.is_open();
+}
+
+//! Returns the sorted paths of the regular '*.conf' files in the conf.d directory next to the
+//! configuration file. A missing directory is the same as an empty directory.
+std::vector<std::string> find_fragments(std::string const& config_path)
+{
+    auto slash = config_path.rfind('/');
+    std::string dir = slash == std::string::npos ? std::string{} : config_path.substr(0, slash + 1);
+    dir += FRAGMENT_DIR;
+
+    std::vector<std::string> fragments;
+    DIR* d = ::opendir(dir.c_str());
+    if (d == nullptr) {
+        return fragments;
+    }
+    core::final close_dir{[d](){::closedir(d);}};
+
+    std::string_view const suffix{FRAGMENT_SUFFIX};
+    while (auto entry = ::readdir(d)) {
+        std::string_view name{entry->d_name};
+        if (name.size() <= suffix.size() || name.front() == '.'
+            || name.substr(name.size() - suffix.size()) != suffix) {
+            continue;
+        }
+        auto path = dir + "/" + std::string{name};
+        struct stat st{};
+        if (0 == ::stat(path.c_str(), &st) && S_ISREG(st.st_mode)) {
+            fragments.push_back(std::move(path));
+        }
+    }
+    std::sort(fragments.begin(), fragments.end());
+    return fragments;
+}
+
+//! Returns the paths of all files of the configuration in merge order.
+std::vector<std::string const*> config_paths(config_source const& source)
+{
+    std::vector<std::string const*> paths;
+    paths.reserve(source.fragments.size() + 1);
+    paths.push_back(&source.path);
+    for (auto const& fragment : source.fragments) {
+        paths.push_back(&fragment);
     }
+    return paths;
+}
+
+//! Rethrows the exception with the path of the file it occurred in attached.
+[[noreturn]] void rethrow_with_source(std::exception_ptr const& error, std::string const& path)
+{
     try {
-        ini_file = core::ini::file{f};
+        std::rethrow_exception(error);
     }
-    catch(std::runtime_error& e) {
+    catch (core::ini::parse_exception& e) {
+        throw core::ini::parse_exception{e.line_number(), e.expression(), path};
+    }
+    catch (std::runtime_error& e) {
         throw std::runtime_error{std::string{e.what()} + " [" + path + "]"};
     }
-    return true;
 }
 
-std::string get_prop_value(core::ini::section const& section, std::string const& prop_name, std::string const& def_value)
+//! Rethrows the first error in merge order.
+void check_errors(std::vector<std::exception_ptr> const& errors, std::vector<std::string const*> const& paths)
+{
+    for (std::size_t i = 0; i < errors.size(); ++i) {
+        if (errors[i]) {
+            rethrow_with_source(errors[i], *paths[i]);
+        }
+    }
+}
+
+core::ini::file parse_file(std::string const& path, std::pmr::memory_resource* resource)
 {
-    auto it = std::find_if(section.properties.cbegin(), section.properties.cend(),
-                   [&prop_name](core::ini::property const& p){return p.name == prop_name;});
-    if (it == section.properties.cend()) {
-        return def_value;
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        throw std::runtime_error{std::string{"Cannot open configuration file: "} + path};
+    }
+    return core::ini::file{f, true, resource};
+}
+
+//! The decoded sections of a single file.
+struct configuration_part {
+    std::optional<dbus_configuration> dbus{};
+    std::optional<verify_configuration> verify{};
+    std::optional<scheduler_configuration> scheduler{};
+    std::optional<metrics_configuration> metrics{};
+    std::vector<chip_configuration> chips{};
+    std::vector<gpio_configuration> gpios{};
+    std::vector<scene_configuration> scenes{};
+    std::vector<rule_configuration> rules{};
+};
+
+//! Decodes a section that may appear only once.
+template<typename T>
+void decode_unique(core::ini::section const& section, std::optional<T>& dest)
+{
+    if (dest) {
+        throw std::runtime_error{std::string{"Multiple '"}.append(section.name).append("' sections in configuration file.")};
     }
-    return it->value;
+    dest = T::decode_from_section(section);
 }
 
+//! Moves a section that may appear only once across all files into the configuration.
 template<typename T>
-T get_prop_value_enum(core::ini::section const& section, std::string const& prop_name,
-                      std::vector<std::pair<std::string, T>> const& values, T const& def_value = T{})
+void merge_unique(std::optional<T>& part, T& dest, char const* name,
+                  std::string const*& first_path, std::string const& path)
 {
-    auto it = std::find_if(section.properties.cbegin(), section.properties.cend(),
-                           [&prop_name](core::ini::property const& p){return p.name == prop_name;});
-    if (it == section.properties.cend()) {
-        return def_value;
+    if (!part) {
+        return;
     }
-    auto rit = std::find_if(values.cbegin(), values.cend(),
-                    [str = it->value](std::pair<std::string, T> const& v){return v.first == str;});
-    if (rit == values.cend()) {
-        return def_value;
+    if (first_path != nullptr) {
+        throw std::runtime_error{std::string{"Multiple '"} + name + "' sections in configuration, first in "
+                                 + *first_path + " [" + path + "]"};
     }
-    return rit->second;
+    first_path = &path;
+    dest = std::move(*part);
+}
+
+configuration_part decode_file(core::ini::file const& ini_file)
+{
+    configuration_part part;
+    for (auto const& section : ini_file.sections()) {
+        if (section.name == "dbus") {
+            decode_unique(section, part.dbus);
+        }
+        else if (section.name == "verify") {
+            decode_unique(section, part.verify);
+        }
+        else if (section.name == "scheduler") {
+            decode_unique(section, part.scheduler);
+        }
+        else if (section.name == "metrics") {
+            decode_unique(section, part.metrics);
+        }
+        else if (section.name == "chip") {
+            part.chips.push_back(chip_configuration::decode_from_section(section));
+        }
+        else if (section.name == "gpio") {
+            part.gpios.push_back(gpio_configuration::decode_from_section(section));
+        }
+        else if (section.name == "scene") {
+            part.scenes.push_back(scene_configuration::decode_from_section(section));
+        }
+        else if (section.name == "rule") {
+            part.rules.push_back(rule_configuration::decode_from_section(section));
+        }
+        else {
+            throw std::runtime_error{std::string{"Unknown section type: "}.append(section.name)};
+        }
+    }
+    return part;
 }
 
 } // namespace
 
-std::pair<core::ini::file, std::string> get_config(opts const& options)
+config_source find_config(opts const& options)
 {
-    core::ini::file ini_file;
-
     if (!options.config_file.empty()) {
-        if (!read_config_file(options.config_file, ini_file)) {
+        if (!is_readable(options.config_file)) {
             std::string msg{"Cannot open configuration file from command line argument: "};
             msg += options.config_file;
             throw std::runtime_error{msg};
         }
-        return std::make_pair(ini_file, std::string{"-c "} + options.config_file);
+        return config_source{options.config_file, std::string{"-c "} + options.config_file,
+                             find_fragments(options.config_file)};
     }
 
     auto env_var_wirectrl_config = getenv(ENVVAR_NAME_CONFIG);
     if (env_var_wirectrl_config != nullptr && strlen(env_var_wirectrl_config) > 0) {
-        if (!read_config_file(env_var_wirectrl_config, ini_file)) {
+        if (!is_readable(env_var_wirectrl_config)) {
             std::string msg{"Cannot open configuration file from environment variable: "};
             msg += env_var_wirectrl_config;
             throw std::runtime_error{msg};
         }
-        return std::make_pair(ini_file, std::string{ENVVAR_NAME_CONFIG} + "=" + std::string{env_var_wirectrl_config});
+        return config_source{env_var_wirectrl_config,
+                             std::string{ENVVAR_NAME_CONFIG} + "=" + std::string{env_var_wirectrl_config},
+                             find_fragments(env_var_wirectrl_config)};
     }
 
     auto env_var_home = getenv(ENVVAR_HOME);
     if (env_var_home != nullptr && strlen(env_var_home) > 0) {
         std::string path{env_var_home};
         path += HOME_PATH_CONFIG;
-        if (read_config_file(path, ini_file)) {
-            return std::make_pair(ini_file, path);
+        if (is_readable(path)) {
+            auto fragments = find_fragments(path);
+            return config_source{path, path, std::move(fragments)};
         }
     }
-    if (read_config_file(ETC_PATH_CONFIG, ini_file)) {
-        return std::make_pair(ini_file, std::string{ETC_PATH_CONFIG});
+    if (is_readable(ETC_PATH_CONFIG)) {
+        return config_source{ETC_PATH_CONFIG, ETC_PATH_CONFIG, find_fragments(ETC_PATH_CONFIG)};
     }
     throw std::runtime_error{"No configuration file found."};
 }
 
-configuration configuration::decode_from_section(core::ini::file const& ini_file)
+configuration configuration::load(config_source const& source)
 {
-    configuration c;
+    auto paths = config_paths(source);
+    std::vector<configuration_part> parts(paths.size());
+    check_errors(core::for_each_parallel(paths.size(), [&](std::size_t i) {
+                     std::pmr::monotonic_buffer_resource arena{};
+                     auto ini_file = parse_file(*paths[i], &arena);
+                     ini_file.build_index();
+                     parts[i] = decode_file(ini_file);
+                 }), paths);
 
-    bool dbus_section_found {false};
-    for (auto const& section : ini_file.sections()) {
-        if (section.name == "dbus") {
-            if (dbus_section_found) {
-                // more than one dbus section
-                throw std::runtime_error{"Multiple 'dbus' sections in configuration file."};
+    configuration c;
+    std::string const* dbus_path{nullptr};
+    std::string const* verify_path{nullptr};
+    std::string const* scheduler_path{nullptr};
+    std::string const* metrics_path{nullptr};
+    std::size_t gpio_count{0};
+    for (auto const& part : parts) {
+        gpio_count += part.gpios.size();
+    }
+    c.gpios.reserve(gpio_count);
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        auto& part = parts[i];
+        merge_unique(part.dbus, c.dbus, "dbus", dbus_path, *paths[i]);
+        merge_unique(part.verify, c.verify, "verify", verify_path, *paths[i]);
+        merge_unique(part.scheduler, c.scheduler, "scheduler", scheduler_path, *paths[i]);
+        merge_unique(part.metrics, c.metrics, "metrics", metrics_path, *paths[i]);
+        for (auto& chip : part.chips) {
+            auto same = [&chip](chip_configuration const& other){return other.name == chip.name;};
+            if (std::any_of(c.chips.begin(), c.chips.end(), same)) {
+                throw std::runtime_error{"Multiple 'chip' sections for " + chip.name + " [" + *paths[i] + "]"};
             }
-            dbus_section_found = true;
-            c.dbus = dbus_configuration::decode_from_section(section);
-        }
-        else if (section.name == "gpio") {
-            c.gpios.push_back(gpio_configuration::decode_from_section(section));
-        }
-        else {
-            throw std::runtime_error{std::string{"Unknown section type: "} + section.name};
+            c.chips.push_back(std::move(chip));
         }
+        std::move(part.gpios.begin(), part.gpios.end(), std::back_inserter(c.gpios));
+        std::move(part.scenes.begin(), part.scenes.end(), std::back_inserter(c.scenes));
+        std::move(part.rules.begin(), part.rules.end(), std::back_inserter(c.rules));
     }
     return c;
 }
@@ -137,47 +283,173 @@ configuration configuration::decode_from_section(core::ini::file const& ini_file
 dbus_configuration dbus_configuration::decode_from_section(core::ini::section const& section)
 {
     dbus_configuration dc;
-    dc.connection_name = get_prop_value(section, "connection-id", "de.titnc.pi.wirectrl");
-    dc.object_name = get_prop_value(section, "object-id", "/de/titnc/pi/wirectrl/v1");
-    auto str_use_session_bus = get_prop_value(section, "use-session-bus", "true");
-    dc.use_session_bus = (str_use_session_bus == "true");
+    dc.connection_name = section.get<std::string>("connection-id", "de.titnc.pi.wirectrl");
+    dc.object_name = section.get<std::string>("object-id", "/de/titnc/pi/wirectrl/v1");
+    dc.use_session_bus = section.get<bool>("use-session-bus", true);
+    dc.peer_socket = section.get<std::string>("peer-socket", std::string{});
+    dc.client_rate = section.get<unsigned>("client-rate", 0);
+    dc.client_burst = section.get<unsigned>("client-burst", std::max(dc.client_rate, 1u));
+    dc.client_key = section.get_enum<client_identity>("client-key",
+                                                      {{"sender", client_identity::sender},
+                                                       {"uid",    client_identity::uid}},
+                                                      client_identity::sender);
+    dc.authorization_ttl = section.get<unsigned>("authorization-ttl", 300);
+    dc.broadcast_lines = section.get<bool>("broadcast-lines", true);
 
     // sanity checks
-    std::regex connection_name_regex{R"(([a-z0-9_]+)(\.[a-z0-9_]+)*)"};
-    if (!std::regex_match(dc.connection_name, connection_name_regex)) {
+    if (!validate::dbus_connection_name(dc.connection_name)) {
         throw std::runtime_error{std::string{"DBus connection name invalid:"} + dc.connection_name};
     }
-    std::regex object_name_regex{R"((/[a-z0-9_]+)(/[a-z0-9_]+)*)"};
-    if (!std::regex_match(dc.object_name, object_name_regex)) {
+    if (!validate::dbus_object_name(dc.object_name)) {
         throw std::runtime_error{std::string{"DBus object name invalid:"} + dc.object_name};
     }
-    std::regex use_session_bus_regex{R"(true|false)"};
-    if (!str_use_session_bus.empty() && !std::regex_match(str_use_session_bus, use_session_bus_regex)) {
-        throw std::runtime_error{std::string{"Invalid value for dbus.use-session-bus :"} + str_use_session_bus};
+    if (!dc.peer_socket.empty() && !validate::unix_socket_path(dc.peer_socket)) {
+        throw std::runtime_error{std::string{"DBus peer socket path invalid:"} + dc.peer_socket};
+    }
+    if (dc.client_rate > 0 && dc.client_burst == 0) {
+        throw std::runtime_error{"DBus client burst must not be 0."};
+    }
+    if (dc.authorization_ttl == 0) {
+        throw std::runtime_error{"DBus authorization ttl must not be 0."};
     }
     return dc;
 }
 
+verify_configuration verify_configuration::decode_from_section(core::ini::section const& section)
+{
+    verify_configuration vc;
+    vc.interval_ms = section.get<unsigned>("interval", 0);
+    vc.reassert = section.get<bool>("reassert", false);
+    return vc;
+}
+
+scheduler_configuration scheduler_configuration::decode_from_section(core::ini::section const& section)
+{
+    auto decode_limit = [&section](std::string const& cls) {
+        limit l;
+        l.rate = section.get<unsigned>(cls + "-rate", 0);
+        // without an explicit burst a class may use up one second of its rate at once
+        l.burst = section.get<unsigned>(cls + "-burst", std::max(l.rate, 1u));
+        if (l.rate > 0 && l.burst == 0) {
+            throw std::runtime_error{"Scheduler burst of " + cls + " must not be 0."};
+        }
+        return l;
+    };
+    scheduler_configuration sc;
+    sc.realtime = decode_limit("realtime");
+    sc.bus = decode_limit("bus");
+    sc.housekeeping = decode_limit("housekeeping");
+    sc.lag_threshold_ms = section.get<unsigned>("lag-threshold", 100);
+    return sc;
+}
+
+metrics_configuration metrics_configuration::decode_from_section(core::ini::section const& section)
+{
+    metrics_configuration mc;
+    mc.socket = section.get<std::string>("socket", std::string{});
+    if (!mc.socket.empty() && !validate::unix_socket_path(mc.socket)) {
+        throw std::runtime_error{std::string{"Metrics socket path invalid:"} + mc.socket};
+    }
+    return mc;
+}
+
+rule_configuration rule_configuration::decode_from_section(core::ini::section const& section)
+{
+    rule_configuration rc;
+    rc.input = section.get<std::string>("input", std::string{});
+    rc.output = section.get<std::string>("output", std::string{});
+    if (rc.input.empty() || rc.output.empty()) {
+        throw std::runtime_error{"Rule without input or output line."};
+    }
+    rc.edge = section.get_enum<gpio::edge>("edge",
+                                           {{"rising",  gpio::edge::rising},
+                                            {"falling", gpio::edge::falling},
+                                            {"both",    gpio::edge::both}},
+                                           gpio::edge::rising);
+    rc.level = section.get_enum<gpio::level>("level",
+                                             {{"inactive", gpio::level::inactive},
+                                              {"active",   gpio::level::active}},
+                                             gpio::level::active);
+    rc.duration_ms = section.get<unsigned>("duration", 0);
+    return rc;
+}
+
+scene_configuration scene_configuration::decode_from_section(core::ini::section const& section)
+{
+    scene_configuration sc;
+    if (!validate::scene_name(section.value)) {
+        throw std::runtime_error{std::string{"Invalid scene name: "}.append(section.value)};
+    }
+    sc.name = std::string{std::string_view{section.value}};
+    sc.levels.reserve(section.properties.size());
+    for (auto const& p : section.properties) {
+        gpio::level lev;
+        if (p.value == "active") {
+            lev = gpio::level::active;
+        }
+        else if (p.value == "inactive") {
+            lev = gpio::level::inactive;
+        }
+        else {
+            throw core::ini::parse_exception{p.line_number, std::string{std::string_view{p.name}}
+                                                            .append(" = ").append(p.value)};
+        }
+        sc.levels.emplace_back(std::string{std::string_view{p.name}}, lev);
+    }
+    return sc;
+}
+
+chip_configuration chip_configuration::decode_from_section(core::ini::section const& section)
+{
+    chip_configuration cc;
+    if (section.value.empty()) {
+        throw std::runtime_error{"Chip section without chip name."};
+    }
+    cc.name = std::string{std::string_view{section.value}};
+    cc.backend = section.get_enum<gpio::chip_backend>("backend",
+                                                      {{"gpiod", gpio::chip_backend::gpiod},
+                                                       {"raw",   gpio::chip_backend::raw}},
+                                                      gpio::chip_backend::gpiod);
+    return cc;
+}
+
 gpio_configuration gpio_configuration::decode_from_section(core::ini::section const& section) {
     gpio_configuration gc;
-    gc.name = get_prop_value(section, "name", std::string{});
-    gc.consumer = get_prop_value(section, "consumer", "wirectrl");
-
-    gc.active_level = get_prop_value_enum<gpio::active_level>(section, "active-level",
-                                                              {{"low",  gpio::active_level::active_low},
-                                                               {"high", gpio::active_level::active_high}},
-                                                              gpio::active_level::undefined);
-    gc.initial_level = get_prop_value_enum<gpio::level>(section, "init-level",
-                                                        {{"inactive", gpio::level::inactive},
-                                                         {"active",   gpio::level::active}},
-                                                        gpio::level::inactive);
-
-    static std::regex const gpio_line_spec_regex{R"((.+)\-([0-9]+))"};
-    std::smatch line_spec_match;
-    if (!std::regex_match(section.value, line_spec_match, gpio_line_spec_regex) || line_spec_match.size() < 2) {
-        throw std::runtime_error{std::string{"Invalid gpio line spec: "} + section.value};
-    };
-    gc.gpio_chip_name = line_spec_match[1];
-    gc.gpio_line_id = static_cast<unsigned>(std::stoi(line_spec_match[2]));
+    gc.name = section.get<std::string>("name", std::string{});
+    gc.consumer = section.get<std::string>("consumer", "wirectrl");
+
+    gc.active_level = section.get_enum<gpio::active_level>("active-level",
+                                                           {{"low",  gpio::active_level::active_low},
+                                                            {"high", gpio::active_level::active_high}},
+                                                           gpio::active_level::undefined);
+    gc.initial_level = section.get_enum<gpio::level>("init-level",
+                                                     {{"inactive", gpio::level::inactive},
+                                                      {"active",   gpio::level::active}},
+                                                     gpio::level::inactive);
+    gc.request = section.get_enum<gpio::request_mode>("request",
+                                                      {{"eager",     gpio::request_mode::eager},
+                                                       {"lazy",      gpio::request_mode::lazy},
+                                                       {"on-demand", gpio::request_mode::on_demand}},
+                                                      gpio::request_mode::eager);
+    gc.direction = section.get_enum<gpio::direction>("direction",
+                                                     {{"output", gpio::direction::output},
+                                                      {"input",  gpio::direction::input}},
+                                                     gpio::direction::output);
+    gc.pull_resistor = section.get_enum<gpio::pull_resistor>("pull-resistor",
+                                                             {{"none", gpio::pull_resistor::none},
+                                                              {"up",   gpio::pull_resistor::up},
+                                                              {"down", gpio::pull_resistor::down}},
+                                                             gpio::pull_resistor::none);
+    gc.access = section.get<std::string>("access", std::string{});
+    if (!gc.access.empty() && !validate::polkit_action(gc.access)) {
+        throw std::runtime_error{std::string{"Invalid polkit action: "} + gc.access};
+    }
+
+    validate::line_spec spec{};
+    if (!validate::gpio_line_spec(section.value, spec)) {
+        throw std::runtime_error{std::string{"Invalid gpio line spec: "}.append(section.value)};
+    }
+    gc.gpio_chip_name = std::string{spec.chip};
+    gc.gpio_line_id = spec.line;
     return gc;
 }
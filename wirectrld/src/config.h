@@ -24,46 +24,135 @@
 #include <tuple>
 #include <vector>
 
-//! Searches for the configuration file and parses it.
+//! Location of the configuration file and a description where the location came from.
+struct config_source {
+    std::string path;                   //!< path of the configuration file
+    std::string origin;                 //!< description of the origin for diagnostics (e.g. '-c <path>')
+    std::vector<std::string> fragments; //!< paths of the conf.d fragments in the order they are merged
+};
+
+//! Searches for the configuration file and its fragments.
 //! The method searches for the configuration file in the following order:
-//! 1. If a path is given in options.config_file (from command line -c) this file is parsed.
+//! 1. If a path is given in options.config_file (from command line -c) this file is used.
 //!    If the file does not exist the function throws a std::runtime error.
 //! 2. If the environment variable WIRECTRL_CONFIG_FILE is set it is interpreted as config file path
 //!    If the file does not exist the function throws a std::runtime error.
-//! 3. If the file $HOME/.wirectrl/wirectrl.conf exist it is parsed as configuration file.
+//! 3. If the file $HOME/.wirectrl/wirectrl.conf exist it is used as configuration file.
 //!    If the $HOME environment variable is not set, it is the same as when the file does not exist.
-//! 4. If the file /etc/wirectrl/wirectrl.conf exists it is parsed as configuration file.
-//! 5. When no configuration file is found or an existing file is parsed with ini-errors, the function
-//!    throws a std::runtime_error.
-//! @throws     std::runtime_error  Thrown when expected files are not found or ini-syntax errors occurred.
-//! @return     Returns a pair consisting of the ini-file root section and the ini-file's path
-std::pair<core::ini::file, std::string> get_config(opts const& options);
+//! 4. If the file /etc/wirectrl/wirectrl.conf exists it is used as configuration file.
+//! Fragments are the regular files with suffix '.conf' in the directory 'conf.d' next to the
+//! configuration file, sorted by file name.
+//! @throws     std::runtime_error  Thrown when no configuration file is found.
+config_source find_config(opts const& options);
 
+//! Identity of a DBus client for the call rate limit.
+enum class client_identity {
+    sender,     //!< unique bus name, every connection has its own limit
+    uid,        //!< user id, all connections of a user share a limit
+    last = uid,
+};
 
 struct dbus_configuration {
     std::string connection_name;
     std::string object_name;
     bool use_session_bus;
+    std::string peer_socket;    //!< path of the socket for direct peer-to-peer connections, empty if disabled
+    unsigned client_rate{0};    //!< method calls per second and client, 0 for no limit
+    unsigned client_burst{1};   //!< calls a client may make in a row before the rate applies
+    client_identity client_key{client_identity::sender};
+    unsigned authorization_ttl{300};    //!< seconds a polkit authorization of a client is cached
+    bool broadcast_lines{true};     //!< emit PropertiesChanged for 'lines', subscribers get unicast signals regardless
 
     static dbus_configuration decode_from_section(core::ini::section const& s);
 };
 
+//! Hardware read-back of the output lines.
+struct verify_configuration {
+    unsigned interval_ms{0};    //!< period of the read-back, 0 disables the periodic read-back
+    bool reassert{false};       //!< drive the commanded level again when a line drifted
+
+    static verify_configuration decode_from_section(core::ini::section const& s);
+};
+
+//! Rate limits of the event source priority classes, a rate of 0 leaves the class unlimited.
+struct scheduler_configuration {
+    struct limit {
+        unsigned rate{0};       //!< dispatches per second
+        unsigned burst{1};      //!< dispatches allowed in a row before the rate applies
+    };
+    limit realtime{};
+    limit bus{};
+    limit housekeeping{};
+    unsigned lag_threshold_ms{100};     //!< loop iterations above are logged with their slowest handler, 0 disables
+
+    static scheduler_configuration decode_from_section(core::ini::section const& s);
+};
+
+//! OpenMetrics export of the daemon's counters.
+struct metrics_configuration {
+    std::string socket;     //!< path of the UNIX socket serving the metrics, empty if disabled
+
+    static metrics_configuration decode_from_section(core::ini::section const& s);
+};
+
+//! Settings of a GPIO chip, chips without a section use libgpiod.
+struct chip_configuration {
+    std::string name;
+    gpio::chip_backend backend{gpio::chip_backend::gpiod};
+
+    static chip_configuration decode_from_section(core::ini::section const& s);
+};
+
 struct gpio_configuration {
     std::string name;
     std::string consumer;
     gpio::level initial_level;
     gpio::active_level active_level;
-    gpio::pull_resistor pull_resistor;
-    bool terminate_on_error;
+    gpio::pull_resistor pull_resistor{gpio::pull_resistor::none};
+    bool terminate_on_error{false};
+    gpio::request_mode request{gpio::request_mode::eager};
+    gpio::direction direction{gpio::direction::output};
+    std::string access;         //!< polkit action required to set the line, empty if unrestricted
 
     std::string gpio_chip_name;
     unsigned gpio_line_id;
     static gpio_configuration decode_from_section(core::ini::section const& s);
 };
 
+//! Output action triggered by an edge of an input line.
+struct rule_configuration {
+    std::string input;          //!< name of the input line
+    gpio::edge edge{gpio::edge::rising};
+    std::string output;         //!< name of the output line
+    gpio::level level{gpio::level::active};
+    unsigned duration_ms{0};    //!< the output returns to the opposite level after this time, 0 for never
+
+    static rule_configuration decode_from_section(core::ini::section const& s);
+};
+
+//! Named set of line levels applied with one call.
+struct scene_configuration {
+    std::string name;
+    std::vector<std::pair<std::string, gpio::level>> levels;   //!< line name and level
+
+    static scene_configuration decode_from_section(core::ini::section const& s);
+};
+
 struct configuration {
     dbus_configuration dbus{};
+    verify_configuration verify{};
+    scheduler_configuration scheduler{};
+    metrics_configuration metrics{};
+    std::vector<chip_configuration> chips{};
     std::vector<gpio_configuration> gpios{};
+    std::vector<scene_configuration> scenes{};
+    std::vector<rule_configuration> rules{};
 
-    static configuration decode_from_section(core::ini::file const& ini_file);
+    //! Parses and decodes the configuration file and its fragments.
+    //! Every file is parsed and decoded on a worker thread into its own arena, the decoded parts are
+    //! merged on the calling thread in the order configuration file first, then fragments.
+    //! The first error in that order is rethrown with the path of the offending file attached.
+    //! @throws     core::ini::parse_exception  Thrown on ini-syntax errors, source() names the file.
+    //! @throws     std::runtime_error  Thrown when a file cannot be read or decoded.
+    static configuration load(config_source const& source);
 };
\ No newline at end of file
@@ -0,0 +1,527 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "config_cache.h"
+
+#include <core/final.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+    constexpr char cache_magic[8] = {'W', 'C', 'T', 'L', 'C', 'F', 'G', '\0'};
+    //! Bumped once per change of the payload layout.
+    constexpr std::uint32_t cache_version{13};
+
+    //! Fixed size header at the beginning of the cache file, followed by payload_size bytes of payload.
+    struct cache_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t header_size;
+        std::uint64_t source_stamp;
+        std::uint64_t payload_size;
+        std::uint64_t payload_checksum;
+    };
+
+    // FNV-1a (64 bit)
+    constexpr std::uint64_t fnv_offset_basis{14695981039346656037ull};
+    constexpr std::uint64_t fnv_prime{1099511628211ull};
+
+    std::uint64_t fnv1a(void const* data, std::size_t size, std::uint64_t hash = fnv_offset_basis)
+    {
+        auto bytes = static_cast<unsigned char const*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= fnv_prime;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    std::uint64_t fnv1a_value(T value, std::uint64_t hash)
+    {
+        return fnv1a(&value, sizeof(value), hash);
+    }
+
+    // ------------------------------------------------------------------------
+    // encoding
+    // ------------------------------------------------------------------------
+    class writer {
+    public:
+        template<typename T>
+        std::enable_if_t<std::is_integral_v<T>> put(T value)
+        {
+            auto p = reinterpret_cast<char const*>(&value);
+            _buffer.append(p, sizeof(T));
+        }
+
+        template<typename T>
+        std::enable_if_t<std::is_enum_v<T>> put(T value)
+        {
+            put(static_cast<std::uint8_t>(value));
+        }
+
+        void put(bool value)
+        {
+            put(static_cast<std::uint8_t>(value ? 1 : 0));
+        }
+
+        void put(std::string const& value)
+        {
+            put(static_cast<std::uint32_t>(value.size()));
+            _buffer.append(value);
+        }
+
+        std::string const& buffer() const
+        {
+            return _buffer;
+        }
+
+    private:
+        std::string _buffer{};
+    };
+
+    class reader {
+    public:
+        reader(char const* data, std::size_t size)
+            : _pos{data}, _end{data + size}
+        {}
+
+        template<typename T>
+        std::enable_if_t<std::is_integral_v<T>, bool> get(T& value)
+        {
+            if (static_cast<std::size_t>(_end - _pos) < sizeof(T)) {
+                return false;
+            }
+            std::memcpy(&value, _pos, sizeof(T));
+            _pos += sizeof(T);
+            return true;
+        }
+
+        //! Reads an enumeration value; values greater than T::last are rejected.
+        template<typename T>
+        std::enable_if_t<std::is_enum_v<T>, bool> get(T& value)
+        {
+            std::uint8_t v;
+            if (!get(v) || v > static_cast<std::uint8_t>(T::last)) {
+                return false;
+            }
+            value = static_cast<T>(v);
+            return true;
+        }
+
+        bool get(bool& value)
+        {
+            std::uint8_t v;
+            if (!get(v) || v > 1) {
+                return false;
+            }
+            value = (v == 1);
+            return true;
+        }
+
+        bool get(std::string& value)
+        {
+            std::uint32_t size;
+            if (!get(size) || static_cast<std::size_t>(_end - _pos) < size) {
+                return false;
+            }
+            value.assign(_pos, size);
+            _pos += size;
+            return true;
+        }
+
+        bool at_end() const
+        {
+            return _pos == _end;
+        }
+
+    private:
+        char const* _pos;
+        char const* _end;
+    };
+
+    void encode(writer& w, dbus_configuration const& dc)
+    {
+        w.put(dc.connection_name);
+        w.put(dc.object_name);
+        w.put(dc.use_session_bus);
+        w.put(dc.peer_socket);
+        w.put(static_cast<std::uint32_t>(dc.client_rate));
+        w.put(static_cast<std::uint32_t>(dc.client_burst));
+        w.put(dc.client_key);
+        w.put(static_cast<std::uint32_t>(dc.authorization_ttl));
+        w.put(dc.broadcast_lines);
+    }
+
+    bool decode(reader& r, dbus_configuration& dc)
+    {
+        std::uint32_t client_rate;
+        std::uint32_t client_burst;
+        std::uint32_t authorization_ttl;
+        if (!r.get(dc.connection_name)
+            || !r.get(dc.object_name)
+            || !r.get(dc.use_session_bus)
+            || !r.get(dc.peer_socket)
+            || !r.get(client_rate)
+            || !r.get(client_burst)
+            || !r.get(dc.client_key)
+            || !r.get(authorization_ttl)
+            || !r.get(dc.broadcast_lines)) {
+            return false;
+        }
+        dc.client_rate = client_rate;
+        dc.client_burst = client_burst;
+        dc.authorization_ttl = authorization_ttl;
+        return true;
+    }
+
+    void encode(writer& w, verify_configuration const& vc)
+    {
+        w.put(static_cast<std::uint32_t>(vc.interval_ms));
+        w.put(vc.reassert);
+    }
+
+    bool decode(reader& r, verify_configuration& vc)
+    {
+        std::uint32_t interval_ms;
+        if (!r.get(interval_ms) || !r.get(vc.reassert)) {
+            return false;
+        }
+        vc.interval_ms = interval_ms;
+        return true;
+    }
+
+    void encode(writer& w, scheduler_configuration const& sc)
+    {
+        for (auto l : {&sc.realtime, &sc.bus, &sc.housekeeping}) {
+            w.put(static_cast<std::uint32_t>(l->rate));
+            w.put(static_cast<std::uint32_t>(l->burst));
+        }
+        w.put(static_cast<std::uint32_t>(sc.lag_threshold_ms));
+    }
+
+    void encode(writer& w, metrics_configuration const& mc)
+    {
+        w.put(mc.socket);
+    }
+
+    bool decode(reader& r, metrics_configuration& mc)
+    {
+        return r.get(mc.socket);
+    }
+
+    bool decode(reader& r, scheduler_configuration& sc)
+    {
+        for (auto l : {&sc.realtime, &sc.bus, &sc.housekeeping}) {
+            std::uint32_t rate;
+            std::uint32_t burst;
+            if (!r.get(rate) || !r.get(burst)) {
+                return false;
+            }
+            l->rate = rate;
+            l->burst = burst;
+        }
+        std::uint32_t lag_threshold_ms;
+        if (!r.get(lag_threshold_ms)) {
+            return false;
+        }
+        sc.lag_threshold_ms = lag_threshold_ms;
+        return true;
+    }
+
+    void encode(writer& w, chip_configuration const& cc)
+    {
+        w.put(cc.name);
+        w.put(cc.backend);
+    }
+
+    bool decode(reader& r, chip_configuration& cc)
+    {
+        return r.get(cc.name)
+            && r.get(cc.backend);
+    }
+
+    void encode(writer& w, gpio_configuration const& gc)
+    {
+        w.put(gc.name);
+        w.put(gc.consumer);
+        w.put(gc.initial_level);
+        w.put(gc.active_level);
+        w.put(gc.pull_resistor);
+        w.put(gc.terminate_on_error);
+        w.put(gc.request);
+        w.put(gc.direction);
+        w.put(gc.access);
+        w.put(gc.gpio_chip_name);
+        w.put(static_cast<std::uint32_t>(gc.gpio_line_id));
+    }
+
+    bool decode(reader& r, gpio_configuration& gc)
+    {
+        std::uint32_t line_id;
+        if (!r.get(gc.name)
+            || !r.get(gc.consumer)
+            || !r.get(gc.initial_level)
+            || !r.get(gc.active_level)
+            || !r.get(gc.pull_resistor)
+            || !r.get(gc.terminate_on_error)
+            || !r.get(gc.request)
+            || !r.get(gc.direction)
+            || !r.get(gc.access)
+            || !r.get(gc.gpio_chip_name)
+            || !r.get(line_id)) {
+            return false;
+        }
+        gc.gpio_line_id = line_id;
+        return true;
+    }
+
+    void encode(writer& w, scene_configuration const& sc)
+    {
+        w.put(sc.name);
+        w.put(static_cast<std::uint32_t>(sc.levels.size()));
+        for (auto const& [line, lev] : sc.levels) {
+            w.put(line);
+            w.put(lev);
+        }
+    }
+
+    bool decode(reader& r, scene_configuration& sc)
+    {
+        std::uint32_t level_count;
+        if (!r.get(sc.name) || !r.get(level_count)) {
+            return false;
+        }
+        sc.levels.clear();
+        for (std::uint32_t i = 0; i < level_count; ++i) {
+            std::pair<std::string, gpio::level> level;
+            if (!r.get(level.first) || !r.get(level.second)) {
+                return false;
+            }
+            sc.levels.push_back(std::move(level));
+        }
+        return true;
+    }
+
+    void encode(writer& w, rule_configuration const& rc)
+    {
+        w.put(rc.input);
+        w.put(rc.edge);
+        w.put(rc.output);
+        w.put(rc.level);
+        w.put(static_cast<std::uint32_t>(rc.duration_ms));
+    }
+
+    bool decode(reader& r, rule_configuration& rc)
+    {
+        std::uint32_t duration_ms;
+        if (!r.get(rc.input)
+            || !r.get(rc.edge)
+            || !r.get(rc.output)
+            || !r.get(rc.level)
+            || !r.get(duration_ms)) {
+            return false;
+        }
+        rc.duration_ms = duration_ms;
+        return true;
+    }
+
+    template<typename T>
+    void encode(writer& w, std::vector<T> const& v)
+    {
+        w.put(static_cast<std::uint32_t>(v.size()));
+        for (auto const& e : v) {
+            encode(w, e);
+        }
+    }
+
+    template<typename T>
+    bool decode(reader& r, std::vector<T>& v)
+    {
+        std::uint32_t count;
+        if (!r.get(count)) {
+            return false;
+        }
+        v.clear();
+        v.reserve(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            T e;
+            if (!decode(r, e)) {
+                return false;
+            }
+            v.push_back(std::move(e));
+        }
+        return true;
+    }
+
+    void encode(writer& w, configuration const& c)
+    {
+        encode(w, c.dbus);
+        encode(w, c.verify);
+        encode(w, c.scheduler);
+        encode(w, c.metrics);
+        encode(w, c.chips);
+        encode(w, c.gpios);
+        encode(w, c.scenes);
+        encode(w, c.rules);
+    }
+
+    bool decode(reader& r, configuration& c)
+    {
+        return decode(r, c.dbus)
+            && decode(r, c.verify)
+            && decode(r, c.scheduler)
+            && decode(r, c.metrics)
+            && decode(r, c.chips)
+            && decode(r, c.gpios)
+            && decode(r, c.scenes)
+            && decode(r, c.rules)
+            && r.at_end();
+    }
+
+    void write_all(int fd, char const* data, std::size_t size)
+    {
+        while (size > 0) {
+            auto n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error{std::string{"Cannot write configuration cache: "} + std::strerror(errno)};
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+
+} // namespace
+
+std::string config_cache_path(std::string const& config_path)
+{
+    return config_path + ".cache";
+}
+
+bool config_source_stamp(config_source const& source, std::uint64_t& stamp)
+{
+    // the fragment paths are part of the stamp, so adding or removing a fragment invalidates it
+    auto hash = fnv_offset_basis;
+    auto add_file = [&hash](std::string const& path) {
+        struct stat st{};
+        if (0 != ::stat(path.c_str(), &st)) {
+            return false;
+        }
+        hash = fnv1a(path.data(), path.size() + 1, hash);
+        hash = fnv1a_value(static_cast<std::uint64_t>(st.st_dev), hash);
+        hash = fnv1a_value(static_cast<std::uint64_t>(st.st_ino), hash);
+        hash = fnv1a_value(static_cast<std::int64_t>(st.st_size), hash);
+        hash = fnv1a_value(static_cast<std::int64_t>(st.st_mtim.tv_sec), hash);
+        hash = fnv1a_value(static_cast<std::int64_t>(st.st_mtim.tv_nsec), hash);
+        return true;
+    };
+    if (!add_file(source.path)) {
+        return false;
+    }
+    for (auto const& fragment : source.fragments) {
+        if (!add_file(fragment)) {
+            return false;
+        }
+    }
+    stamp = hash;
+    return true;
+}
+
+bool load_config_cache(config_source const& source, std::uint64_t stamp, configuration& config)
+{
+    int fd = ::open(config_cache_path(source.path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    core::final close_fd{[fd](){::close(fd);}};
+
+    struct stat st{};
+    if (0 != ::fstat(fd, &st) || static_cast<std::size_t>(st.st_size) < sizeof(cache_header)) {
+        return false;
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    core::final unmap{[map, size](){::munmap(map, size);}};
+
+    auto data = static_cast<char const*>(map);
+    cache_header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (0 != std::memcmp(header.magic, cache_magic, sizeof(cache_magic))
+        || header.version != cache_version
+        || header.header_size != sizeof(cache_header)
+        || header.source_stamp != stamp
+        || header.payload_size != size - sizeof(cache_header)) {
+        return false;
+    }
+    auto payload = data + sizeof(cache_header);
+    auto payload_size = static_cast<std::size_t>(header.payload_size);
+    if (fnv1a(payload, payload_size) != header.payload_checksum) {
+        return false;
+    }
+
+    configuration c;
+    reader r{payload, payload_size};
+    if (!decode(r, c)) {
+        return false;
+    }
+    config = std::move(c);
+    return true;
+}
+
+void store_config_cache(config_source const& source, std::uint64_t stamp, configuration const& config)
+{
+    writer w;
+    encode(w, config);
+    auto const& payload = w.buffer();
+
+    cache_header header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.header_size = sizeof(cache_header);
+    header.source_stamp = stamp;
+    header.payload_size = payload.size();
+    header.payload_checksum = fnv1a(payload.data(), payload.size());
+
+    auto cache_path = config_cache_path(source.path);
+    auto tmp_path = cache_path + ".tmp" + std::to_string(::getpid());
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error{std::string{"Cannot create configuration cache: "} + tmp_path};
+    }
+    core::final remove_tmp{[fd, &tmp_path](){::close(fd); ::unlink(tmp_path.c_str());}};
+
+    write_all(fd, reinterpret_cast<char const*>(&header), sizeof(header));
+    write_all(fd, payload.data(), payload.size());
+    if (0 != ::fsync(fd) || 0 != ::rename(tmp_path.c_str(), cache_path.c_str())) {
+        throw std::runtime_error{std::string{"Cannot install configuration cache: "} + cache_path};
+    }
+    remove_tmp.reset([fd](){::close(fd);});
+}
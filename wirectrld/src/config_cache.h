@@ -0,0 +1,45 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+
+//! Returns the path of the binary configuration cache that belongs to the configuration file.
+//! The cache is stored next to the configuration file with the suffix '.cache'.
+std::string config_cache_path(std::string const& config_path);
+
+//! Computes the stamp that identifies the current state of the configuration file and its fragments
+//! (path, device, inode, size and modification time of each file).
+//! @return     Returns false when a file cannot be stat'ed.
+bool config_source_stamp(config_source const& source, std::uint64_t& stamp);
+
+//! Loads the decoded configuration from the binary cache of the configuration file.
+//! The cache file is memory mapped and decoded in place. It is only used when its version and
+//! checksum are valid and its source stamp matches the given stamp.
+//! @return     Returns true when the configuration was loaded from the cache, false when the cache
+//!             does not exist or is stale or corrupted. In the latter case config is left untouched.
+bool load_config_cache(config_source const& source, std::uint64_t stamp, configuration& config);
+
+//! Writes the decoded configuration into the binary cache of the configuration file.
+//! The stamp must be taken before the configuration files are read, so a file changed while it
+//! is read leaves a stale cache instead of a cache that hides the change.
+//! The cache is written into a temporary file first and then renamed, so readers never see a
+//! partially written cache.
+//! @throws     std::runtime_error  Thrown when the cache file cannot be written.
+void store_config_cache(config_source const& source, std::uint64_t stamp, configuration const& config);
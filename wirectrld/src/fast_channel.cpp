@@ -0,0 +1,86 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "fast_channel.h"
+
+#include <core/exception.h>
+#include <core/final.h>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <new>
+
+fast_channel::fast_channel(std::string owner)
+    : _owner{std::move(owner)}
+{
+    _memfd = ::memfd_create("wirectrl-fast-channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (_memfd < 0) {
+        throw core::runtime_exception{"cannot create fast channel memory", errno};
+    }
+    core::final close_memfd{[this](){::close(_memfd);}};
+
+    // sealed, so the client can neither shrink the memory under the daemon nor reseal it
+    if (0 != ::ftruncate(_memfd, static_cast<off_t>(size()))
+        || 0 != ::fcntl(_memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        throw core::runtime_exception{"cannot size fast channel memory", errno};
+    }
+    void* map = ::mmap(nullptr, size(), PROT_READ | PROT_WRITE, MAP_SHARED, _memfd, 0);
+    if (map == MAP_FAILED) {
+        throw core::runtime_exception{"cannot map fast channel memory", errno};
+    }
+    core::final unmap{[map](){::munmap(map, size());}};
+
+    _eventfd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_eventfd < 0) {
+        throw core::runtime_exception{"cannot create fast channel eventfd", errno};
+    }
+
+    _header = new (map) header{magic, version, capacity, sizeof(command), {0}, {0}};
+    _commands = reinterpret_cast<command*>(static_cast<char*>(map) + sizeof(header));
+    unmap.reset();
+    close_memfd.reset();
+}
+
+fast_channel::~fast_channel()
+{
+    ::munmap(_header, size());
+    ::close(_eventfd);
+    ::close(_memfd);
+}
+
+std::string const& fast_channel::owner() const noexcept
+{
+    return _owner;
+}
+
+int fast_channel::memfd() const noexcept
+{
+    return _memfd;
+}
+
+int fast_channel::eventfd() const noexcept
+{
+    return _eventfd;
+}
+
+void fast_channel::acknowledge() noexcept
+{
+    eventfd_t value;
+    (void)::eventfd_read(_eventfd, &value);
+}
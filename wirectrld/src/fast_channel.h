@@ -0,0 +1,109 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+//! Shared memory channel for local high-rate clients.
+//! The channel is a single producer (client), single consumer (wirectrld) ring of line write
+//! commands in a sealed memfd plus an eventfd the client writes to after it published commands.
+//! Both file descriptors are handed to the client over DBus; wirectrld consumes the commands on
+//! its event loop. All data read from the shared memory is validated, the client is not trusted.
+class fast_channel
+{
+public:
+    //! Line write command; lines are addressed like with set_mask.
+    struct command {
+        std::uint32_t chip;         //!< chip index as published in the property 'chips'
+        std::uint32_t reserved;     //!< must be 0
+        std::uint64_t mask;         //!< lines to write
+        std::uint64_t values;       //!< levels of the lines in mask, bit set for active
+    };
+
+    //! Layout of the beginning of the shared memory, followed by capacity commands.
+    //! The client writes commands[head % capacity] and then increments head; wirectrld
+    //! increments tail after it consumed a command.
+    struct header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t capacity;
+        std::uint32_t command_size;
+        alignas(64) std::atomic<std::uint64_t> head;
+        alignas(64) std::atomic<std::uint64_t> tail;
+    };
+
+    static constexpr std::uint32_t magic{0x57434643};  // "WCFC"
+    static constexpr std::uint32_t version{1};
+    static constexpr std::uint32_t capacity{1024};
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    //! Creates the shared memory ring and the eventfd of the channel for the client owner.
+    //! @throws     core::runtime_exception     Thrown when a system call fails.
+    explicit fast_channel(std::string owner);
+    ~fast_channel();
+
+    fast_channel(fast_channel const&) = delete;
+    fast_channel& operator=(fast_channel const&) = delete;
+
+    //! Unique bus name of the client that opened the channel.
+    std::string const& owner() const noexcept;
+
+    int memfd() const noexcept;
+    int eventfd() const noexcept;
+
+    //! Size of the shared memory in bytes.
+    static constexpr std::size_t size() noexcept
+    {
+        return sizeof(header) + std::size_t{capacity} * sizeof(command);
+    }
+
+    //! Resets the eventfd counter; called before the commands are consumed.
+    void acknowledge() noexcept;
+
+    //! Calls fn(command const&) for every published command and releases the slots.
+    //! Each command is copied out of the shared memory before fn sees it.
+    //! @return Returns false when the client corrupted the ring indices; the channel is unusable then.
+    template<typename F>
+    bool consume(F&& fn)
+    {
+        auto head = _header->head.load(std::memory_order_acquire);
+        if (head - _tail > capacity) {
+            return false;
+        }
+        while (_tail != head) {
+            command c;
+            std::memcpy(&c, &_commands[_tail & (capacity - 1)], sizeof(c));
+            fn(static_cast<command const&>(c));
+            ++_tail;
+        }
+        _header->tail.store(_tail, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::string _owner;
+    int _memfd{-1};
+    int _eventfd{-1};
+    header* _header{nullptr};
+    command* _commands{nullptr};
+    std::uint64_t _tail{0};     //!< consumer index, the copy in the shared memory is not trusted
+};
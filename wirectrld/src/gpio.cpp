@@ -14,61 +14,214 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>
 #include "types.h"
-
-#include <core/final.h>
+#include "gpio_raw.h"
 
 #include <stdexcept>
+#include <algorithm>
 #include <cerrno>
+#include <map>
+#include <string_view>
 
 using namespace gpio;
 
-gpio_line::gpio_line(std::string name, std::string chip, unsigned line,
-                     std::string const& consumer, gpio::level init_level,
-                     active_level al)
+char const* gpio::to_string(line_state state) noexcept
+{
+    switch (state) {
+        case line_state::pending:
+            return "pending";
+        case line_state::ready:
+            return "ready";
+        case line_state::failed:
+            return "failed";
+    }
+    return "unknown";
+}
+
+// ----------------------------------------------------------------------------
+// chip
+// ----------------------------------------------------------------------------
+chip::chip(std::string name, chip_backend backend)
     : _name{std::move(name)}
-    , _level{init_level}
+    , _backend{backend}
+{}
+
+chip::~chip()
+{
+    if (_chip) {
+        gpiod_chip_close(_chip);
+    }
+}
+
+std::string const& chip::name() const
+{
+    return _name;
+}
+
+chip_backend chip::backend() const
 {
-    _chip = gpiod_chip_open_lookup(chip.c_str());
-    if (!_chip) {
-        throw gpio_exception{"chip not found", errno};
+    return _backend;
+}
+
+gpiod_chip* chip::get() const
+{
+    return _chip;
+}
+
+// ----------------------------------------------------------------------------
+// gpio_line
+// ----------------------------------------------------------------------------
+namespace {
+
+    bool is_raw_output(gpio_line const& line, gpio::chip const* chip)
+    {
+        return line.direction() == gpio::direction::output && chip->backend() == chip_backend::raw;
     }
-    core::final close_chip{[pchip = _chip](){gpiod_chip_close(pchip);}};
 
-    _line = gpiod_chip_get_line(_chip, line);
-    if (!_line) {
-        throw gpio_exception{"line cannot be reserved", 0};
+} // namespace
+
+std::vector<std::optional<gpio_exception>> gpio::request_lines(std::vector<gpio_line*> const& lines)
+{
+    // pending output lines of a raw chip with the same consumer share one raw request
+    std::map<std::string_view, std::vector<std::size_t>> groups;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        auto const* line = lines[i];
+        if (line->_state == line_state::pending && is_raw_output(*line, line->_chip)) {
+            groups[line->_consumer].push_back(i);
+        }
+    }
+    for (auto const& [consumer, group] : groups) {
+        for (std::size_t first = 0; first < group.size(); first += raw_request::max_lines) {
+            auto const count = std::min(group.size() - first, raw_request::max_lines);
+            if (count < 2) {
+                continue;
+            }
+            std::vector<raw_request::line> raw_lines;
+            raw_lines.reserve(count);
+            for (std::size_t n = first; n < first + count; ++n) {
+                auto const* line = lines[group[n]];
+                raw_lines.push_back({line->_line_offset, line->_active_level, line->_pull, line->_level});
+            }
+            try {
+                auto req = std::make_shared<raw_request>(lines[group[first]]->_chip->name(), std::string{consumer},
+                                                         std::move(raw_lines));
+                for (std::size_t n = 0; n < count; ++n) {
+                    auto line = lines[group[first + n]];
+                    line->_raw = req;
+                    line->_raw_bit = static_cast<std::uint32_t>(n);
+                    line->_state = line_state::ready;
+                }
+            }
+            catch (gpio_exception&) {
+                // the lines are requested one by one below, which names the line that failed
+            }
+        }
     }
-    close_chip.reset([pline = _line](){gpiod_line_close_chip(pline);});
+    gpio_line::share_requests(lines);
 
-    gpiod_line_request_config lrc {consumer.c_str(), GPIOD_LINE_REQUEST_DIRECTION_OUTPUT,
-        al == active_level::active_low ? GPIOD_LINE_REQUEST_FLAG_ACTIVE_LOW : 0};
-    if (0 != gpiod_line_request(_line, &lrc, init_level == level::inactive ? 0 : 1)) {
-        throw gpio_exception{"cannot reserve requested line", 0};
+    std::vector<std::optional<gpio_exception>> failures(lines.size());
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        try {
+            lines[i]->request();
+        }
+        catch (gpio_exception& e) {
+            failures[i] = e;
+        }
     }
-    close_chip.reset();
+    return failures;
 }
 
-gpio_line::gpio_line(gpio_line&& old) noexcept
-    : _name{std::move(old._name)}
-    , _chip{old._chip}
-    , _line{old._line}
-    , _level{old._level}
+std::uint64_t gpio::set_raw_levels(gpio_line* lines, std::uint64_t& mask, std::uint64_t values)
 {
-    old._name.clear();
-    old._chip = nullptr;
-    old._line = nullptr;
+    std::uint64_t changed{0};
+    auto todo = mask;
+    while (todo != 0) {
+        auto const& head = lines[__builtin_ctzll(todo)];
+        if (!head._raw || head._state != line_state::ready) {
+            todo &= todo - 1;
+            continue;
+        }
+        // all lines of the mask on the raw request of the head line
+        auto req = head._raw.get();
+        std::uint64_t written{0};
+        std::uint64_t raw_mask{0};
+        std::uint64_t raw_values{0};
+        for (auto rest = todo; rest != 0; rest &= rest - 1) {
+            auto const bit = static_cast<std::size_t>(__builtin_ctzll(rest));
+            auto const& line = lines[bit];
+            if (line._raw.get() != req || line._state != line_state::ready) {
+                continue;
+            }
+            auto const flag = std::uint64_t{1} << bit;
+            written |= flag;
+            auto const lev = (values & flag) != 0 ? level::active : level::inactive;
+            if (lev != line._level) {
+                raw_mask |= std::uint64_t{1} << line._raw_bit;
+                if (lev == level::active) {
+                    raw_values |= std::uint64_t{1} << line._raw_bit;
+                }
+                changed |= flag;
+            }
+        }
+        todo &= ~written;
+        if (raw_mask != 0) {
+            try {
+                req->set_values(raw_mask, raw_values);
+            }
+            catch (gpio_exception&) {
+                // left to set_level, which reports the error of each line
+                changed &= ~written;
+                continue;
+            }
+        }
+        for (auto rest = written & changed; rest != 0; rest &= rest - 1) {
+            auto const bit = static_cast<std::size_t>(__builtin_ctzll(rest));
+            auto& line = lines[bit];
+            line._level = line._level == level::active ? level::inactive : level::active;
+        }
+        mask &= ~written;
+    }
+    return changed;
 }
 
-gpio_line::~gpio_line()
+gpio_line::gpio_line(gpio::chip& chip, unsigned line, char const* consumer, gpio::level init_level,
+                     active_level al, gpio::direction dir, pull_resistor pull)
+    : _chip{&chip}
+    , _consumer{consumer}
+    , _line_offset{line}
+    , _active_level{al}
+    , _pull{pull}
+    , _level{init_level}
+    , _direction{dir}
+{}
+
+void gpio_line::request()
 {
-    if (_line) {
-        gpiod_line_close_chip(_line);
+    if (_state != line_state::pending) {
+        return;
+    }
+    _state = line_state::failed;
+
+    if (is_raw_output(*this, _chip)) {
+        _raw = std::make_shared<raw_request>(_chip->name(), _consumer,
+                                             std::vector<raw_request::line>{{_line_offset, _active_level,
+                                                                             _pull, _level}});
+        _raw_bit = 0;
+    }
+    else {
+        // input lines of a raw chip use libgpiod as well, each one needs its own event fd
+        backend_request();
     }
+    _state = line_state::ready;
 }
 
-std::string const& gpio_line::name() const
+gpio::chip& gpio_line::chip() const
 {
-    return _name;
+    return *_chip;
+}
+
+unsigned gpio_line::offset() const
+{
+    return _line_offset;
 }
 
 gpio::level gpio_line::level() const
@@ -76,18 +229,97 @@ gpio::level gpio_line::level() const
     return _level;
 }
 
+line_state gpio_line::state() const
+{
+    return _state;
+}
+
+gpio::direction gpio_line::direction() const
+{
+    return _direction;
+}
+
+void gpio_line::write(gpio::level lev)
+{
+    if (_raw) {
+        auto const flag = std::uint64_t{1} << _raw_bit;
+        _raw->set_values(flag, lev == gpio::level::active ? flag : 0);
+    }
+    else {
+        backend_write(lev);
+    }
+}
+
 bool gpio_line::set_level(gpio::level lev)
 {
+    if (_direction == gpio::direction::input) {
+        throw gpio_exception{"line is an input", EPERM};
+    }
+    if (_state == line_state::pending) {
+        // the first request already drives the requested level
+        auto init_level = _level;
+        _level = lev;
+        try {
+            request();
+        }
+        catch (...) {
+            _level = init_level;
+            throw;
+        }
+        return lev != init_level;
+    }
+    if (_state == line_state::failed) {
+        throw gpio_exception{"line request failed", 0};
+    }
     if (lev == _level) {
         return false;
     }
-    if (0 != gpiod_line_set_value(_line, lev == gpio::level::active ? 1 : 0)) {
-        throw gpio_exception{"cannot set value", errno};
-    }
+    write(lev);
     _level = lev;
     return true;
 }
 
+gpio::level gpio_line::read_level() const
+{
+    if (_state != line_state::ready) {
+        throw gpio_exception{"line not ready", 0};
+    }
+    if (_raw) {
+        auto const flag = std::uint64_t{1} << _raw_bit;
+        return _raw->get_values(flag) != 0 ? gpio::level::active : gpio::level::inactive;
+    }
+    return backend_read();
+}
+
+void gpio_line::reassert()
+{
+    if (_state != line_state::ready || _direction == gpio::direction::input) {
+        throw gpio_exception{"line not ready", 0};
+    }
+    write(_level);
+}
+
+void gpio_line::reconfigure(active_level al, pull_resistor pull)
+{
+    if (_state == line_state::pending) {
+        // applied when the line is requested
+        _active_level = al;
+        _pull = pull;
+        return;
+    }
+    if (_state != line_state::ready) {
+        throw gpio_exception{"line not ready", 0};
+    }
+    if (_raw) {
+        _raw->reconfigure(_raw_bit, al, pull);
+        _active_level = al;
+        _pull = pull;
+    }
+    else {
+        backend_reconfigure(al, pull);
+    }
+}
+
 // ----------------------------------------------------------------------------
 // gpio_exception
 // ----------------------------------------------------------------------------
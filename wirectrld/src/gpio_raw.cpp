@@ -0,0 +1,211 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "gpio_raw.h"
+
+#include <core/final.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+using namespace gpio;
+
+namespace {
+
+    int open_device(std::string const& path)
+    {
+        return ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    }
+
+    int open_chip(std::string const& name)
+    {
+        auto path = chip_device_path(name);
+        return path.empty() ? -1 : open_device(path);
+    }
+
+    std::uint64_t line_flags(raw_request::line const& l)
+    {
+        std::uint64_t flags{GPIO_V2_LINE_FLAG_OUTPUT};
+        if (l.al == active_level::active_low) {
+            flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+        }
+        if (l.pull == pull_resistor::up) {
+            flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+        }
+        else if (l.pull == pull_resistor::down) {
+            flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+        }
+        return flags;
+    }
+
+} // namespace
+
+std::string gpio::chip_device_path(std::string const& name)
+{
+    if (name.empty()) {
+        errno = ENOENT;
+        return {};
+    }
+    if (std::all_of(name.begin(), name.end(), [](char c){return c >= '0' && c <= '9';})) {
+        return "/dev/gpiochip" + name;
+    }
+    if (name.front() == '/') {
+        return name;
+    }
+    auto path = "/dev/" + name;
+    if (0 == ::access(path.c_str(), F_OK)) {
+        return path;
+    }
+
+    // a label, the devices are asked for theirs
+    DIR* d = ::opendir("/dev");
+    if (d == nullptr) {
+        return {};
+    }
+    core::final close_dir{[d](){::closedir(d);}};
+    while (auto entry = ::readdir(d)) {
+        std::string_view dev{entry->d_name};
+        if (dev.substr(0, 8) != "gpiochip") {
+            continue;
+        }
+        path = "/dev/" + std::string{dev};
+        auto fd = open_device(path);
+        if (fd < 0) {
+            continue;
+        }
+        gpiochip_info info{};
+        auto const match = 0 == ::ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info)
+            && name == std::string_view{info.label, strnlen(info.label, sizeof(info.label))};
+        ::close(fd);
+        if (match) {
+            return path;
+        }
+    }
+    errno = ENOENT;
+    return {};
+}
+
+raw_request::raw_request(std::string const& chip_name, std::string const& consumer, std::vector<line> lines)
+    : _lines{std::move(lines)}
+{
+    if (_lines.empty() || _lines.size() > max_lines) {
+        throw gpio_exception{"invalid number of lines for a raw request", EINVAL};
+    }
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        _request.offsets[i] = _lines[i].offset;
+        if (_lines[i].init_level == level::active) {
+            _levels |= std::uint64_t{1} << i;
+        }
+    }
+    _request.num_lines = static_cast<std::uint32_t>(_lines.size());
+    std::strncpy(_request.consumer, consumer.c_str(), sizeof(_request.consumer) - 1);
+    build_config();
+
+    auto chip_fd = open_chip(chip_name);
+    if (chip_fd < 0) {
+        throw gpio_exception{"chip not found", errno};
+    }
+    auto r = ::ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &_request);
+    auto error = errno;
+    // the line request keeps working without the chip file descriptor
+    ::close(chip_fd);
+    if (r < 0) {
+        throw gpio_exception{"cannot reserve requested line", error};
+    }
+    _fd = _request.fd;
+}
+
+raw_request::~raw_request()
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+std::size_t raw_request::size() const noexcept
+{
+    return _lines.size();
+}
+
+void raw_request::build_config()
+{
+    // lines with the flags of the first line use the default flags, every other combination of
+    // flags gets an attribute; there are at most six combinations plus the output values
+    auto& config = _request.config;
+    config = gpio_v2_line_config{};
+    config.flags = line_flags(_lines.front());
+    std::uint64_t all{0};
+    for (std::size_t i = 0; i < _lines.size(); ++i) {
+        all |= std::uint64_t{1} << i;
+        auto flags = line_flags(_lines[i]);
+        if (flags == config.flags) {
+            continue;
+        }
+        std::uint32_t a{0};
+        while (a < config.num_attrs && config.attrs[a].attr.flags != flags) {
+            ++a;
+        }
+        if (a == config.num_attrs) {
+            config.attrs[a].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+            config.attrs[a].attr.flags = flags;
+            ++config.num_attrs;
+        }
+        config.attrs[a].mask |= std::uint64_t{1} << i;
+    }
+    auto& values = config.attrs[config.num_attrs++];
+    values.attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    values.attr.values = _levels;
+    values.mask = all;
+}
+
+void raw_request::set_values(std::uint64_t mask, std::uint64_t values)
+{
+    _values.mask = mask;
+    _values.bits = values;
+    if (::ioctl(_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &_values) < 0) {
+        throw gpio_exception{"cannot set value", errno};
+    }
+    _levels = (_levels & ~mask) | (values & mask);
+}
+
+std::uint64_t raw_request::get_values(std::uint64_t mask) const
+{
+    _values.mask = mask;
+    _values.bits = 0;
+    if (::ioctl(_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &_values) < 0) {
+        throw gpio_exception{"cannot get value", errno};
+    }
+    return _values.bits & mask;
+}
+
+void raw_request::reconfigure(std::size_t index, active_level al, pull_resistor pull)
+{
+    auto const old = _lines[index];
+    _lines[index].al = al;
+    _lines[index].pull = pull;
+    build_config();
+    if (::ioctl(_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &_request.config) < 0) {
+        auto error = errno;
+        _lines[index] = old;
+        build_config();
+        throw gpio_exception{"cannot reconfigure line", error};
+    }
+}
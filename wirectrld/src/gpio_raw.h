@@ -0,0 +1,82 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include "types.h"
+
+#include <linux/gpio.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gpio {
+
+    //! Resolves a chip by number, path, name or label to the path of its character device, like
+    //! gpiod_chip_open_lookup of libgpiod v1. Shared by the raw and the libgpiod v2 backend.
+    //! @return Returns the device path, or an empty string with errno set when no chip matches.
+    std::string chip_device_path(std::string const& name);
+
+    //! Output lines of one chip requested directly from the GPIO character device with the
+    //! GPIO v2 uAPI, bypassing libgpiod.
+    //! The request structures are allocated once when the lines are requested; a batch write is a
+    //! single ioctl without allocations. Bit i of masks and values addresses the i-th line.
+    class raw_request
+    {
+    public:
+        struct line {
+            unsigned offset;
+            active_level al;
+            pull_resistor pull;
+            level init_level;
+        };
+
+        static constexpr std::size_t max_lines{GPIO_V2_LINES_MAX};
+
+        //! Requests the lines as outputs driven to their initial levels.
+        //! @throw  gpio_exception   Thrown when the chip cannot be opened or the kernel rejects the request.
+        raw_request(std::string const& chip_name, std::string const& consumer, std::vector<line> lines);
+        ~raw_request();
+
+        raw_request(raw_request const&) = delete;
+        raw_request& operator=(raw_request const&) = delete;
+
+        std::size_t size() const noexcept;
+
+        //! Drives the lines in mask to the levels in values (bit set for active) with one ioctl.
+        //! @throw  gpio_exception   Thrown when the ioctl fails.
+        void set_values(std::uint64_t mask, std::uint64_t values);
+
+        //! Reads the levels of the lines in mask back from the hardware with one ioctl.
+        //! @throw  gpio_exception   Thrown when the ioctl fails.
+        std::uint64_t get_values(std::uint64_t mask) const;
+
+        //! Changes active level and bias of one line in place; all lines keep their levels.
+        //! @throw  gpio_exception   Thrown when the ioctl fails.
+        void reconfigure(std::size_t index, active_level al, pull_resistor pull);
+
+    private:
+        //! Fills the config of the request from the lines, the outputs driven to _levels.
+        void build_config();
+
+        std::vector<line> _lines;
+        std::uint64_t _levels{0};           //!< commanded levels, bit set for active
+        gpio_v2_line_request _request{};
+        mutable gpio_v2_line_values _values{};
+        int _fd{-1};
+    };
+
+} // namespace gpio
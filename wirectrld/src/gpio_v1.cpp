@@ -0,0 +1,139 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "types.h"
+
+#include <cerrno>
+
+// GPIO backend on the libgpiod v1 API, one line request per line.
+
+using namespace gpio;
+
+// ----------------------------------------------------------------------------
+// chip
+// ----------------------------------------------------------------------------
+gpiod_chip* chip::open()
+{
+    if (!_chip) {
+        _chip = gpiod_chip_open_lookup(_name.c_str());
+        if (!_chip) {
+            throw gpio_exception{"chip not found", errno};
+        }
+    }
+    return _chip;
+}
+
+// ----------------------------------------------------------------------------
+// gpio_line
+// ----------------------------------------------------------------------------
+void gpio_line::share_requests(std::vector<gpio_line*> const& /*lines*/)
+{
+    // libgpiod v1 requests lines one by one
+}
+
+void gpio_line::backend_request()
+{
+    auto line = gpiod_chip_get_line(_chip->open(), _line_offset);
+    if (!line) {
+        throw gpio_exception{"line cannot be reserved", 0};
+    }
+
+    auto flags = _active_level == active_level::active_low ? GPIOD_LINE_REQUEST_FLAG_ACTIVE_LOW : 0;
+    if (_direction == gpio::direction::input) {
+        if (0 != gpiod_line_request_both_edges_events_flags(line, _consumer, flags)) {
+            throw gpio_exception{"cannot reserve requested line", errno};
+        }
+        auto value = gpiod_line_get_value(line);
+        if (value < 0) {
+            gpiod_line_release(line);
+            throw gpio_exception{"cannot get value", errno};
+        }
+        _level = value == 0 ? gpio::level::inactive : gpio::level::active;
+        _line = line;
+        return;
+    }
+
+    gpiod_line_request_config lrc {_consumer, GPIOD_LINE_REQUEST_DIRECTION_OUTPUT, flags};
+    if (0 != gpiod_line_request(line, &lrc, _level == level::inactive ? 0 : 1)) {
+        throw gpio_exception{"cannot reserve requested line", 0};
+    }
+    _line = line;
+}
+
+gpio_line::gpio_line(gpio_line&& old) noexcept
+    : _chip{old._chip}
+    , _consumer{old._consumer}
+    , _line{old._line}
+    , _raw{std::move(old._raw)}
+    , _line_offset{old._line_offset}
+    , _raw_bit{old._raw_bit}
+    , _active_level{old._active_level}
+    , _pull{old._pull}
+    , _level{old._level}
+    , _direction{old._direction}
+    , _state{old._state}
+{
+    old._line = nullptr;
+    old._state = line_state::failed;
+}
+
+gpio_line::~gpio_line()
+{
+    if (_line) {
+        gpiod_line_release(_line);
+    }
+}
+
+void gpio_line::backend_write(gpio::level lev)
+{
+    if (0 != gpiod_line_set_value(_line, lev == gpio::level::active ? 1 : 0)) {
+        throw gpio_exception{"cannot set value", errno};
+    }
+}
+
+gpio::level gpio_line::backend_read() const
+{
+    auto value = gpiod_line_get_value(_line);
+    if (value < 0) {
+        throw gpio_exception{"cannot get value", errno};
+    }
+    return value == 0 ? gpio::level::inactive : gpio::level::active;
+}
+
+void gpio_line::backend_reconfigure(active_level al, pull_resistor pull)
+{
+    // libgpiod v1 cannot change the flags of a requested line
+    gpiod_line_release(_line);
+    _line = nullptr;
+    _state = line_state::pending;
+    _active_level = al;
+    _pull = pull;
+    request();
+}
+
+int gpio_line::event_fd() const
+{
+    return _line ? gpiod_line_event_get_fd(_line) : -1;
+}
+
+gpio::level gpio_line::read_event()
+{
+    gpiod_line_event event{};
+    if (0 != gpiod_line_event_read(_line, &event)) {
+        throw gpio_exception{"cannot read event", errno};
+    }
+    _level = event.event_type == GPIOD_LINE_EVENT_RISING_EDGE ? gpio::level::active : gpio::level::inactive;
+    return _level;
+}
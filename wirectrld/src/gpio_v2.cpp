@@ -0,0 +1,294 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "types.h"
+#include "gpio_raw.h"
+
+#include <cerrno>
+#include <map>
+#include <string_view>
+
+// GPIO backend on the libgpiod v2 API. Output lines of a chip with the same consumer share one
+// line request, settings are changed in place with gpiod_line_request_reconfigure_lines.
+
+using namespace gpio;
+
+//! Kernel line request shared by the lines requested together.
+struct gpio::line_request
+{
+    //! Settings of a line; the request is always reconfigured with the settings of all its lines.
+    struct entry {
+        unsigned offset;
+        gpio::direction direction;
+        gpio::active_level active_level;
+        gpio::pull_resistor pull;
+        gpio::level level;
+    };
+
+    line_request() = default;
+    ~line_request()
+    {
+        if (events) {
+            gpiod_edge_event_buffer_free(events);
+        }
+        if (request) {
+            gpiod_line_request_release(request);
+        }
+    }
+
+    line_request(line_request const&) = delete;
+    line_request& operator=(line_request const&) = delete;
+
+    gpiod_line_request* request{nullptr};
+    gpiod_edge_event_buffer* events{nullptr};   //!< input lines only
+    std::vector<entry> entries{};
+};
+
+namespace {
+
+    template<typename T, void (*Free)(T*)>
+    struct deleter {
+        void operator()(T* p) const noexcept
+        {
+            Free(p);
+        }
+    };
+
+    using settings_ptr = std::unique_ptr<gpiod_line_settings, deleter<gpiod_line_settings, gpiod_line_settings_free>>;
+    using line_config_ptr = std::unique_ptr<gpiod_line_config, deleter<gpiod_line_config, gpiod_line_config_free>>;
+    using request_config_ptr = std::unique_ptr<gpiod_request_config,
+                                               deleter<gpiod_request_config, gpiod_request_config_free>>;
+
+    gpiod_line_value to_value(level lev)
+    {
+        return lev == level::active ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+    }
+
+    gpiod_line_bias to_bias(pull_resistor pull)
+    {
+        switch (pull) {
+            case pull_resistor::up:
+                return GPIOD_LINE_BIAS_PULL_UP;
+            case pull_resistor::down:
+                return GPIOD_LINE_BIAS_PULL_DOWN;
+            case pull_resistor::none:
+                break;
+        }
+        // like libgpiod v1, the bias of the hardware is left alone
+        return GPIOD_LINE_BIAS_AS_IS;
+    }
+
+    line_config_ptr make_line_config(std::vector<line_request::entry> const& entries)
+    {
+        line_config_ptr config{gpiod_line_config_new()};
+        settings_ptr settings{gpiod_line_settings_new()};
+        if (!config || !settings) {
+            throw gpio_exception{"cannot allocate line config", ENOMEM};
+        }
+        for (auto const& e : entries) {
+            gpiod_line_settings_reset(settings.get());
+            int r{0};
+            if (e.direction == direction::input) {
+                r |= gpiod_line_settings_set_direction(settings.get(), GPIOD_LINE_DIRECTION_INPUT);
+                r |= gpiod_line_settings_set_edge_detection(settings.get(), GPIOD_LINE_EDGE_BOTH);
+            }
+            else {
+                r |= gpiod_line_settings_set_direction(settings.get(), GPIOD_LINE_DIRECTION_OUTPUT);
+                r |= gpiod_line_settings_set_output_value(settings.get(), to_value(e.level));
+            }
+            gpiod_line_settings_set_active_low(settings.get(), e.active_level == active_level::active_low);
+            r |= gpiod_line_settings_set_bias(settings.get(), to_bias(e.pull));
+            r |= gpiod_line_config_add_line_settings(config.get(), &e.offset, 1, settings.get());
+            if (r != 0) {
+                throw gpio_exception{"invalid line settings", errno};
+            }
+        }
+        return config;
+    }
+
+    std::shared_ptr<line_request> open_request(gpiod_chip* chip, std::string const& consumer,
+                                               std::vector<line_request::entry> entries)
+    {
+        auto config = make_line_config(entries);
+        request_config_ptr request_config{gpiod_request_config_new()};
+        if (!request_config) {
+            throw gpio_exception{"cannot allocate request config", ENOMEM};
+        }
+        gpiod_request_config_set_consumer(request_config.get(), consumer.c_str());
+
+        auto req = std::make_shared<line_request>();
+        req->request = gpiod_chip_request_lines(chip, request_config.get(), config.get());
+        if (!req->request) {
+            throw gpio_exception{"cannot reserve requested line", errno};
+        }
+        req->entries = std::move(entries);
+        return req;
+    }
+
+    gpiod_chip* open_chip(std::string const& name)
+    {
+        auto path = chip_device_path(name);
+        return path.empty() ? nullptr : gpiod_chip_open(path.c_str());
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+// chip
+// ----------------------------------------------------------------------------
+gpiod_chip* chip::open()
+{
+    if (!_chip) {
+        _chip = open_chip(_name);
+        if (!_chip) {
+            throw gpio_exception{"chip not found", errno};
+        }
+    }
+    return _chip;
+}
+
+// ----------------------------------------------------------------------------
+// gpio_line
+// ----------------------------------------------------------------------------
+void gpio_line::share_requests(std::vector<gpio_line*> const& lines)
+{
+    // pending output lines with the same consumer share one request; input lines keep a request
+    // of their own, so every input has its own edge event file descriptor
+    std::map<std::string_view, std::vector<std::size_t>> groups;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        auto const* line = lines[i];
+        if (line->_state == line_state::pending && line->_direction == direction::output
+            && line->_chip->backend() == chip_backend::gpiod) {
+            groups[line->_consumer].push_back(i);
+        }
+    }
+    for (auto const& [consumer, group] : groups) {
+        if (group.size() < 2) {
+            continue;
+        }
+        std::vector<line_request::entry> entries;
+        entries.reserve(group.size());
+        for (auto i : group) {
+            auto const* line = lines[i];
+            entries.push_back({line->_line_offset, line->_direction, line->_active_level, line->_pull, line->_level});
+        }
+        try {
+            auto req = open_request(lines[group.front()]->_chip->open(), std::string{consumer}, std::move(entries));
+            for (std::size_t slot = 0; slot < group.size(); ++slot) {
+                auto line = lines[group[slot]];
+                line->_request = req;
+                line->_slot = static_cast<std::uint32_t>(slot);
+                line->_state = line_state::ready;
+            }
+        }
+        catch (gpio_exception&) {
+            // request_lines requests the lines one by one, which names the line that failed
+        }
+    }
+}
+
+void gpio_line::backend_request()
+{
+    auto req = open_request(_chip->open(), _consumer,
+                            {line_request::entry{_line_offset, _direction, _active_level, _pull, _level}});
+    if (_direction == gpio::direction::input) {
+        req->events = gpiod_edge_event_buffer_new(1);
+        if (!req->events) {
+            throw gpio_exception{"cannot allocate event buffer", ENOMEM};
+        }
+        auto value = gpiod_line_request_get_value(req->request, _line_offset);
+        if (value == GPIOD_LINE_VALUE_ERROR) {
+            throw gpio_exception{"cannot get value", errno};
+        }
+        _level = value == GPIOD_LINE_VALUE_INACTIVE ? gpio::level::inactive : gpio::level::active;
+        req->entries.front().level = _level;
+    }
+    _request = std::move(req);
+    _slot = 0;
+}
+
+gpio_line::gpio_line(gpio_line&& old) noexcept
+    : _chip{old._chip}
+    , _consumer{old._consumer}
+    , _request{std::move(old._request)}
+    , _raw{std::move(old._raw)}
+    , _line_offset{old._line_offset}
+    , _slot{old._slot}
+    , _raw_bit{old._raw_bit}
+    , _active_level{old._active_level}
+    , _pull{old._pull}
+    , _level{old._level}
+    , _direction{old._direction}
+    , _state{old._state}
+{
+    old._state = line_state::failed;
+}
+
+// the line request is released with its last line
+gpio_line::~gpio_line() = default;
+
+void gpio_line::backend_write(gpio::level lev)
+{
+    if (0 != gpiod_line_request_set_value(_request->request, _line_offset, to_value(lev))) {
+        throw gpio_exception{"cannot set value", errno};
+    }
+    _request->entries[_slot].level = lev;
+}
+
+gpio::level gpio_line::backend_read() const
+{
+    auto value = gpiod_line_request_get_value(_request->request, _line_offset);
+    if (value == GPIOD_LINE_VALUE_ERROR) {
+        throw gpio_exception{"cannot get value", errno};
+    }
+    return value == GPIOD_LINE_VALUE_INACTIVE ? gpio::level::inactive : gpio::level::active;
+}
+
+void gpio_line::backend_reconfigure(active_level al, pull_resistor pull)
+{
+    // one ioctl for all lines of the request, the outputs keep their levels
+    auto entries = _request->entries;
+    entries[_slot].active_level = al;
+    entries[_slot].pull = pull;
+    auto config = make_line_config(entries);
+    if (0 != gpiod_line_request_reconfigure_lines(_request->request, config.get())) {
+        throw gpio_exception{"cannot reconfigure line", errno};
+    }
+    _request->entries = std::move(entries);
+    _active_level = al;
+    _pull = pull;
+    if (_direction == gpio::direction::input) {
+        // the logical level of an input follows the active level
+        _level = backend_read();
+        _request->entries[_slot].level = _level;
+    }
+}
+
+int gpio_line::event_fd() const
+{
+    return _request ? gpiod_line_request_get_fd(_request->request) : -1;
+}
+
+gpio::level gpio_line::read_event()
+{
+    if (gpiod_line_request_read_edge_events(_request->request, _request->events, 1) < 1) {
+        throw gpio_exception{"cannot read event", errno};
+    }
+    auto event = gpiod_edge_event_buffer_get_event(_request->events, 0);
+    _level = gpiod_edge_event_get_event_type(event) == GPIOD_EDGE_EVENT_RISING_EDGE
+             ? gpio::level::active : gpio::level::inactive;
+    _request->entries[_slot].level = _level;
+    return _level;
+}
@@ -0,0 +1,221 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "line_table.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+    constexpr std::uint32_t no_line{~std::uint32_t{0}};
+
+} // namespace
+
+line_table::line_table(std::vector<gpio_configuration> const& gpios, std::vector<chip_configuration> const& chips)
+{
+    // chips in the order of their first line
+    std::unordered_map<std::string_view, std::uint32_t> chip_index;
+    std::vector<std::uint32_t> line_chip(gpios.size());
+    std::vector<std::uint32_t> counts;
+    for (std::size_t i = 0; i < gpios.size(); ++i) {
+        auto const& g = gpios[i];
+        auto [it, inserted] = chip_index.try_emplace(g.gpio_chip_name, static_cast<std::uint32_t>(_chips.size()));
+        if (inserted) {
+            auto backend = gpio::chip_backend::gpiod;
+            for (auto const& cc : chips) {
+                if (cc.name == g.gpio_chip_name) {
+                    backend = cc.backend;
+                }
+            }
+            _chips.push_back(std::make_unique<gpio::chip>(g.gpio_chip_name, backend));
+            counts.push_back(0);
+        }
+        line_chip[i] = it->second;
+        ++counts[it->second];
+    }
+
+    // counting sort by chip keeps the configuration order of the lines of a chip
+    _chip_first.assign(_chips.size() + 1, 0);
+    _chip_word.assign(_chips.size(), 0);
+    _outputs.assign(_chips.size(), 0);
+    std::uint32_t words{0};
+    for (std::size_t c = 0; c < _chips.size(); ++c) {
+        _chip_first[c + 1] = _chip_first[c] + counts[c];
+        _chip_word[c] = words;
+        words += (counts[c] + 63) / 64;
+    }
+    std::vector<std::uint32_t> order(gpios.size());
+    std::vector<std::uint32_t> next(_chip_first.begin(), _chip_first.end() - 1);
+    for (std::size_t i = 0; i < gpios.size(); ++i) {
+        order[next[line_chip[i]]++] = static_cast<std::uint32_t>(i);
+    }
+
+    _names.reserve(gpios.size());
+    _request.reserve(gpios.size());
+    _handles.reserve(gpios.size());
+    for (std::size_t line = 0; line < order.size(); ++line) {
+        auto const& g = gpios[order[line]];
+        auto const c = line_chip[order[line]];
+        auto const name = _strings.intern(g.name);
+        auto const consumer = _strings.intern(g.consumer);
+        if (_line_by_name.size() < _strings.size()) {
+            _line_by_name.resize(_strings.size(), no_line);
+        }
+        if (_line_by_name[name] == no_line) {
+            _line_by_name[name] = static_cast<std::uint32_t>(line);
+        }
+        _names.push_back(name);
+        _request.push_back(g.request);
+        _handles.emplace_back(*_chips[c], g.gpio_line_id, _strings.c_str(consumer), g.initial_level,
+                              g.active_level, g.direction, g.pull_resistor);
+        auto const bit = line - _chip_first[c];
+        if (g.direction == gpio::direction::output && bit < 64) {
+            _outputs[c] |= std::uint64_t{1} << bit;
+        }
+    }
+    _levels.assign(words, 0);
+    sync_levels();
+}
+
+std::size_t line_table::size() const noexcept
+{
+    return _handles.size();
+}
+
+std::size_t line_table::chip_count() const noexcept
+{
+    return _chips.size();
+}
+
+gpio::chip const& line_table::chip(std::size_t c) const noexcept
+{
+    return *_chips[c];
+}
+
+std::size_t line_table::first(std::size_t c) const noexcept
+{
+    return _chip_first[c];
+}
+
+std::size_t line_table::chip_of(std::size_t line) const noexcept
+{
+    // a handful of chips at most, a binary search beats a column per line
+    auto it = std::upper_bound(_chip_first.begin(), _chip_first.end(), static_cast<std::uint32_t>(line));
+    return static_cast<std::size_t>(it - _chip_first.begin()) - 1;
+}
+
+std::uint64_t line_table::output_mask(std::size_t c) const noexcept
+{
+    return _outputs[c];
+}
+
+gpio::gpio_line& line_table::operator[](std::size_t line) noexcept
+{
+    return _handles[line];
+}
+
+gpio::gpio_line const& line_table::operator[](std::size_t line) const noexcept
+{
+    return _handles[line];
+}
+
+gpio::gpio_line* line_table::chip_lines(std::size_t c) noexcept
+{
+    return _handles.data() + _chip_first[c];
+}
+
+char const* line_table::name(std::size_t line) const noexcept
+{
+    return _strings.c_str(_names[line]);
+}
+
+std::size_t line_table::find(std::string_view name) const noexcept
+{
+    auto id = _strings.find(name);
+    if (id == string_pool::npos || id >= _line_by_name.size() || _line_by_name[id] == no_line) {
+        return npos;
+    }
+    return _line_by_name[id];
+}
+
+gpio::request_mode line_table::request_mode(std::size_t line) const noexcept
+{
+    return _request[line];
+}
+
+gpio::level line_table::level(std::size_t line) const noexcept
+{
+    auto const bit = level_bit(line);
+    return (_levels[bit / 64] & (std::uint64_t{1} << (bit % 64))) != 0 ? gpio::level::active : gpio::level::inactive;
+}
+
+std::uint64_t const* line_table::levels(std::size_t c) const noexcept
+{
+    return _levels.data() + _chip_word[c];
+}
+
+void line_table::sync_level(std::size_t line) noexcept
+{
+    auto const bit = level_bit(line);
+    auto const flag = std::uint64_t{1} << (bit % 64);
+    if (_handles[line].level() == gpio::level::active) {
+        _levels[bit / 64] |= flag;
+    }
+    else {
+        _levels[bit / 64] &= ~flag;
+    }
+}
+
+void line_table::sync_levels() noexcept
+{
+    for (std::size_t line = 0; line < _handles.size(); ++line) {
+        sync_level(line);
+    }
+}
+
+std::size_t line_table::memory_usage() const noexcept
+{
+    std::size_t chips{0};
+    for (auto const& c : _chips) {
+        chips += sizeof(gpio::chip) + c->name().capacity();
+    }
+    return _strings.memory_usage() + chips + _chips.capacity() * sizeof(_chips[0])
+        + (_chip_first.capacity() + _chip_word.capacity()) * sizeof(std::uint32_t)
+        + _outputs.capacity() * sizeof(std::uint64_t) + _names.capacity() * sizeof(string_pool::id)
+        + _request.capacity() * sizeof(gpio::request_mode) + _line_by_name.capacity() * sizeof(std::uint32_t)
+        + _levels.capacity() * sizeof(std::uint64_t) + _handles.capacity() * sizeof(gpio::gpio_line);
+}
+
+void line_table::clear() noexcept
+{
+    _handles.clear();
+    _levels.clear();
+    _line_by_name.clear();
+    _request.clear();
+    _names.clear();
+    _outputs.clear();
+    _chip_word.clear();
+    _chip_first.clear();
+    _chips.clear();
+    _strings.clear();
+}
+
+std::size_t line_table::level_bit(std::size_t line) const noexcept
+{
+    auto const c = chip_of(line);
+    return std::size_t{_chip_word[c]} * 64 + (line - _chip_first[c]);
+}
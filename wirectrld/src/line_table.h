@@ -0,0 +1,106 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include "config.h"
+#include "string_pool.h"
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//! The configured lines in a struct-of-arrays layout, grouped by chip.
+//! The lines of a chip have consecutive indices in configuration order, bit i of a set_mask mask
+//! addresses line first(chip) + i. Names and consumers are interned in one string pool. The
+//! commanded levels are kept in a bitset in which every chip starts on a new word, so the levels
+//! of the first 64 lines of a chip are a single word.
+class line_table
+{
+public:
+    static constexpr std::size_t npos{~std::size_t{0}};
+
+    line_table() = default;
+
+    //! Creates the lines in state pending; no GPIO chip is accessed.
+    //! A name configured for more than one line refers to the first of them.
+    line_table(std::vector<gpio_configuration> const& gpios, std::vector<chip_configuration> const& chips);
+
+    line_table(line_table&&) = default;
+    //! A member-wise move would close the chips of the old lines before releasing the lines.
+    line_table& operator=(line_table&&) = delete;
+
+    std::size_t size() const noexcept;
+
+    std::size_t chip_count() const noexcept;
+
+    gpio::chip const& chip(std::size_t c) const noexcept;
+
+    //! Returns the first line of chip c, the lines of c are [first(c), first(c + 1)).
+    std::size_t first(std::size_t c) const noexcept;
+
+    std::size_t chip_of(std::size_t line) const noexcept;
+
+    //! Bit i is set if line first(c) + i is an output, for the first 64 lines of chip c.
+    std::uint64_t output_mask(std::size_t c) const noexcept;
+
+    gpio::gpio_line& operator[](std::size_t line) noexcept;
+    gpio::gpio_line const& operator[](std::size_t line) const noexcept;
+
+    //! Handles of the lines of chip c, see first.
+    gpio::gpio_line* chip_lines(std::size_t c) noexcept;
+
+    char const* name(std::size_t line) const noexcept;
+
+    //! Returns the index of the line named name or npos.
+    std::size_t find(std::string_view name) const noexcept;
+
+    gpio::request_mode request_mode(std::size_t line) const noexcept;
+
+    //! Returns the commanded level as of the last sync of the line.
+    gpio::level level(std::size_t line) const noexcept;
+
+    //! Level bits of chip c, bit i of the bitset is set if line first(c) + i is active.
+    std::uint64_t const* levels(std::size_t c) const noexcept;
+
+    //! Copies the level of the line handle into the bitset.
+    void sync_level(std::size_t line) noexcept;
+
+    void sync_levels() noexcept;
+
+    //! Bytes allocated by the table, the chips and the string pool.
+    std::size_t memory_usage() const noexcept;
+
+    //! Releases the lines before their chips.
+    void clear() noexcept;
+
+private:
+    std::size_t level_bit(std::size_t line) const noexcept;
+
+    string_pool _strings{};
+    std::vector<std::unique_ptr<gpio::chip>> _chips{};
+    std::vector<std::uint32_t> _chip_first{};       //!< first line per chip, followed by the line count
+    std::vector<std::uint32_t> _chip_word{};        //!< first word of the chip in _levels
+    std::vector<std::uint64_t> _outputs{};          //!< output_mask per chip
+    std::vector<string_pool::id> _names{};
+    std::vector<gpio::request_mode> _request{};
+    std::vector<std::uint32_t> _line_by_name{};     //!< line per string id, ~0 for ids that name no line
+    std::vector<std::uint64_t> _levels{};
+    // the handles refer to the chips and consumers above and are destroyed first
+    std::vector<gpio::gpio_line> _handles{};
+};
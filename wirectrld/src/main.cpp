@@ -15,6 +15,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "opts.h"
 #include "config.h"
+#include "config_cache.h"
 #include "application.h"
 
 #include <core/ini.h>
@@ -22,6 +23,7 @@
 
 #include <systemd/sd-journal.h>
 
+#include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 
@@ -31,11 +33,26 @@ int main(int argc, char* argv[])
     configuration config;
     try {
         opts options = parse_program_options(argc, argv);
-        core::ini::file ini_file;
-        std::string path;
-        std::tie(ini_file, path) = get_config(options);
-        sd_journal_print(LOG_INFO, "Reading configuration from %s", path.c_str());
-        config = configuration::decode_from_section(ini_file);
+        auto source = find_config(options);
+        // the stamp is taken before reading, a file changed meanwhile invalidates the stored cache
+        std::uint64_t stamp{0};
+        bool stamped = options.use_config_cache && config_source_stamp(source, stamp);
+        if (stamped && load_config_cache(source, stamp, config)) {
+            sd_journal_print(LOG_INFO, "Reading configuration from %s (cached)", source.origin.c_str());
+        }
+        else {
+            sd_journal_print(LOG_INFO, "Reading configuration from %s and %zu fragments",
+                             source.origin.c_str(), source.fragments.size());
+            config = configuration::load(source);
+            if (stamped) {
+                try {
+                    store_config_cache(source, stamp, config);
+                }
+                catch (std::runtime_error& e) {
+                    sd_journal_print(LOG_WARNING, "Configuration cache not updated. (%s)", e.what());
+                }
+            }
+        }
 
         sd_journal_print(LOG_INFO, "DBus configuration '%s', '%s', '%s'",
                          config.dbus.connection_name.c_str(), config.dbus.object_name.c_str(),
@@ -48,8 +65,8 @@ int main(int argc, char* argv[])
         }
     }
     catch(core::ini::parse_exception& e) {
-        sd_journal_print(LOG_ERR, "Failed to parse ini configuration file. (%s) [line %i, expression: %s]"
-                         , e.what(), e.line_number(), e.expression().c_str());
+        sd_journal_print(LOG_ERR, "Failed to parse ini configuration file. (%s) [%s line %i, expression: %s]"
+                         , e.what(), e.source().c_str(), e.line_number(), e.expression().c_str());
         return EXIT_FAILURE;
     }
     catch (std::runtime_error& e) {
@@ -59,6 +76,8 @@ int main(int argc, char* argv[])
 
     try {
         application app{config};
+        // the application resolved what it needs into its line table
+        config = configuration{};
         app.run();
     }
     catch (core::runtime_exception& e) {
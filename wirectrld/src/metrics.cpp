@@ -0,0 +1,332 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "metrics.h"
+
+#include <core/journal.h>
+#include <core/unix_socket.h>
+
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+    void append_value(std::string& out, std::uint64_t value, metrics_page::unit u)
+    {
+        char buf[24];
+        if (u == metrics_page::unit::count) {
+            auto end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+            out.append(buf, end);
+            return;
+        }
+        // exact decimal seconds, no floating point formatting
+        auto end = std::to_chars(buf, buf + sizeof(buf), value / 1000000).ptr;
+        out.append(buf, end);
+        auto fraction = value % 1000000;
+        if (fraction != 0) {
+            char digits[7] = "000000";
+            for (int i = 5; i >= 0 && fraction != 0; --i, fraction /= 10) {
+                digits[i] = static_cast<char>('0' + fraction % 10);
+            }
+            auto len = std::strlen(digits);
+            while (len > 0 && digits[len - 1] == '0') {
+                --len;
+            }
+            out.push_back('.');
+            out.append(digits, len);
+        }
+    }
+
+    //! An HTTP request is complete with its head, any other request with its first line.
+    bool request_complete(std::string const& request)
+    {
+        auto const line_end = request.find('\n');
+        if (line_end == std::string::npos) {
+            return false;
+        }
+        if (request.rfind(" HTTP/", line_end) == std::string::npos) {
+            return true;
+        }
+        return request.find("\r\n\r\n") != std::string::npos || request.find("\n\n") != std::string::npos;
+    }
+
+    std::string seconds(std::uint64_t usec)
+    {
+        std::string s;
+        append_value(s, usec, metrics_page::unit::usec);
+        return s;
+    }
+
+} // namespace
+
+std::size_t metrics_page::add_family(std::string const& name, char const* type, char const* help)
+{
+    _families.push_back(family{"# TYPE " + name + " " + type + "\n# HELP " + name + " " + help + "\n"});
+    return _families.size() - 1;
+}
+
+std::size_t metrics_page::add_sample(std::size_t family, std::string const& name, unit u)
+{
+    _samples.push_back(sample{family, name + " ", u});
+    _families[family].samples.push_back(_samples.size() - 1);
+    _families[family].dirty = true;
+    return _samples.size() - 1;
+}
+
+std::size_t metrics_page::add_histogram(std::size_t family, std::string const& name, std::string const& labels)
+{
+    auto const prefix = labels.empty() ? std::string{} : labels + ",";
+    auto first = _samples.size();
+    for (std::size_t i = 0; i < core::latency_histogram::bucket_count; ++i) {
+        // bucket i counts whole microseconds below 2^i, i.e. up to 2^i - 1
+        auto le = i + 1 < core::latency_histogram::bucket_count
+                      ? seconds(core::latency_histogram::upper_bound(i) - 1) : std::string{"+Inf"};
+        add_sample(family, name + "_bucket{" + prefix + "le=\"" + le + "\"}");
+    }
+    add_sample(family, name + "_count" + (labels.empty() ? std::string{} : "{" + labels + "}"));
+    add_sample(family, name + "_sum" + (labels.empty() ? std::string{} : "{" + labels + "}"), unit::usec);
+    return first;
+}
+
+void metrics_page::set(std::size_t sample, std::uint64_t value) noexcept
+{
+    auto& s = _samples[sample];
+    if (s.value != value) {
+        s.value = value;
+        _families[s.family].dirty = true;
+    }
+}
+
+void metrics_page::set_histogram(std::size_t first_sample, core::latency_histogram const& h) noexcept
+{
+    // OpenMetrics buckets are cumulative
+    std::uint64_t cumulative{0};
+    for (std::size_t i = 0; i < core::latency_histogram::bucket_count; ++i) {
+        cumulative += h.buckets()[i];
+        set(first_sample + i, cumulative);
+    }
+    set(first_sample + core::latency_histogram::bucket_count, h.count());
+    set(first_sample + core::latency_histogram::bucket_count + 1, h.sum());
+}
+
+std::string const& metrics_page::render()
+{
+    _page.clear();
+    for (auto& f : _families) {
+        if (f.dirty) {
+            f.text = f.header;
+            for (auto i : f.samples) {
+                auto const& s = _samples[i];
+                f.text.append(s.prefix);
+                append_value(f.text, s.value, s.u);
+                f.text.push_back('\n');
+            }
+            f.dirty = false;
+        }
+        _page.append(f.text);
+    }
+    _page.append("# EOF\n");
+    return _page;
+}
+
+std::string metrics_page::escape(std::string const& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (auto c : value) {
+        switch (c) {
+            case '\\':
+                escaped.append("\\\\");
+                break;
+            case '"':
+                escaped.append("\\\"");
+                break;
+            case '\n':
+                escaped.append("\\n");
+                break;
+            default:
+                escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+struct metrics_server::connection
+{
+    metrics_server* server;
+    int fd;
+    sd_event_source* source{nullptr};
+    sd_event_source* timer{nullptr};
+    std::string request{};
+    std::string response{};     //!< empty until the request is complete
+    std::size_t sent{0};
+
+    ~connection()
+    {
+        sd_event_source_unref(timer);
+        sd_event_source_unref(source);
+        ::close(fd);
+    }
+};
+
+metrics_server::metrics_server(core::event_scheduler& scheduler, std::string path, render_fn render,
+                               std::uint64_t connection_timeout)
+    : _scheduler{scheduler}
+    , _path{std::move(path)}
+    , _render{std::move(render)}
+    , _connection_timeout{connection_timeout}
+{
+    // the monitoring agent gets access by the group of the socket
+    _listen_fd = core::listen_unix_socket(_scheduler, core::priority_class::housekeeping, _path, "metrics",
+                                          &_listen_source, &metrics_server::gdc_accept_handler, this);
+}
+
+metrics_server::~metrics_server()
+{
+    _connections.clear();
+    sd_event_source_unref(_listen_source);
+    ::close(_listen_fd);
+    unlink(_path.c_str());
+}
+
+std::uint64_t metrics_server::scrapes() const noexcept
+{
+    return _scrapes;
+}
+
+std::uint64_t metrics_server::timeouts() const noexcept
+{
+    return _timeouts;
+}
+
+int metrics_server::gdc_accept_handler(sd_event_source */*s*/, int fd, uint32_t /*revents*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto server = reinterpret_cast<metrics_server*>(userdata);
+    for (;;) {
+        auto client_fd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                core::log(LOG_WARNING, {nullptr, nullptr, errno}, "Unable to accept metrics connection (%s)",
+                          strerror(errno));
+            }
+            return 0;
+        }
+        if (server->_connections.size() >= max_connections) {
+            // scrapes are rare, more clients at once are not served
+            ::close(client_fd);
+            continue;
+        }
+        std::unique_ptr<connection> c{new connection{server, client_fd}};
+        auto r = server->_scheduler.add_io(core::priority_class::housekeeping, &c->source, client_fd, EPOLLIN,
+                                           &metrics_server::gdc_connection_handler, c.get());
+        if (r >= 0) {
+            r = sd_event_source_set_description(c->source, "metrics-connection");
+        }
+        if (r >= 0) {
+            // the deadline is not extended by activity, a client trickling its request is closed as well
+            r = server->_scheduler.add_time(core::priority_class::housekeeping, &c->timer, CLOCK_MONOTONIC,
+                                            core::monotonic_usec() + server->_connection_timeout, 100000,
+                                            &metrics_server::gdc_timeout_handler, c.get());
+        }
+        if (r < 0) {
+            core::log(LOG_WARNING, {nullptr, nullptr, -r}, "Unable to watch metrics connection (%s)", strerror(-r));
+            continue;
+        }
+        server->_connections.push_back(std::move(c));
+    }
+}
+
+int metrics_server::gdc_connection_handler(sd_event_source */*s*/, int /*fd*/, uint32_t revents, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto c = reinterpret_cast<connection*>(userdata);
+    c->server->serve(*c, revents);
+    return 0;
+}
+
+int metrics_server::gdc_timeout_handler(sd_event_source */*s*/, uint64_t /*usec*/, void *userdata)
+{
+    assert(userdata != nullptr);
+    auto c = reinterpret_cast<connection*>(userdata);
+    ++c->server->_timeouts;
+    c->server->close(*c);
+    return 0;
+}
+
+void metrics_server::serve(connection& c, std::uint32_t revents)
+{
+    if (c.response.empty()) {
+        char buf[512];
+        auto n = read(c.fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                close(c);
+            }
+            return;
+        }
+        c.request.append(buf, static_cast<std::size_t>(n));
+        // any request is answered with the page, also when the client stopped sending early
+        if (n > 0 && !request_complete(c.request)) {
+            if (c.request.size() > max_request_size) {
+                close(c);
+            }
+            return;
+        }
+        auto const& page = _render();
+        ++_scrapes;
+        c.response = "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                     "Content-Length: " + std::to_string(page.size()) + "\r\n\r\n";
+        c.response.append(page);
+        sd_event_source_set_io_events(c.source, EPOLLOUT);
+        revents = EPOLLOUT;
+    }
+    if ((revents & (EPOLLOUT | EPOLLHUP | EPOLLERR)) == 0) {
+        return;
+    }
+    while (c.sent < c.response.size()) {
+        auto n = send(c.fd, c.response.data() + c.sent, c.response.size() - c.sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                close(c);
+            }
+            return;
+        }
+        c.sent += static_cast<std::size_t>(n);
+    }
+    close(c);
+}
+
+void metrics_server::close(connection& c)
+{
+    auto it = std::find_if(_connections.begin(), _connections.end(), [&c](auto const& p) { return p.get() == &c; });
+    if (it != _connections.end()) {
+        _connections.erase(it);
+    }
+}
@@ -0,0 +1,167 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <core/loop_monitor.h>
+#include <core/scheduler.h>
+
+#include <systemd/sd-event.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//! OpenMetrics text page with preformatted sample names.
+//! Every metric family keeps its rendered text; set() marks a family dirty only when a value
+//! changed and render() formats the values of dirty families only, the others are copied.
+class metrics_page
+{
+public:
+    //! Unit of a sample value; microseconds are rendered as seconds.
+    enum class unit { count, usec };
+
+    //! Adds a metric family.
+    //! @param name     family name, counters without the suffix _total
+    //! @param type     OpenMetrics type: counter, gauge or histogram
+    //! @return Returns the family index for add_sample.
+    std::size_t add_family(std::string const& name, char const* type, char const* help);
+
+    //! Adds a sample to the family.
+    //! @param name     sample name including labels, e.g. wirectrl_requests_total{method="set_line"}
+    //! @return Returns the sample index for set.
+    std::size_t add_sample(std::size_t family, std::string const& name, unit u = unit::count);
+
+    //! Adds the bucket, count and sum samples of a histogram filled from a core::latency_histogram.
+    //! @param labels   labels of the samples without braces, may be empty
+    //! @return Returns the first sample index for set_histogram.
+    std::size_t add_histogram(std::size_t family, std::string const& name, std::string const& labels);
+
+    void set(std::size_t sample, std::uint64_t value) noexcept;
+    void set_histogram(std::size_t first_sample, core::latency_histogram const& h) noexcept;
+
+    //! Returns the page terminated by # EOF.
+    std::string const& render();
+
+    //! Escapes a label value.
+    static std::string escape(std::string const& value);
+
+    //! Number of samples add_histogram adds: the buckets, _count and _sum.
+    static constexpr std::size_t histogram_samples{core::latency_histogram::bucket_count + 2};
+
+    //! @return Returns the index the next added sample gets.
+    std::size_t sample_count() const noexcept { return _samples.size(); }
+
+private:
+    struct family {
+        std::string header;
+        std::vector<std::size_t> samples{};
+        std::string text{};
+        bool dirty{true};
+    };
+    struct sample {
+        std::size_t family;
+        std::string prefix;     //!< name and labels followed by a space
+        unit u;
+        std::uint64_t value{0};
+    };
+
+    std::vector<family> _families{};
+    std::vector<sample> _samples{};
+    std::string _page{};
+};
+
+//! Counters of the DBus methods; one entry per method of the wirectrl interface.
+struct request_metrics {
+    std::uint64_t count{0};
+    core::latency_histogram duration{};
+};
+
+//! Measures one DBus method call.
+class request_scope
+{
+public:
+    explicit request_scope(request_metrics& m) noexcept
+        : _metrics{m}
+        , _start{core::monotonic_usec()}
+    {}
+
+    ~request_scope()
+    {
+        ++_metrics.count;
+        _metrics.duration.record(core::monotonic_usec() - _start);
+    }
+
+    request_scope(request_scope const&) = delete;
+    request_scope& operator=(request_scope const&) = delete;
+
+private:
+    request_metrics& _metrics;
+    std::uint64_t _start;
+};
+
+//! Serves the metrics page on a UNIX stream socket.
+//! A client sends a request (an HTTP request head or any line) and gets an HTTP/1.0 response
+//! with the page, e.g. curl --unix-socket /run/wirectrl/metrics.socket http://localhost/metrics.
+//! Connections are served on the event loop in the housekeeping class without blocking. A
+//! connection not served within the connection timeout is closed, so idle clients cannot hold
+//! the connection slots.
+class metrics_server
+{
+public:
+    using render_fn = std::function<std::string const&()>;
+
+    //! Binds and listens on the socket path, a stale socket file is replaced.
+    //! @param connection_timeout   usec a connection may take from accept until the page is sent
+    //! @throws core::runtime_exception     Thrown when the socket cannot be set up.
+    metrics_server(core::event_scheduler& scheduler, std::string path, render_fn render,
+                   std::uint64_t connection_timeout = 5000000);
+    ~metrics_server();
+
+    metrics_server(metrics_server const&) = delete;
+    metrics_server& operator=(metrics_server const&) = delete;
+
+    //! Number of pages served.
+    std::uint64_t scrapes() const noexcept;
+
+    //! Number of connections closed by the connection timeout.
+    std::uint64_t timeouts() const noexcept;
+
+private:
+    struct connection;
+
+    static int gdc_accept_handler(sd_event_source* s, int fd, std::uint32_t revents, void* userdata);
+    static int gdc_connection_handler(sd_event_source* s, int fd, std::uint32_t revents, void* userdata);
+    static int gdc_timeout_handler(sd_event_source* s, std::uint64_t usec, void* userdata);
+    void serve(connection& c, std::uint32_t revents);
+    void close(connection& c);
+
+    static constexpr std::size_t max_connections{8};
+    static constexpr std::size_t max_request_size{4096};
+
+    core::event_scheduler& _scheduler;
+    std::string _path;
+    render_fn _render;
+    std::uint64_t _connection_timeout;
+    int _listen_fd{-1};
+    sd_event_source* _listen_source{nullptr};
+    std::vector<std::unique_ptr<connection>> _connections{};
+    std::uint64_t _scrapes{0};
+    std::uint64_t _timeouts{0};
+};
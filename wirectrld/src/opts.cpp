@@ -22,7 +22,7 @@
 
 opts parse_program_options(int argc, char * const argv[])
 {
-    static const char* opt_string = "c:";
+    static const char* opt_string = "c:n";
 
     opts options{};
     int opt;
@@ -32,6 +32,9 @@ opts parse_program_options(int argc, char * const argv[])
             case 'c':
                 options.config_file = std::string{optarg};
                 break;
+            case 'n':
+                options.use_config_cache = false;
+                break;
             case '?':
                 std::string error{"Unknown option: "};
                 error += static_cast<char>(opt);
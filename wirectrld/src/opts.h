@@ -19,6 +19,7 @@
 
 struct opts {
     std::string config_file{};
+    bool use_config_cache{true};    //!< disabled with -n
 };
 
 opts parse_program_options(int argc, char * const argv[]);
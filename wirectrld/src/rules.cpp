@@ -0,0 +1,61 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "rules.h"
+
+#include <stdexcept>
+
+rule_table::rule_table(std::vector<rule> const& rules, std::size_t line_count)
+    : _offsets(line_count + 1, 0)
+    , _actions(rules.size())
+{
+    // counting sort by input line keeps the order of the rules per line
+    for (auto const& r : rules) {
+        if (r.input >= line_count || r.act.output >= line_count) {
+            throw std::out_of_range{"rule refers to unknown line"};
+        }
+        ++_offsets[r.input + 1];
+    }
+    for (std::size_t i = 1; i < _offsets.size(); ++i) {
+        _offsets[i] += _offsets[i - 1];
+    }
+    std::vector<std::uint32_t> next(_offsets.begin(), _offsets.end() - 1);
+    for (auto const& r : rules) {
+        _actions[next[r.input]++] = r.act;
+    }
+}
+
+std::pair<std::size_t, std::size_t> rule_table::actions(std::size_t input) const noexcept
+{
+    if (input + 1 >= _offsets.size()) {
+        return {0, 0};
+    }
+    return {_offsets[input], _offsets[input + 1]};
+}
+
+rule_table::action const& rule_table::operator[](std::size_t index) const noexcept
+{
+    return _actions[index];
+}
+
+std::size_t rule_table::size() const noexcept
+{
+    return _actions.size();
+}
+
+bool rule_table::empty() const noexcept
+{
+    return _actions.empty();
+}
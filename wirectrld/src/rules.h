@@ -0,0 +1,69 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//! Rules compiled into a dispatch table indexed by the input line.
+//! The actions of all rules are stored in one array ordered by input line, so the actions of an
+//! input line are found with a single offset lookup in the edge event handler.
+class rule_table
+{
+public:
+    struct action {
+        std::size_t output;             //!< index of the output line
+        gpio::edge edge;                //!< edges of the input line that trigger the action
+        gpio::level level;              //!< level the output line is set to
+        std::uint32_t duration_ms;      //!< the output returns to the opposite level after this time, 0 for never
+    };
+
+    struct rule {
+        std::size_t input;              //!< index of the input line
+        action act;
+    };
+
+    rule_table() = default;
+
+    //! Compiles the rules for line indices in [0, line_count); the order of the rules of an
+    //! input line is kept.
+    //! @throws     std::out_of_range   Thrown when a rule refers to a line index >= line_count.
+    rule_table(std::vector<rule> const& rules, std::size_t line_count);
+
+    //! Returns the range [first, last) of the indices of the actions of the input line.
+    std::pair<std::size_t, std::size_t> actions(std::size_t input) const noexcept;
+
+    action const& operator[](std::size_t index) const noexcept;
+
+    std::size_t size() const noexcept;
+
+    bool empty() const noexcept;
+
+    //! Returns true if the action edge matches the edge that led to the new level.
+    static constexpr bool triggers(gpio::edge action_edge, gpio::level new_level) noexcept
+    {
+        return action_edge == gpio::edge::both
+            || (action_edge == gpio::edge::rising) == (new_level == gpio::level::active);
+    }
+
+private:
+    std::vector<std::uint32_t> _offsets{};  //!< actions of line i are [_offsets[i], _offsets[i+1])
+    std::vector<action> _actions{};
+};
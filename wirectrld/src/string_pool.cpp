@@ -0,0 +1,123 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "string_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+string_pool::id string_pool::intern(std::string_view s)
+{
+    if (_index.empty() || (_strings.size() + 1) * 2 > _index.size()) {
+        grow_index();
+    }
+    auto const mask = _index.size() - 1;
+    auto i = slot(s);
+    for (; _index[i] != npos; i = (i + 1) & mask) {
+        if (_strings[_index[i]] == s) {
+            return _index[i];
+        }
+    }
+
+    char* dest;
+    if (s.size() + 1 > block_size) {
+        // a long string gets a block of its own, the open block stays open for short ones
+        _blocks.push_back(std::make_unique<char[]>(s.size() + 1));
+        _block_bytes += s.size() + 1;
+        dest = _blocks.back().get();
+    }
+    else {
+        if (_open_block >= _blocks.size() || _open_used + s.size() + 1 > block_size) {
+            _blocks.push_back(std::make_unique<char[]>(block_size));
+            _block_bytes += block_size;
+            _open_block = _blocks.size() - 1;
+            _open_used = 0;
+        }
+        dest = _blocks[_open_block].get() + _open_used;
+        _open_used += s.size() + 1;
+    }
+    std::memcpy(dest, s.data(), s.size());
+    dest[s.size()] = '\0';
+
+    auto const new_id = static_cast<id>(_strings.size());
+    _strings.emplace_back(dest, s.size());
+    _index[i] = new_id;
+    return new_id;
+}
+
+string_pool::id string_pool::find(std::string_view s) const noexcept
+{
+    if (_index.empty()) {
+        return npos;
+    }
+    auto const mask = _index.size() - 1;
+    for (auto i = slot(s); _index[i] != npos; i = (i + 1) & mask) {
+        if (_strings[_index[i]] == s) {
+            return _index[i];
+        }
+    }
+    return npos;
+}
+
+char const* string_pool::c_str(id i) const noexcept
+{
+    return _strings[i].data();
+}
+
+std::string_view string_pool::view(id i) const noexcept
+{
+    return _strings[i];
+}
+
+std::size_t string_pool::size() const noexcept
+{
+    return _strings.size();
+}
+
+std::size_t string_pool::memory_usage() const noexcept
+{
+    return _block_bytes + _blocks.capacity() * sizeof(_blocks[0]) + _strings.capacity() * sizeof(_strings[0])
+        + _index.capacity() * sizeof(_index[0]);
+}
+
+void string_pool::clear() noexcept
+{
+    _blocks.clear();
+    _open_block = ~std::size_t{0};
+    _open_used = 0;
+    _block_bytes = 0;
+    _strings.clear();
+    _index.clear();
+}
+
+std::size_t string_pool::slot(std::string_view s) const noexcept
+{
+    return std::hash<std::string_view>{}(s) & (_index.size() - 1);
+}
+
+void string_pool::grow_index()
+{
+    // at most half of the slots are used, so probe sequences stay short
+    _index.assign(std::max<std::size_t>(16, _index.size() * 2), npos);
+    auto const mask = _index.size() - 1;
+    for (id s = 0; s < _strings.size(); ++s) {
+        auto i = slot(_strings[s]);
+        while (_index[i] != npos) {
+            i = (i + 1) & mask;
+        }
+        _index[i] = s;
+    }
+}
@@ -0,0 +1,63 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//! Interned strings: every distinct string is stored once and identified by a dense id.
+//! The characters live in blocks that are never moved or freed before clear(), so c_str()
+//! and view() stay valid while strings are added; every string is NUL-terminated.
+class string_pool
+{
+public:
+    using id = std::uint32_t;
+    static constexpr id npos{~id{0}};
+
+    //! Returns the id of s, the string is copied into the pool on first use.
+    id intern(std::string_view s);
+
+    //! Returns the id of s or npos if s was never interned.
+    id find(std::string_view s) const noexcept;
+
+    char const* c_str(id i) const noexcept;
+
+    std::string_view view(id i) const noexcept;
+
+    //! Number of distinct strings.
+    std::size_t size() const noexcept;
+
+    //! Bytes allocated for characters, ids and the hash index.
+    std::size_t memory_usage() const noexcept;
+
+    void clear() noexcept;
+
+private:
+    std::size_t slot(std::string_view s) const noexcept;
+    void grow_index();
+
+    static constexpr std::size_t block_size{4096};
+
+    std::vector<std::unique_ptr<char[]>> _blocks{};
+    std::size_t _open_block{~std::size_t{0}};  //!< block short strings are added to
+    std::size_t _open_used{0};
+    std::size_t _block_bytes{0};
+    std::vector<std::string_view> _strings{};
+    std::vector<id> _index{};               //!< open addressing, npos marks an empty slot
+};
@@ -0,0 +1,66 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include "subscriptions.h"
+
+#include <algorithm>
+
+std::uint32_t subscription_table::add(std::string const& owner, std::vector<bool> lines)
+{
+    if (_subscriptions.size() >= max_total || count(owner) >= max_per_owner) {
+        return 0;
+    }
+    auto id = _next_id++;
+    if (_next_id == 0) {
+        _next_id = 1;
+    }
+    _subscriptions.push_back({id, owner, std::move(lines)});
+    return id;
+}
+
+bool subscription_table::remove(std::uint32_t id, std::string const& owner)
+{
+    auto it = std::find_if(_subscriptions.begin(), _subscriptions.end(), [id, &owner](subscription const& sub) {
+        return sub.id == id && sub.owner == owner;
+    });
+    if (it == _subscriptions.end()) {
+        return false;
+    }
+    _subscriptions.erase(it);
+    return true;
+}
+
+void subscription_table::forget(std::string const& owner)
+{
+    _subscriptions.erase(std::remove_if(_subscriptions.begin(), _subscriptions.end(), [&owner](subscription const& sub) {
+        return sub.owner == owner;
+    }), _subscriptions.end());
+}
+
+void subscription_table::clear() noexcept
+{
+    _subscriptions.clear();
+}
+
+std::size_t subscription_table::size() const noexcept
+{
+    return _subscriptions.size();
+}
+
+std::size_t subscription_table::count(std::string const& owner) const
+{
+    return static_cast<std::size_t>(std::count_if(_subscriptions.begin(), _subscriptions.end(),
+                                                  [&owner](subscription const& sub) { return sub.owner == owner; }));
+}
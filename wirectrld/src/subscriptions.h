@@ -0,0 +1,76 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! Lines DBus clients are interested in; change signals are sent to the owners only.
+//! Subscriptions are limited per owner and in total, every flush looks at all of them.
+class subscription_table
+{
+public:
+    static constexpr std::size_t max_per_owner{16};
+    static constexpr std::size_t max_total{1024};
+
+    //! Adds a subscription of the owner.
+    //! @param lines    subscribed lines, indexed like the line table
+    //! @return Returns the id of the subscription, 0 when the owner or the table is at its limit.
+    std::uint32_t add(std::string const& owner, std::vector<bool> lines);
+
+    //! Removes the subscription if it belongs to the owner.
+    bool remove(std::uint32_t id, std::string const& owner);
+
+    //! Removes the subscriptions of a bus name that disappeared.
+    void forget(std::string const& owner);
+
+    void clear() noexcept;
+
+    std::size_t size() const noexcept;
+
+    //! Subscriptions of the owner.
+    std::size_t count(std::string const& owner) const;
+
+    //! Calls fn(owner, lines) for every subscription with the changed lines it subscribed to.
+    template<typename Fn>
+    void for_each_changed(std::vector<std::size_t> const& changed, Fn&& fn)
+    {
+        for (auto const& sub : _subscriptions) {
+            _lines.clear();
+            for (auto line : changed) {
+                if (line < sub.lines.size() && sub.lines[line]) {
+                    _lines.push_back(line);
+                }
+            }
+            if (!_lines.empty()) {
+                fn(sub.owner, static_cast<std::vector<std::size_t> const&>(_lines));
+            }
+        }
+    }
+
+private:
+    struct subscription {
+        std::uint32_t id;
+        std::string owner;          //!< unique bus name of the subscriber
+        std::vector<bool> lines;
+    };
+
+    std::vector<subscription> _subscriptions{};
+    std::uint32_t _next_id{1};
+    std::vector<std::size_t> _lines{};  //!< scratch buffer of for_each_changed
+};
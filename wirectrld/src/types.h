@@ -17,50 +17,70 @@
 
 #include <gpiod.h>
 
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace gpio {
-    enum class level {
+    // the configuration enumerations end with a last alias, the bound of the values read from the cache
+    enum class level : std::uint8_t {
         active,
         inactive,
+        last = inactive,
     };
 
-    enum class active_level {
+    enum class active_level : std::uint8_t {
         undefined,
         active_low,
         active_high,
+        last = active_high,
     };
 
-    enum class pull_resistor {
+    enum class pull_resistor : std::uint8_t {
         none,
         up,
         down,
+        last = down,
     };
 
-    class gpio_line
-    {
-    public:
-        gpio_line(std::string name, std::string chip, unsigned line,
-                  std::string const& consumer, gpio::level init_level, active_level al);
-        ~gpio_line();
-
-        gpio_line(gpio_line&&) noexcept;
+    enum class direction : std::uint8_t {
+        output,
+        input,          //!< requested for edge events on both edges
+        last = input,
+    };
 
-        std::string const& name() const;
+    enum class edge : std::uint8_t {
+        rising,         //!< inactive to active
+        falling,        //!< active to inactive
+        both,
+        last = both,
+    };
 
-        gpio::level level() const;
+    //! When a configured line is requested from the GPIO chip.
+    enum class request_mode : std::uint8_t {
+        eager,          //!< during startup, before the event loop runs
+        lazy,           //!< on first use or by the background warm-up, whichever comes first
+        on_demand,      //!< on first use only
+        last = on_demand,
+    };
 
-        //! @throw  gpio_exception   Thrown when GPIOD returns an error
-        //! @return Returns true if level has changed, false if level stays the same.
-        bool set_level(gpio::level lev);
+    //! How the lines of a chip are driven.
+    enum class chip_backend : std::uint8_t {
+        gpiod,          //!< through libgpiod
+        raw,            //!< output lines through the GPIO v2 character device uAPI, see raw_request
+        last = raw,
+    };
 
-    private:
-        std::string _name;
-        gpiod_chip *_chip;
-        gpiod_line *_line;
-        gpio::level _level;
+    enum class line_state : std::uint8_t {
+        pending,        //!< not yet requested
+        ready,          //!< requested and driven by wirectrld
+        failed,         //!< the request failed, the line is not usable
     };
 
+    char const* to_string(line_state state) noexcept;
+
     class gpio_exception : public std::exception
     {
     public:
@@ -75,5 +95,150 @@ namespace gpio {
         int _errorno;
     };
 
+#ifdef WIRECTRL_GPIOD_V2
+    struct line_request;
+#endif
+    class raw_request;
+
+    //! A GPIO chip shared by all configured lines on it.
+    //! The chip is opened by the first line request and closed when the last line is gone.
+    //! A chip and its lines must only be used by one thread at a time.
+    class chip
+    {
+    public:
+        explicit chip(std::string name, chip_backend backend = chip_backend::gpiod);
+        ~chip();
+
+        chip(chip const&) = delete;
+        chip& operator=(chip const&) = delete;
+
+        std::string const& name() const;
+
+        chip_backend backend() const;
+
+        //! Opens the chip if not yet open.
+        //! @throw  gpio_exception   Thrown when the chip cannot be opened.
+        gpiod_chip* open();
+
+        //! Returns the chip handle or nullptr when the chip is not open.
+        gpiod_chip* get() const;
+
+    private:
+        std::string _name;
+        chip_backend _backend;
+        gpiod_chip* _chip{nullptr};
+    };
+
+    class gpio_line;
+
+    //! Requests the pending lines of one chip at once.
+    //! On a raw chip the output lines with the same consumer share one raw_request, with libgpiod v2
+    //! they share one kernel line request; when that fails the lines are requested one by one, so
+    //! every failure is attributed to its line.
+    //! @return Returns the error of each line that failed, at the position of the line.
+    std::vector<std::optional<gpio_exception>> request_lines(std::vector<gpio_line*> const& lines);
+
+    //! Writes the ready lines that share a raw_request with one ioctl per request.
+    //! Bit i of mask and values addresses lines[i]; the bits of the written lines are cleared from
+    //! mask, the remaining lines are left to gpio_line::set_level. When an ioctl fails the bits of
+    //! its lines stay in mask as well. Does not allocate.
+    //! @return Returns the bits of the lines whose level changed.
+    std::uint64_t set_raw_levels(gpio_line* lines, std::uint64_t& mask, std::uint64_t values);
+
+    //! Handle of a requested line. The line does not own its chip and consumer, both must outlive
+    //! it; names are kept by the owner of the lines, see line_table.
+    class gpio_line
+    {
+    public:
+        //! Creates the line in state pending; no GPIO chip is accessed until request is called.
+        gpio_line(gpio::chip& chip, unsigned line, char const* consumer,
+                  gpio::level init_level, active_level al,
+                  gpio::direction dir = gpio::direction::output,
+                  pull_resistor pull = pull_resistor::none);
+        ~gpio_line();
+
+        gpio_line(gpio_line&&) noexcept;
+
+        gpio::chip& chip() const;
+
+        //! Offset of the line on its chip.
+        unsigned offset() const;
+
+        gpio::level level() const;
+
+        line_state state() const;
+
+        gpio::direction direction() const;
+
+        //! Requests the line from the chip and drives the initial level.
+        //! Input lines are requested for edge events and take the level read from the hardware.
+        //! Does nothing when the line is not pending anymore.
+        //! @throw  gpio_exception   Thrown when GPIOD returns an error; the line is failed afterwards.
+        void request();
+
+        //! Requests the line if still pending and sets the level.
+        //! @throw  gpio_exception   Thrown when GPIOD returns an error, the line is failed or an input.
+        //! @return Returns true if level has changed, false if level stays the same.
+        bool set_level(gpio::level lev);
+
+        //! Reads the level back from the hardware; level() returns the commanded level.
+        //! @throw  gpio_exception   Thrown when the line is not ready or GPIOD returns an error.
+        gpio::level read_level() const;
+
+        //! Drives the commanded level again, e.g. after it was changed by somebody else.
+        //! @throw  gpio_exception   Thrown when the line is not ready or GPIOD returns an error.
+        void reassert();
+
+        //! Changes the active level and bias of the ready line.
+        //! With libgpiod v2 this is a single reconfiguration of the line request that keeps the
+        //! line driven; libgpiod v1 releases and requests the line again.
+        //! The bias is applied by the libgpiod v2 and the raw backend only. The settings of a pending
+        //! line are kept and applied when it is requested.
+        //! @throw  gpio_exception   Thrown when the line failed or GPIOD returns an error.
+        void reconfigure(active_level al, pull_resistor pull);
+
+        //! Returns the file descriptor that becomes readable when an edge event of the ready input
+        //! line is pending.
+        int event_fd() const;
+
+        //! Reads one pending edge event of the input line and updates the level.
+        //! @throw  gpio_exception   Thrown when GPIOD returns an error.
+        //! @return Returns the level after the edge.
+        gpio::level read_event();
+
+    private:
+        friend std::vector<std::optional<gpio_exception>> request_lines(std::vector<gpio_line*> const& lines);
+        friend std::uint64_t set_raw_levels(gpio_line* lines, std::uint64_t& mask, std::uint64_t values);
+
+        void write(gpio::level lev);
+
+        // libgpiod backend, gpio_v1.cpp or gpio_v2.cpp
+        static void share_requests(std::vector<gpio_line*> const& lines);
+        void backend_request();
+        void backend_write(gpio::level lev);
+        gpio::level backend_read() const;
+        void backend_reconfigure(active_level al, pull_resistor pull);
+
+        // ordered by alignment, a line is 56 bytes with libgpiod v1 and 72 with v2
+        gpio::chip* _chip;
+        char const* _consumer;
+#ifdef WIRECTRL_GPIOD_V2
+        std::shared_ptr<line_request> _request{};
+#else
+        gpiod_line *_line{nullptr};
+#endif
+        std::shared_ptr<raw_request> _raw{};
+        unsigned _line_offset;
+#ifdef WIRECTRL_GPIOD_V2
+        std::uint32_t _slot{0};         //!< index of the line in the request
+#endif
+        std::uint32_t _raw_bit{0};      //!< index of the line in the raw request
+        gpio::active_level _active_level;
+        gpio::pull_resistor _pull;
+        gpio::level _level;
+        gpio::direction _direction;
+        line_state _state{line_state::pending};
+    };
+
 } // namespace gpio
 
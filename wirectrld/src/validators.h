@@ -0,0 +1,208 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#pragma once
+
+#include <sys/un.h>
+#include <climits>
+#include <string_view>
+
+//! Hand written matchers for the values of the configuration file.
+//! The matchers are small deterministic automatons that replace std::regex; they are constexpr
+//! so that their behaviour is verified at compile time by the static_asserts below.
+namespace validate {
+
+    constexpr bool is_name_char(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    constexpr bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    //! Matches a sequence of elements of [a-z0-9_]+ that are separated by the separator.
+    //! If leading_separator is true every element must be preceded by the separator,
+    //! e.g. equivalent to the regex (/[a-z0-9_]+)(/[a-z0-9_]+)* for '/'.
+    //! Otherwise the regex ([a-z0-9_]+)(\.[a-z0-9_]+)* for '.' is matched.
+    constexpr bool separated_names(std::string_view s, char separator, bool leading_separator)
+    {
+        enum class state { expect_separator, expect_name_char, in_name };
+        state st = leading_separator ? state::expect_separator : state::expect_name_char;
+        for (char c : s) {
+            switch (st) {
+                case state::expect_separator:
+                    if (c != separator) {
+                        return false;
+                    }
+                    st = state::expect_name_char;
+                    break;
+                case state::expect_name_char:
+                    if (!is_name_char(c)) {
+                        return false;
+                    }
+                    st = state::in_name;
+                    break;
+                case state::in_name:
+                    if (c == separator) {
+                        st = state::expect_name_char;
+                    }
+                    else if (!is_name_char(c)) {
+                        return false;
+                    }
+                    break;
+            }
+        }
+        return st == state::in_name;
+    }
+
+    //! Matches DBus connection names as accepted by wirectrld: ([a-z0-9_]+)(\.[a-z0-9_]+)*
+    constexpr bool dbus_connection_name(std::string_view s)
+    {
+        return separated_names(s, '.', false);
+    }
+
+    //! Matches DBus object paths as accepted by wirectrld: (/[a-z0-9_]+)(/[a-z0-9_]+)*
+    constexpr bool dbus_object_name(std::string_view s)
+    {
+        return separated_names(s, '/', true);
+    }
+
+    //! Matches scene names: ([a-z0-9_]+)(\-[a-z0-9_]+)*
+    constexpr bool scene_name(std::string_view s)
+    {
+        return separated_names(s, '-', false);
+    }
+
+    //! Matches polkit action ids as accepted by wirectrld: ([a-z0-9_]+)(\.[a-z0-9_]+)*
+    constexpr bool polkit_action(std::string_view s)
+    {
+        return separated_names(s, '.', false);
+    }
+
+    //! Matches paths usable for UNIX sockets: absolute, without NUL and short enough for sun_path.
+    constexpr bool unix_socket_path(std::string_view s)
+    {
+        return s.size() > 1 && s.size() < sizeof(sockaddr_un::sun_path) && s.front() == '/'
+            && s.back() != '/' && s.find('\0') == std::string_view::npos;
+    }
+
+    //! Matches boolean values: true|false
+    constexpr bool boolean(std::string_view s)
+    {
+        return s == "true" || s == "false";
+    }
+
+    //! Parses an unsigned decimal number without sign or whitespace.
+    //! @return Returns false when s is empty, contains non-digits or the value exceeds UINT_MAX.
+    constexpr bool unsigned_number(std::string_view s, unsigned& value)
+    {
+        if (s.empty()) {
+            return false;
+        }
+        unsigned long long v{0};
+        for (char c : s) {
+            if (!is_digit(c)) {
+                return false;
+            }
+            v = v * 10 + static_cast<unsigned>(c - '0');
+            if (v > UINT_MAX) {
+                return false;
+            }
+        }
+        value = static_cast<unsigned>(v);
+        return true;
+    }
+
+    //! GPIO line specification <chip>-<line> as split by gpio_line_spec.
+    struct line_spec {
+        std::string_view chip{};
+        unsigned line{};
+    };
+
+    //! Matches and splits gpio line specifications: (.+)\-([0-9]+)
+    //! Like the greedy regex the chip is everything in front of the last '-'.
+    constexpr bool gpio_line_spec(std::string_view s, line_spec& spec)
+    {
+        auto pos = s.rfind('-');
+        if (pos == std::string_view::npos || pos == 0) {
+            return false;
+        }
+        unsigned line{};
+        if (!unsigned_number(s.substr(pos + 1), line)) {
+            return false;
+        }
+        spec.chip = s.substr(0, pos);
+        spec.line = line;
+        return true;
+    }
+
+    namespace detail {
+        constexpr bool line_spec_is(std::string_view s, std::string_view chip, unsigned line)
+        {
+            line_spec spec{};
+            return gpio_line_spec(s, spec) && spec.chip == chip && spec.line == line;
+        }
+
+        constexpr bool line_spec_fails(std::string_view s)
+        {
+            line_spec spec{};
+            return !gpio_line_spec(s, spec);
+        }
+    } // namespace detail
+
+    static_assert(dbus_connection_name("de.titnc.pi.wirectrl"));
+    static_assert(dbus_connection_name("a_1"));
+    static_assert(!dbus_connection_name(""));
+    static_assert(!dbus_connection_name(".de"));
+    static_assert(!dbus_connection_name("de."));
+    static_assert(!dbus_connection_name("de..pi"));
+    static_assert(!dbus_connection_name("De.pi"));
+
+    static_assert(dbus_object_name("/de/titnc/pi/wirectrl/v1"));
+    static_assert(dbus_object_name("/a"));
+    static_assert(!dbus_object_name(""));
+    static_assert(!dbus_object_name("/"));
+    static_assert(!dbus_object_name("de/titnc"));
+    static_assert(!dbus_object_name("/de/"));
+    static_assert(!dbus_object_name("/de//pi"));
+
+    static_assert(scene_name("all-off") && scene_name("maintenance") && scene_name("stage_2"));
+    static_assert(!scene_name("") && !scene_name("-off") && !scene_name("all off") && !scene_name("Stage"));
+
+    static_assert(polkit_action("de.titnc.pi.wirectrl.relays"));
+    static_assert(!polkit_action("") && !polkit_action("de..relays") && !polkit_action("de.Relays"));
+
+    static_assert(unix_socket_path("/run/wirectrl/peer.socket"));
+    static_assert(!unix_socket_path("") && !unix_socket_path("/") && !unix_socket_path("run/peer.socket"));
+    static_assert(!unix_socket_path("/run/wirectrl/") && !unix_socket_path(std::string_view{"/run/a\0b", 9}));
+
+    static_assert(boolean("true") && boolean("false"));
+    static_assert(!boolean("") && !boolean("True") && !boolean("truee"));
+
+    static_assert(detail::line_spec_is("0-17", "0", 17));
+    static_assert(detail::line_spec_is("gpiochip1-3", "gpiochip1", 3));
+    static_assert(detail::line_spec_is("pinctrl-bcm2835-4", "pinctrl-bcm2835", 4));
+    static_assert(detail::line_spec_is("--0", "-", 0));
+    static_assert(detail::line_spec_fails(""));
+    static_assert(detail::line_spec_fails("17"));
+    static_assert(detail::line_spec_fails("-17"));
+    static_assert(detail::line_spec_fails("0-"));
+    static_assert(detail::line_spec_fails("0-1x"));
+    static_assert(detail::line_spec_fails("0-1-x"));
+    static_assert(detail::line_spec_fails("0-99999999999"));
+
+} // namespace validate
@@ -0,0 +1,100 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "authorization.h"
+
+#include <stdexcept>
+#include <string>
+
+TEST_CASE("access_policy maps lines and masks to actions")
+{
+    access_policy policy;
+    CHECK(policy.empty());
+    policy.require(0, 0, 0, "de.titnc.relays");
+    policy.require(2, 0, 2, "de.titnc.heater");
+    policy.require(5, 1, 1, "de.titnc.relays");
+    policy.require(70, 1, 66, "de.titnc.relays");
+    CHECK_FALSE(policy.empty());
+    CHECK_EQ(policy.name(0), "de.titnc.relays");
+    CHECK_EQ(policy.name(1), "de.titnc.heater");
+
+    CHECK_EQ(policy.line(0), 0b01);
+    CHECK_EQ(policy.line(1), 0);
+    CHECK_EQ(policy.line(2), 0b10);
+    CHECK_EQ(policy.line(70), 0b01);
+    CHECK_EQ(policy.line(1000), 0);
+
+    CHECK_EQ(policy.mask(0, 0b010), 0);
+    CHECK_EQ(policy.mask(0, 0b011), 0b01);
+    CHECK_EQ(policy.mask(0, 0b111), 0b11);
+    CHECK_EQ(policy.mask(1, 0b001), 0);
+    CHECK_EQ(policy.mask(1, 0b010), 0b01);
+    CHECK_EQ(policy.mask(7, ~std::uint64_t{0}), 0);
+
+    access_policy many;
+    for (std::size_t i = 0; i < access_policy::max_actions; ++i) {
+        many.require(i, 0, i, "action" + std::to_string(i));
+    }
+    CHECK_THROWS_AS(many.require(64, 1, 0, "action64"), std::runtime_error);
+    CHECK_NOTHROW(many.require(64, 1, 0, "action3"));
+}
+
+TEST_CASE("authorization_cache classifies actions per client")
+{
+    authorization_cache cache;
+    auto res = cache.check(":1.7", 0b11, 0);
+    CHECK_EQ(res.unknown, 0b11);
+    CHECK_FALSE(res.granted());
+    CHECK(cache.check(":1.7", 0, 0).granted());
+
+    cache.begin(":1.7", 0b11);
+    res = cache.check(":1.7", 0b11, 0);
+    CHECK_EQ(res.pending, 0b11);
+    CHECK_EQ(res.unknown, 0);
+
+    cache.store(":1.7", 0, true, 1000);
+    cache.store(":1.7", 1, false, 500);
+    res = cache.check(":1.7", 0b11, 100);
+    CHECK_EQ(res.pending, 0);
+    CHECK_EQ(res.denied, 0b10);
+    CHECK(cache.check(":1.7", 0b01, 100).granted());
+    CHECK(cache.check(":1.8", 0b01, 100).unknown == 0b01);
+
+    // expired decisions have to be checked again
+    CHECK_EQ(cache.check(":1.7", 0b11, 600).unknown, 0b10);
+    CHECK_EQ(cache.check(":1.7", 0b11, 1000).unknown, 0b11);
+
+    cache.store(":1.7", 1, true, 2000);
+    CHECK(cache.check(":1.7", 0b10, 600).granted());
+}
+
+TEST_CASE("authorization_cache forgets clients and invalidates decisions")
+{
+    authorization_cache cache;
+    cache.store(":1.7", 0, true, 1000);
+    cache.store(":1.8", 0, true, 1000);
+    cache.begin(":1.8", 0b10);
+    CHECK_EQ(cache.clients(), 2);
+
+    cache.forget(":1.7");
+    CHECK_EQ(cache.clients(), 1);
+    CHECK_EQ(cache.check(":1.7", 0b01, 0).unknown, 0b01);
+
+    cache.invalidate();
+    auto res = cache.check(":1.8", 0b11, 0);
+    CHECK_EQ(res.unknown, 0b01);
+    CHECK_EQ(res.pending, 0b10);
+}
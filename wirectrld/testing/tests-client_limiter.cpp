@@ -0,0 +1,49 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "client_limiter.h"
+
+#include <map>
+
+TEST_CASE("client limiter keeps a bucket per client")
+{
+    client_limiter unlimited{0, 1};
+    CHECK_FALSE(unlimited.enabled());
+    for (int i = 0; i < 100; ++i) {
+        CHECK(unlimited.admit(":1.1", 0));
+    }
+    CHECK_EQ(unlimited.clients(), 0);
+
+    client_limiter limiter{10, 2};
+    CHECK(limiter.enabled());
+    CHECK(limiter.admit(":1.1", 1000000));
+    CHECK(limiter.admit(":1.1", 1000000));
+    CHECK_FALSE(limiter.admit(":1.1", 1000000));
+    // a flooding client does not use up the tokens of another
+    CHECK(limiter.admit(":1.2", 1000000));
+    CHECK(limiter.admit(":1.1", 1100000));
+    CHECK_FALSE(limiter.admit(":1.1", 1100000));
+    CHECK_EQ(limiter.rejected(), 2);
+
+    std::map<std::string, std::uint64_t> rejected;
+    limiter.for_each_rejected([&rejected](std::string const& key, std::uint64_t count) { rejected[key] = count; });
+    CHECK_EQ(rejected, std::map<std::string, std::uint64_t>{{":1.1", 2}});
+
+    limiter.forget(":1.1");
+    CHECK_EQ(limiter.clients(), 1);
+    CHECK_EQ(limiter.rejected(), 2);
+    CHECK(limiter.admit(":1.1", 1100000));
+}
@@ -0,0 +1,341 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "config.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+//! Temporary configuration directory with a conf.d sub directory, removed on destruction.
+class config_dir {
+public:
+    config_dir()
+    {
+        char tmpl[] = "/tmp/wirectrl-test-XXXXXX";
+        _path = ::mkdtemp(tmpl);
+        std::string cmd{"mkdir -p "};
+        REQUIRE_EQ(std::system((cmd + _path + "/conf.d").c_str()), 0);
+    }
+
+    ~config_dir()
+    {
+        std::string cmd{"rm -rf "};
+        (void)std::system((cmd + _path).c_str());
+    }
+
+    std::string write(std::string const& name, std::string const& content) const
+    {
+        auto path = _path + "/" + name;
+        std::ofstream f(path);
+        f << content;
+        return path;
+    }
+
+    config_source source() const
+    {
+        opts options;
+        options.config_file = _path + "/wirectrl.conf";
+        return find_config(options);
+    }
+
+private:
+    std::string _path;
+};
+
+std::string gpio_section(unsigned line)
+{
+    return "[gpio = gpiochip0-" + std::to_string(line) + "]\nname = line" + std::to_string(line) + "\n";
+}
+
+} // namespace
+
+TEST_CASE("config fragments are found and merged in file name order")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", "[dbus]\nconnection-id = de.titnc.test\n" + gpio_section(0));
+    dir.write("conf.d/20-b.conf", gpio_section(2));
+    dir.write("conf.d/10-a.conf", gpio_section(1) + gpio_section(3));
+    dir.write("conf.d/30-c.conf.disabled", gpio_section(9));
+    dir.write("conf.d/.40-hidden.conf", gpio_section(9));
+
+    auto source = dir.source();
+    REQUIRE_EQ(source.fragments.size(), 2);
+    CHECK_NE(source.fragments[0].find("10-a.conf"), std::string::npos);
+    CHECK_NE(source.fragments[1].find("20-b.conf"), std::string::npos);
+
+    auto config = configuration::load(source);
+    CHECK_EQ(config.dbus.connection_name, "de.titnc.test");
+    REQUIRE_EQ(config.gpios.size(), 4);
+    std::vector<unsigned> lines;
+    for (auto const& gpio : config.gpios) {
+        lines.push_back(gpio.gpio_line_id);
+    }
+    CHECK_EQ(lines, std::vector<unsigned>{0, 1, 3, 2});
+}
+
+TEST_CASE("config dbus peer socket")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    CHECK(configuration::load(dir.source()).dbus.peer_socket.empty());
+
+    dir.write("wirectrl.conf", "[dbus]\npeer-socket = /run/wirectrl/peer.socket\n" + gpio_section(0));
+    CHECK_EQ(configuration::load(dir.source()).dbus.peer_socket, "/run/wirectrl/peer.socket");
+
+    dir.write("wirectrl.conf", "[dbus]\npeer-socket = peer.socket\n" + gpio_section(0));
+    CHECK_THROWS((void)configuration::load(dir.source()));
+}
+
+TEST_CASE("config dbus client rate limit")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    auto dc = configuration::load(dir.source()).dbus;
+    CHECK_EQ(dc.client_rate, 0);
+    CHECK_EQ(dc.client_key, client_identity::sender);
+
+    dir.write("wirectrl.conf", "[dbus]\nclient-rate = 50\nclient-key = uid\n" + gpio_section(0));
+    dc = configuration::load(dir.source()).dbus;
+    CHECK_EQ(dc.client_rate, 50);
+    CHECK_EQ(dc.client_burst, 50);
+    CHECK_EQ(dc.client_key, client_identity::uid);
+
+    dir.write("wirectrl.conf", "[dbus]\nclient-rate = 50\nclient-burst = 0\n" + gpio_section(0));
+    CHECK_THROWS((void)configuration::load(dir.source()));
+}
+
+TEST_CASE("config dbus line broadcast")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    CHECK(configuration::load(dir.source()).dbus.broadcast_lines);
+
+    dir.write("wirectrl.conf", "[dbus]\nbroadcast-lines = false\n" + gpio_section(0));
+    CHECK_FALSE(configuration::load(dir.source()).dbus.broadcast_lines);
+}
+
+TEST_CASE("config line pull resistor")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + gpio_section(1) + "pull-resistor = up\n"
+              + gpio_section(2) + "pull-resistor = down\n" + gpio_section(3) + "pull-resistor = none\n");
+    auto config = configuration::load(dir.source());
+    REQUIRE_EQ(config.gpios.size(), 4);
+    CHECK_EQ(config.gpios[0].pull_resistor, gpio::pull_resistor::none);
+    CHECK_EQ(config.gpios[1].pull_resistor, gpio::pull_resistor::up);
+    CHECK_EQ(config.gpios[2].pull_resistor, gpio::pull_resistor::down);
+    CHECK_EQ(config.gpios[3].pull_resistor, gpio::pull_resistor::none);
+
+    dir.write("wirectrl.conf", gpio_section(0) + "pull-resistor = strong\n");
+    CHECK_THROWS((void)configuration::load(dir.source()));
+}
+
+TEST_CASE("config line access policies")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + gpio_section(1) + "access = de.titnc.pi.wirectrl.relays\n");
+    auto config = configuration::load(dir.source());
+    REQUIRE_EQ(config.gpios.size(), 2);
+    CHECK(config.gpios[0].access.empty());
+    CHECK_EQ(config.gpios[1].access, "de.titnc.pi.wirectrl.relays");
+    CHECK_EQ(config.dbus.authorization_ttl, 300);
+
+    dir.write("wirectrl.conf", "[dbus]\nauthorization-ttl = 30\n" + gpio_section(0));
+    CHECK_EQ(configuration::load(dir.source()).dbus.authorization_ttl, 30);
+
+    dir.write("wirectrl.conf", gpio_section(0) + "access = Relays\n");
+    CHECK_THROWS((void)configuration::load(dir.source()));
+}
+
+TEST_CASE("config chip sections")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + "[chip = gpiochip0]\nbackend = raw\n");
+    auto config = configuration::load(dir.source());
+    REQUIRE_EQ(config.chips.size(), 1);
+    CHECK_EQ(config.chips[0].name, "gpiochip0");
+    CHECK_EQ(config.chips[0].backend, gpio::chip_backend::raw);
+
+    dir.write("conf.d/chip.conf", "[chip = gpiochip0]\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config gpio request mode")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + gpio_section(1) + "request = lazy\n"
+                               + gpio_section(2) + "request = on-demand\n");
+    auto config = configuration::load(dir.source());
+    REQUIRE_EQ(config.gpios.size(), 3);
+    CHECK_EQ(config.gpios[0].request, gpio::request_mode::eager);
+    CHECK_EQ(config.gpios[1].request, gpio::request_mode::lazy);
+    CHECK_EQ(config.gpios[2].request, gpio::request_mode::on_demand);
+
+    dir.write("wirectrl.conf", gpio_section(0) + "request = later\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), core::ini::parse_exception);
+}
+
+TEST_CASE("config verify section")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    CHECK_EQ(configuration::load(dir.source()).verify.interval_ms, 0);
+
+    dir.write("conf.d/verify.conf", "[verify]\ninterval = 250\nreassert = true\n");
+    auto config = configuration::load(dir.source());
+    CHECK_EQ(config.verify.interval_ms, 250);
+    CHECK(config.verify.reassert);
+
+    dir.write("wirectrl.conf", "[verify]\n" + gpio_section(0));
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config scheduler section")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    CHECK_EQ(configuration::load(dir.source()).scheduler.bus.rate, 0);
+
+    dir.write("conf.d/scheduler.conf", "[scheduler]\nbus-rate = 200\nhousekeeping-rate = 10\nhousekeeping-burst = 2\n");
+    auto config = configuration::load(dir.source());
+    CHECK_EQ(config.scheduler.realtime.rate, 0);
+    CHECK_EQ(config.scheduler.bus.rate, 200);
+    CHECK_EQ(config.scheduler.bus.burst, 200);
+    CHECK_EQ(config.scheduler.housekeeping.rate, 10);
+    CHECK_EQ(config.scheduler.housekeeping.burst, 2);
+    CHECK_EQ(config.scheduler.lag_threshold_ms, 100);
+
+    dir.write("conf.d/scheduler.conf", "[scheduler]\nlag-threshold = 0\n");
+    CHECK_EQ(configuration::load(dir.source()).scheduler.lag_threshold_ms, 0);
+
+    dir.write("conf.d/scheduler.conf", "[scheduler]\nbus-rate = 200\nbus-burst = 0\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config metrics section")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0));
+    CHECK(configuration::load(dir.source()).metrics.socket.empty());
+
+    dir.write("conf.d/metrics.conf", "[metrics]\nsocket = /run/wirectrl/metrics.socket\n");
+    CHECK_EQ(configuration::load(dir.source()).metrics.socket, "/run/wirectrl/metrics.socket");
+
+    dir.write("conf.d/metrics.conf", "[metrics]\nsocket = run/metrics.socket\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config scene sections")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + gpio_section(1)
+                               + "[scene = all-off]\nline0 = inactive\nline1 = inactive\n");
+    dir.write("conf.d/stage.conf", "[scene = stage]\nline1 = active\n");
+    auto config = configuration::load(dir.source());
+    REQUIRE_EQ(config.scenes.size(), 2);
+    CHECK_EQ(config.scenes[0].name, "all-off");
+    REQUIRE_EQ(config.scenes[0].levels.size(), 2);
+    CHECK_EQ(config.scenes[0].levels[1].first, "line1");
+    CHECK_EQ(config.scenes[0].levels[1].second, gpio::level::inactive);
+    CHECK_EQ(config.scenes[1].name, "stage");
+    CHECK_EQ(config.scenes[1].levels[0].second, gpio::level::active);
+
+    dir.write("conf.d/stage.conf", "[scene = stage]\nline1 = on\n");
+    try {
+        (void)configuration::load(dir.source());
+        FAIL("expected parse_exception");
+    }
+    catch (core::ini::parse_exception& e) {
+        CHECK_EQ(e.line_number(), 2);
+        CHECK_EQ(e.expression(), "line1 = on");
+    }
+
+    dir.write("conf.d/stage.conf", "[scene = Stage]\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config rule sections")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", gpio_section(0) + "direction = input\n" + gpio_section(1)
+                               + "[rule]\ninput = line0\noutput = line1\nduration = 500\n"
+                               + "[rule]\ninput = line0\nedge = falling\noutput = line1\nlevel = inactive\n");
+    auto config = configuration::load(dir.source());
+    CHECK_EQ(config.gpios[0].direction, gpio::direction::input);
+    CHECK_EQ(config.gpios[1].direction, gpio::direction::output);
+    REQUIRE_EQ(config.rules.size(), 2);
+    CHECK_EQ(config.rules[0].input, "line0");
+    CHECK_EQ(config.rules[0].edge, gpio::edge::rising);
+    CHECK_EQ(config.rules[0].output, "line1");
+    CHECK_EQ(config.rules[0].level, gpio::level::active);
+    CHECK_EQ(config.rules[0].duration_ms, 500);
+    CHECK_EQ(config.rules[1].edge, gpio::edge::falling);
+    CHECK_EQ(config.rules[1].level, gpio::level::inactive);
+    CHECK_EQ(config.rules[1].duration_ms, 0);
+
+    dir.write("wirectrl.conf", "[rule]\ninput = line0\n");
+    CHECK_THROWS_AS((void)configuration::load(dir.source()), std::runtime_error);
+}
+
+TEST_CASE("config errors are attributed to the fragment")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", "[dbus]\n");
+    std::string broken;
+    for (unsigned i = 0; i < 64; ++i) {
+        auto path = dir.write("conf.d/" + std::to_string(100 + i) + ".conf", gpio_section(i));
+        if (i == 17) {
+            broken = path;
+        }
+    }
+    dir.write("conf.d/117.conf", gpio_section(17) + "name\n");
+    dir.write("conf.d/150.conf", "[unknown]\n");
+
+    auto source = dir.source();
+    try {
+        (void)configuration::load(source);
+        FAIL("expected parse_exception");
+    }
+    catch (core::ini::parse_exception& e) {
+        CHECK_EQ(e.source(), broken);
+        CHECK_EQ(e.line_number(), 3);
+    }
+
+    dir.write("conf.d/117.conf", gpio_section(17));
+    try {
+        (void)configuration::load(source);
+        FAIL("expected runtime_error");
+    }
+    catch (std::runtime_error& e) {
+        CHECK_NE(std::string{e.what()}.find("150.conf]"), std::string::npos);
+    }
+
+    dir.write("conf.d/150.conf", "[dbus]\n");
+    try {
+        (void)configuration::load(source);
+        FAIL("expected runtime_error");
+    }
+    catch (std::runtime_error& e) {
+        CHECK_NE(std::string{e.what()}.find("Multiple 'dbus' sections"), std::string::npos);
+        CHECK_NE(std::string{e.what()}.find("150.conf]"), std::string::npos);
+    }
+}
@@ -0,0 +1,165 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "config_cache.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+//! Temporary configuration directory with a conf.d sub directory, removed on destruction.
+class config_dir {
+public:
+    config_dir()
+    {
+        char tmpl[] = "/tmp/wirectrl-test-XXXXXX";
+        _path = ::mkdtemp(tmpl);
+        std::string cmd{"mkdir -p "};
+        REQUIRE_EQ(std::system((cmd + _path + "/conf.d").c_str()), 0);
+    }
+
+    ~config_dir()
+    {
+        std::string cmd{"rm -rf "};
+        (void)std::system((cmd + _path).c_str());
+    }
+
+    std::string write(std::string const& name, std::string const& content) const
+    {
+        auto path = _path + "/" + name;
+        std::ofstream f(path);
+        f << content;
+        return path;
+    }
+
+    config_source source() const
+    {
+        opts options;
+        options.config_file = _path + "/wirectrl.conf";
+        return find_config(options);
+    }
+
+private:
+    std::string _path;
+};
+
+std::string const config_text{
+    "[dbus]\nconnection-id = de.titnc.cache\n"
+    "[gpio = gpiochip0-4]\nname = relay\npull-resistor = up\n"
+    "[gpio = gpiochip0-5]\nname = button\ndirection = input\n"
+};
+
+//! Loads the configuration and stores it in the cache, the stamp taken before loading.
+configuration load_and_store(config_source const& source)
+{
+    std::uint64_t stamp;
+    REQUIRE(config_source_stamp(source, stamp));
+    auto config = configuration::load(source);
+    store_config_cache(source, stamp, config);
+    return config;
+}
+
+//! Loads the configuration from the cache with the current stamp of the source.
+bool load_cached(config_source const& source, configuration& config)
+{
+    std::uint64_t stamp;
+    REQUIRE(config_source_stamp(source, stamp));
+    return load_config_cache(source, stamp, config);
+}
+
+} // namespace
+
+TEST_CASE("config cache round trip")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", config_text);
+    auto source = dir.source();
+
+    configuration cached;
+    CHECK_FALSE(load_cached(source, cached));
+
+    auto config = load_and_store(source);
+    REQUIRE(load_cached(source, cached));
+    CHECK_EQ(cached.dbus.connection_name, "de.titnc.cache");
+    CHECK_EQ(cached.dbus.broadcast_lines, config.dbus.broadcast_lines);
+    REQUIRE_EQ(cached.gpios.size(), 2);
+    for (std::size_t i = 0; i < cached.gpios.size(); ++i) {
+        CHECK_EQ(cached.gpios[i].name, config.gpios[i].name);
+        CHECK_EQ(cached.gpios[i].gpio_line_id, config.gpios[i].gpio_line_id);
+        CHECK_EQ(cached.gpios[i].direction, config.gpios[i].direction);
+        CHECK_EQ(cached.gpios[i].pull_resistor, config.gpios[i].pull_resistor);
+    }
+}
+
+TEST_CASE("config cache is stale after the configuration changed")
+{
+    config_dir dir;
+    auto path = dir.write("wirectrl.conf", config_text);
+    auto source = dir.source();
+    load_and_store(source);
+
+    configuration cached;
+    SUBCASE("modification time") {
+        struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+        REQUIRE_EQ(::utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+        CHECK_FALSE(load_cached(source, cached));
+    }
+    SUBCASE("fragment added") {
+        dir.write("conf.d/10-a.conf", "[gpio = gpiochip0-6]\nname = lamp\n");
+        source = dir.source();
+        REQUIRE_EQ(source.fragments.size(), 1);
+        CHECK_FALSE(load_cached(source, cached));
+    }
+    SUBCASE("changed while loading") {
+        std::uint64_t stamp;
+        REQUIRE(config_source_stamp(source, stamp));
+        struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+        REQUIRE_EQ(::utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+        store_config_cache(source, stamp, configuration::load(source));
+        CHECK_FALSE(load_cached(source, cached));
+    }
+    CHECK(cached.gpios.empty());
+}
+
+TEST_CASE("config cache with corrupted checksum is ignored")
+{
+    config_dir dir;
+    dir.write("wirectrl.conf", config_text);
+    auto source = dir.source();
+    load_and_store(source);
+
+    auto cache_path = config_cache_path(source.path);
+    struct stat st{};
+    REQUIRE_EQ(::stat(cache_path.c_str(), &st), 0);
+    {
+        // flip the last payload byte
+        std::fstream f(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekg(st.st_size - 1);
+        char c = static_cast<char>(f.get());
+        f.seekp(st.st_size - 1);
+        f.put(static_cast<char>(c ^ 0x01));
+    }
+
+    configuration cached;
+    CHECK_FALSE(load_cached(source, cached));
+    CHECK(cached.gpios.empty());
+}
@@ -0,0 +1,117 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "fast_channel.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace {
+
+//! Producer side of the ring as a client implements it.
+class client {
+public:
+    explicit client(fast_channel const& channel)
+        : _eventfd{channel.eventfd()}
+    {
+        _map = ::mmap(nullptr, fast_channel::size(), PROT_READ | PROT_WRITE, MAP_SHARED, channel.memfd(), 0);
+        REQUIRE_NE(_map, MAP_FAILED);
+        _header = static_cast<fast_channel::header*>(_map);
+        _commands = reinterpret_cast<fast_channel::command*>(static_cast<char*>(_map) + sizeof(fast_channel::header));
+    }
+
+    ~client()
+    {
+        ::munmap(_map, fast_channel::size());
+    }
+
+    fast_channel::header& header()
+    {
+        return *_header;
+    }
+
+    bool push(fast_channel::command const& c)
+    {
+        auto head = _header->head.load(std::memory_order_relaxed);
+        if (head - _header->tail.load(std::memory_order_acquire) == _header->capacity) {
+            return false;
+        }
+        _commands[head % _header->capacity] = c;
+        _header->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void notify()
+    {
+        ::eventfd_write(_eventfd, 1);
+    }
+
+private:
+    int _eventfd;
+    void* _map;
+    fast_channel::header* _header;
+    fast_channel::command* _commands;
+};
+
+} // namespace
+
+TEST_CASE("fast channel transfers commands")
+{
+    fast_channel channel{":1.42"};
+    CHECK_EQ(channel.owner(), ":1.42");
+    client c{channel};
+    CHECK_EQ(c.header().magic, fast_channel::magic);
+    CHECK_EQ(c.header().capacity, fast_channel::capacity);
+    CHECK_EQ(c.header().command_size, sizeof(fast_channel::command));
+
+    std::vector<fast_channel::command> received;
+    auto collect = [&received](fast_channel::command const& cmd) { received.push_back(cmd); };
+
+    // wrap around the ring a few times
+    std::uint64_t sent{0};
+    for (int round = 0; round < 5; ++round) {
+        while (c.push({1, 0, sent, ~sent})) {
+            ++sent;
+        }
+        c.notify();
+        channel.acknowledge();
+        REQUIRE(channel.consume(collect));
+        CHECK_EQ(c.header().tail.load(), sent);
+    }
+    REQUIRE_EQ(received.size(), sent);
+    CHECK_EQ(sent, 5 * fast_channel::capacity);
+    for (std::uint64_t i = 0; i < sent; ++i) {
+        CHECK_EQ(received[i].mask, i);
+        CHECK_EQ(received[i].values, ~i);
+    }
+
+    eventfd_t value{0};
+    CHECK_NE(::eventfd_read(channel.eventfd(), &value), 0);   // counter was reset
+}
+
+TEST_CASE("fast channel rejects corrupted indices")
+{
+    fast_channel channel{":1.43"};
+    client c{channel};
+    c.header().head.store(fast_channel::capacity + 1);
+    CHECK_FALSE(channel.consume([](fast_channel::command const&) { FAIL("no command expected"); }));
+
+    // the memory is sealed against shrinking
+    CHECK_NE(::ftruncate(channel.memfd(), 0), 0);
+}
@@ -0,0 +1,150 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "line_table.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+gpio_configuration line(std::string chip, unsigned offset, std::string name,
+                        gpio::direction dir = gpio::direction::output,
+                        gpio::level init = gpio::level::inactive)
+{
+    gpio_configuration g{};
+    g.name = std::move(name);
+    g.consumer = "wirectrl";
+    g.initial_level = init;
+    g.active_level = gpio::active_level::active_high;
+    g.direction = dir;
+    g.gpio_chip_name = std::move(chip);
+    g.gpio_line_id = offset;
+    return g;
+}
+
+} // namespace
+
+TEST_CASE("line table groups the lines by chip in configuration order")
+{
+    std::vector<gpio_configuration> gpios{
+        line("gpiochip1", 7, "b0"),
+        line("gpiochip0", 3, "a0"),
+        line("gpiochip1", 2, "b1"),
+        line("gpiochip0", 1, "a1"),
+        line("gpiochip2", 0, "c0"),
+    };
+    std::vector<chip_configuration> chips{{"gpiochip0", gpio::chip_backend::raw}};
+    line_table lines{gpios, chips};
+
+    REQUIRE_EQ(lines.size(), 5);
+    REQUIRE_EQ(lines.chip_count(), 3);
+    // chips in the order of their first line
+    CHECK_EQ(lines.chip(0).name(), "gpiochip1");
+    CHECK_EQ(lines.chip(1).name(), "gpiochip0");
+    CHECK_EQ(lines.chip(2).name(), "gpiochip2");
+    CHECK_EQ(lines.chip(0).backend(), gpio::chip_backend::gpiod);
+    CHECK_EQ(lines.chip(1).backend(), gpio::chip_backend::raw);
+
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        names.emplace_back(lines.name(i));
+    }
+    CHECK_EQ(names, std::vector<std::string>{"b0", "b1", "a0", "a1", "c0"});
+    CHECK_EQ(lines[1].offset(), 2);
+    CHECK_EQ(lines[3].offset(), 1);
+    CHECK_EQ(lines.chip_lines(1), &lines[2]);
+    CHECK_EQ(&lines[2].chip(), &lines.chip(1));
+
+    // the chips are opened by the first request only
+    for (std::size_t c = 0; c < lines.chip_count(); ++c) {
+        CHECK_EQ(lines.chip(c).get(), nullptr);
+    }
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        CHECK_EQ(lines[i].state(), gpio::line_state::pending);
+    }
+}
+
+TEST_CASE("line table chip boundaries")
+{
+    std::vector<gpio_configuration> gpios{
+        line("gpiochip0", 0, "a0"),
+        line("gpiochip0", 1, "a1"),
+        line("gpiochip1", 0, "b0"),
+        line("gpiochip2", 0, "c0"),
+        line("gpiochip2", 1, "c1"),
+    };
+    line_table lines{gpios, {}};
+
+    REQUIRE_EQ(lines.chip_count(), 3);
+    CHECK_EQ(lines.first(0), 0);
+    CHECK_EQ(lines.first(1), 2);
+    CHECK_EQ(lines.first(2), 3);
+    CHECK_EQ(lines.first(3), 5);
+    std::vector<std::size_t> chip_of;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        chip_of.push_back(lines.chip_of(i));
+    }
+    CHECK_EQ(chip_of, std::vector<std::size_t>{0, 0, 1, 2, 2});
+}
+
+TEST_CASE("line table finds lines by name")
+{
+    std::vector<gpio_configuration> gpios{
+        line("gpiochip1", 0, "dup"),
+        line("gpiochip0", 0, "other"),
+        line("gpiochip0", 1, "dup"),
+    };
+    line_table lines{gpios, {}};
+
+    // the first configured line wins, also when grouping moves it behind the other
+    auto dup = lines.find("dup");
+    REQUIRE_NE(dup, line_table::npos);
+    CHECK_EQ(lines.chip(lines.chip_of(dup)).name(), "gpiochip1");
+    CHECK_EQ(lines.find("other"), 1);
+    CHECK_EQ(lines.find("unknown"), line_table::npos);
+    // consumers are interned in the same pool but name no line
+    CHECK_EQ(lines.find("wirectrl"), line_table::npos);
+    CHECK_EQ(lines.find(""), line_table::npos);
+}
+
+TEST_CASE("line table keeps the levels of every chip in its own words")
+{
+    std::vector<gpio_configuration> gpios;
+    for (unsigned i = 0; i < 70; ++i) {
+        auto dir = i % 2 == 0 ? gpio::direction::output : gpio::direction::input;
+        auto init = i == 0 || i == 65 ? gpio::level::active : gpio::level::inactive;
+        gpios.push_back(line("gpiochip0", i, "a" + std::to_string(i), dir, init));
+    }
+    gpios.push_back(line("gpiochip1", 0, "b0", gpio::direction::output, gpio::level::active));
+    gpios.push_back(line("gpiochip1", 1, "b1"));
+    line_table lines{gpios, {}};
+
+    REQUIRE_EQ(lines.chip_count(), 2);
+    // 70 lines take two words, the second chip starts on the third
+    CHECK_EQ(lines.levels(1) - lines.levels(0), 2);
+    CHECK_EQ(lines.levels(0)[0], std::uint64_t{1});
+    CHECK_EQ(lines.levels(0)[1], std::uint64_t{1} << 1);
+    CHECK_EQ(lines.levels(1)[0], std::uint64_t{1});
+    CHECK_EQ(lines.level(65), gpio::level::active);
+    CHECK_EQ(lines.level(64), gpio::level::inactive);
+    CHECK_EQ(lines.level(70), gpio::level::active);
+    CHECK_EQ(lines.level(71), gpio::level::inactive);
+
+    // only the first 64 lines of a chip are addressable by a mask
+    CHECK_EQ(lines.output_mask(0), 0x5555555555555555ull);
+    CHECK_EQ(lines.output_mask(1), std::uint64_t{3});
+}
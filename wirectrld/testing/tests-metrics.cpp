@@ -0,0 +1,153 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "metrics.h"
+
+#include <core/sd_event_loop.h>
+#include <core/scheduler.h>
+
+#include <systemd/sd-event.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+TEST_CASE("metrics page renders families and terminates with EOF")
+{
+    metrics_page page;
+    auto requests = page.add_family("wirectrl_requests", "counter", "DBus method calls.");
+    auto set_line = page.add_sample(requests, "wirectrl_requests_total{method=\"set_line\"}");
+    auto set_mask = page.add_sample(requests, "wirectrl_requests_total{method=\"set_mask\"}");
+    auto rss = page.add_sample(page.add_family("process_resident_memory_bytes", "gauge", "Resident memory."),
+                               "process_resident_memory_bytes");
+    page.set(set_line, 3);
+    page.set(rss, 4096);
+    CHECK_EQ(page.render(),
+             "# TYPE wirectrl_requests counter\n"
+             "# HELP wirectrl_requests DBus method calls.\n"
+             "wirectrl_requests_total{method=\"set_line\"} 3\n"
+             "wirectrl_requests_total{method=\"set_mask\"} 0\n"
+             "# TYPE process_resident_memory_bytes gauge\n"
+             "# HELP process_resident_memory_bytes Resident memory.\n"
+             "process_resident_memory_bytes 4096\n"
+             "# EOF\n");
+
+    // an unchanged page renders the same, a changed value only its family
+    CHECK_EQ(page.render(), page.render());
+    page.set(set_mask, 12);
+    CHECK_NE(page.render().find("wirectrl_requests_total{method=\"set_mask\"} 12\n"), std::string::npos);
+
+    CHECK_EQ(metrics_page::escape("a\"b\\c\nd"), "a\\\"b\\\\c\\nd");
+}
+
+TEST_CASE("metrics page renders histograms cumulative in seconds")
+{
+    metrics_page page;
+    auto family = page.add_family("wirectrl_loop_iteration_seconds", "histogram", "Busy time.");
+    auto first = page.add_histogram(family, "wirectrl_loop_iteration_seconds", {});
+    CHECK_EQ(page.sample_count(), first + metrics_page::histogram_samples);
+
+    core::latency_histogram h;
+    h.record(0);
+    h.record(3);
+    h.record(1500000);
+    page.set_histogram(first, h);
+    auto const& text = page.render();
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_bucket{le=\"0\"} 1\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_bucket{le=\"0.000003\"} 2\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_bucket{le=\"1.048575\"} 2\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_bucket{le=\"2.097151\"} 3\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_bucket{le=\"+Inf\"} 3\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_count 3\n"), std::string::npos);
+    CHECK_NE(text.find("wirectrl_loop_iteration_seconds_sum 1.500003\n"), std::string::npos);
+
+    metrics_page labelled;
+    auto durations = labelled.add_family("wirectrl_request_duration_seconds", "histogram", "Duration.");
+    labelled.add_histogram(durations, "wirectrl_request_duration_seconds", "method=\"set_line\"");
+    auto const& labelled_text = labelled.render();
+    CHECK_NE(labelled_text.find("_bucket{method=\"set_line\",le=\"+Inf\"} 0\n"), std::string::npos);
+    CHECK_NE(labelled_text.find("_sum{method=\"set_line\"} 0\n"), std::string::npos);
+}
+
+TEST_CASE("metrics server answers an HTTP request")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    std::string const path{"/tmp/wirectrl-test-metrics-" + std::to_string(::getpid()) + ".socket"};
+    std::string const page{"x 1\n# EOF\n"};
+    metrics_server server{scheduler, path, [&page]() -> std::string const& { return page; }};
+
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE_GE(fd, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    std::string const request{"GET /metrics HTTP/1.0\r\nHost: localhost\r\n\r\n"};
+    REQUIRE_EQ(::write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+
+    // the server closes the connection after the response
+    std::string response;
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE_GE(sd_event_run(loop.get(), 10000), 0);
+        char buf[256];
+        auto n = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0) {
+            break;
+        }
+        if (n > 0) {
+            response.append(buf, static_cast<std::size_t>(n));
+        }
+    }
+    ::close(fd);
+    CHECK_EQ(response.rfind("HTTP/1.0 200 OK\r\n", 0), 0);
+    CHECK_NE(response.find("Content-Type: application/openmetrics-text"), std::string::npos);
+    CHECK_EQ(response.substr(response.size() - page.size()), page);
+    CHECK_EQ(server.scrapes(), 1);
+}
+
+TEST_CASE("metrics server closes connections after the connection timeout")
+{
+    auto loop = core::sd_event_loop::create();
+    core::event_scheduler scheduler{loop};
+    std::string const path{"/tmp/wirectrl-test-metrics-" + std::to_string(::getpid()) + ".socket"};
+    std::string const page{"x 1\n# EOF\n"};
+    metrics_server server{scheduler, path, [&page]() -> std::string const& { return page; }, 20000};
+
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE_GE(fd, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    // an incomplete request, the client never finishes it
+    std::string const request{"GET /metrics HTTP/1.0\r\n"};
+    REQUIRE_EQ(::write(fd, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+
+    bool closed{false};
+    for (int i = 0; i < 100 && !closed; ++i) {
+        REQUIRE_GE(sd_event_run(loop.get(), 10000), 0);
+        char buf[256];
+        closed = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) == 0;
+    }
+    ::close(fd);
+    CHECK(closed);
+    CHECK_EQ(server.timeouts(), 1);
+    CHECK_EQ(server.scrapes(), 0);
+}
@@ -0,0 +1,60 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "rules.h"
+
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("rule table dispatch")
+{
+    std::vector<rule_table::rule> rules{
+        {3, {1, gpio::edge::rising, gpio::level::active, 500}},
+        {0, {2, gpio::edge::both, gpio::level::inactive, 0}},
+        {3, {2, gpio::edge::falling, gpio::level::active, 0}},
+    };
+    rule_table table{rules, 4};
+    CHECK_EQ(table.size(), 3);
+
+    auto [first, last] = table.actions(3);
+    REQUIRE_EQ(last - first, 2);
+    CHECK_EQ(table[first].output, 1);
+    CHECK_EQ(table[first].duration_ms, 500);
+    CHECK_EQ(table[first + 1].output, 2);
+
+    auto range0 = table.actions(0);
+    REQUIRE_EQ(range0.second - range0.first, 1);
+    CHECK_EQ(table[range0.first].edge, gpio::edge::both);
+
+    auto range1 = table.actions(1);
+    CHECK_EQ(range1.first, range1.second);
+    auto range_unknown = table.actions(17);
+    CHECK_EQ(range_unknown.first, range_unknown.second);
+
+    CHECK(rule_table{}.empty());
+    CHECK_THROWS_AS(rule_table({{4, {0, gpio::edge::both, gpio::level::active, 0}}}, 4), std::out_of_range);
+}
+
+TEST_CASE("rule edge trigger")
+{
+    static_assert(rule_table::triggers(gpio::edge::rising, gpio::level::active));
+    static_assert(!rule_table::triggers(gpio::edge::rising, gpio::level::inactive));
+    static_assert(rule_table::triggers(gpio::edge::falling, gpio::level::inactive));
+    static_assert(!rule_table::triggers(gpio::edge::falling, gpio::level::active));
+    static_assert(rule_table::triggers(gpio::edge::both, gpio::level::active));
+    static_assert(rule_table::triggers(gpio::edge::both, gpio::level::inactive));
+    CHECK(rule_table::triggers(gpio::edge::both, gpio::level::inactive));
+}
@@ -0,0 +1,65 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "string_pool.h"
+
+#include <string>
+#include <vector>
+
+TEST_CASE("string pool interns every string once")
+{
+    string_pool pool;
+    CHECK_EQ(pool.find("led"), string_pool::npos);
+    auto led = pool.intern("led");
+    auto relay = pool.intern("relay");
+    CHECK_NE(led, relay);
+    CHECK_EQ(pool.intern(std::string{"led"}), led);
+    CHECK_EQ(pool.find("relay"), relay);
+    CHECK_EQ(pool.size(), 2);
+    CHECK_EQ(pool.view(relay), "relay");
+    CHECK_EQ(std::string{pool.c_str(led)}, "led");
+
+    auto empty = pool.intern("");
+    CHECK_EQ(pool.view(empty), "");
+    CHECK_EQ(pool.find(""), empty);
+
+    pool.clear();
+    CHECK_EQ(pool.size(), 0);
+    CHECK_EQ(pool.find("led"), string_pool::npos);
+}
+
+TEST_CASE("string pool keeps strings in place while it grows")
+{
+    string_pool pool;
+    std::vector<char const*> addresses;
+    for (int i = 0; i < 5000; ++i) {
+        addresses.push_back(pool.c_str(pool.intern("line" + std::to_string(i))));
+    }
+    std::string const long_name(10000, 'x');
+    auto long_id = pool.intern(long_name);
+    auto after_long = pool.intern("after-long");
+
+    for (int i = 0; i < 5000; ++i) {
+        auto name = "line" + std::to_string(i);
+        auto id = pool.find(name);
+        REQUIRE_NE(id, string_pool::npos);
+        CHECK_EQ(pool.c_str(id), addresses[static_cast<std::size_t>(i)]);
+        CHECK_EQ(std::string{pool.c_str(id)}, name);
+    }
+    CHECK_EQ(pool.view(long_id), long_name);
+    CHECK_EQ(pool.view(after_long), "after-long");
+    CHECK_GE(pool.memory_usage(), long_name.size());
+}
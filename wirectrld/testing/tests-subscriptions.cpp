@@ -0,0 +1,108 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#include <doctest/doctest.h>
+#include "subscriptions.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    std::vector<bool> lines_of(std::size_t count, std::vector<std::size_t> const& lines)
+    {
+        std::vector<bool> v(count, false);
+        for (auto l : lines) {
+            v[l] = true;
+        }
+        return v;
+    }
+
+    std::vector<std::pair<std::string, std::vector<std::size_t>>> changed(subscription_table& table,
+                                                                           std::vector<std::size_t> const& lines)
+    {
+        std::vector<std::pair<std::string, std::vector<std::size_t>>> calls;
+        table.for_each_changed(lines, [&calls](std::string const& owner, std::vector<std::size_t> const& l) {
+            calls.emplace_back(owner, l);
+        });
+        return calls;
+    }
+
+} // namespace
+
+TEST_CASE("subscription_table filters changed lines per subscriber")
+{
+    subscription_table table;
+    auto a = table.add(":1.1", lines_of(4, {0, 2}));
+    auto b = table.add(":1.2", lines_of(4, {0, 1, 2, 3}));
+    CHECK_NE(a, 0);
+    CHECK_NE(b, 0);
+    CHECK_NE(a, b);
+
+    auto calls = changed(table, {1, 2});
+    REQUIRE_EQ(calls.size(), 2);
+    CHECK_EQ(calls[0].first, ":1.1");
+    CHECK_EQ(calls[0].second, std::vector<std::size_t>{2});
+    CHECK_EQ(calls[1].first, ":1.2");
+    CHECK_EQ(calls[1].second, (std::vector<std::size_t>{1, 2}));
+
+    calls = changed(table, {3});
+    REQUIRE_EQ(calls.size(), 1);
+    CHECK_EQ(calls[0].first, ":1.2");
+}
+
+TEST_CASE("subscription_table removes subscriptions of their owner only")
+{
+    subscription_table table;
+    auto a = table.add(":1.1", lines_of(2, {0}));
+    table.add(":1.1", lines_of(2, {1}));
+    auto b = table.add(":1.2", lines_of(2, {0}));
+
+    CHECK_FALSE(table.remove(a, ":1.2"));
+    CHECK_FALSE(table.remove(12345, ":1.1"));
+    CHECK(table.remove(a, ":1.1"));
+    CHECK_FALSE(table.remove(a, ":1.1"));
+    CHECK_EQ(table.size(), 2);
+
+    // the bus name left the bus
+    table.add(":1.1", lines_of(2, {0}));
+    table.forget(":1.1");
+    CHECK_EQ(table.count(":1.1"), 0);
+    CHECK_EQ(table.size(), 1);
+    auto calls = changed(table, {0, 1});
+    REQUIRE_EQ(calls.size(), 1);
+    CHECK_EQ(calls[0].first, ":1.2");
+    CHECK(table.remove(b, ":1.2"));
+    CHECK(changed(table, {0}).empty());
+}
+
+TEST_CASE("subscription_table limits subscriptions per owner and in total")
+{
+    subscription_table table;
+    for (std::size_t i = 0; i < subscription_table::max_per_owner; ++i) {
+        CHECK_NE(table.add(":1.1", lines_of(1, {0})), 0);
+    }
+    CHECK_EQ(table.add(":1.1", lines_of(1, {0})), 0);
+    CHECK_NE(table.add(":1.2", lines_of(1, {0})), 0);
+
+    subscription_table full;
+    for (std::size_t i = 0; i < subscription_table::max_total; ++i) {
+        REQUIRE_NE(full.add(":1." + std::to_string(i), lines_of(1, {0})), 0);
+    }
+    CHECK_EQ(full.add(":2.0", lines_of(1, {0})), 0);
+    full.forget(":1.0");
+    CHECK_NE(full.add(":2.0", lines_of(1, {0})), 0);
+}
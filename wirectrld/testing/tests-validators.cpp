@@ -0,0 +1,132 @@
+// wirectrl is a daemon for systemd to control GPIO ports of raspberry pi
+// Copyright (C) 2020 Alexander Seifarth
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <doctest/doctest.h>
+#include <core/ini.h>
+#include "validators.h"
+
+#include <chrono>
+#include <regex>
+#include <sstream>
+#include <string>
+
+TEST_CASE("validate dbus names")
+{
+    CHECK(validate::dbus_connection_name("de.titnc.pi.wirectrl"));
+    CHECK_FALSE(validate::dbus_connection_name("de.titnc.pi.wirectrl."));
+    CHECK_FALSE(validate::dbus_connection_name("de.Titnc"));
+    CHECK(validate::dbus_object_name("/de/titnc/pi/wirectrl/v1"));
+    CHECK_FALSE(validate::dbus_object_name("/de/titnc/pi/wirectrl/v1/"));
+    CHECK_FALSE(validate::dbus_object_name("de/titnc"));
+    CHECK(validate::boolean("false"));
+    CHECK_FALSE(validate::boolean("no"));
+    CHECK(validate::unix_socket_path("/run/wirectrl/peer.socket"));
+    CHECK_FALSE(validate::unix_socket_path("/run/" + std::string(120, 'a')));
+}
+
+TEST_CASE("validate gpio line spec")
+{
+    validate::line_spec spec{};
+    REQUIRE(validate::gpio_line_spec("gpiochip0-17", spec));
+    CHECK_EQ(spec.chip, "gpiochip0");
+    CHECK_EQ(spec.line, 17);
+
+    REQUIRE(validate::gpio_line_spec("pinctrl-bcm2711-4", spec));
+    CHECK_EQ(spec.chip, "pinctrl-bcm2711");
+    CHECK_EQ(spec.line, 4);
+
+    CHECK_FALSE(validate::gpio_line_spec("gpiochip0", spec));
+    CHECK_FALSE(validate::gpio_line_spec("gpiochip0-", spec));
+    CHECK_FALSE(validate::gpio_line_spec("gpiochip0-x", spec));
+}
+
+TEST_CASE("validators benchmark against std::regex")
+{
+    constexpr int section_count{10000};
+    std::ostringstream txt;
+    txt << "[dbus]\nconnection-id = \"de.titnc.pi.wirectrl\"\nobject-id = /de/titnc/pi/wirectrl/v1\n"
+        << "use-session-bus = false\n";
+    for (int i = 0; i < section_count; ++i) {
+        txt << "[gpio = gpiochip" << i % 4 << "-" << i << "]\nname = \"line" << i << "\"\n";
+    }
+    std::istringstream istr{txt.str()};
+    core::ini::file f{istr};
+    REQUIRE_EQ(f.sections().size(), section_count + 1);
+
+    using clock = std::chrono::steady_clock;
+
+    // the former implementation: dbus regexes are built per dbus section, the line spec regex once
+    std::size_t regex_matches{0};
+    auto regex_start = clock::now();
+    static std::regex const gpio_line_spec_regex{R"((.+)\-([0-9]+))"};
+    for (auto const& s : f.sections()) {
+        if (s.name == "dbus") {
+            std::regex connection_name_regex{R"(([a-z0-9_]+)(\.[a-z0-9_]+)*)"};
+            std::regex object_name_regex{R"((/[a-z0-9_]+)(/[a-z0-9_]+)*)"};
+            std::regex use_session_bus_regex{R"(true|false)"};
+            if (std::regex_match(s.properties[0].value, connection_name_regex)) {
+                ++regex_matches;
+            }
+            if (std::regex_match(s.properties[1].value, object_name_regex)) {
+                ++regex_matches;
+            }
+            if (std::regex_match(s.properties[2].value, use_session_bus_regex)) {
+                ++regex_matches;
+            }
+        }
+        else {
+            std::match_results<std::pmr::string::const_iterator> m;
+            if (std::regex_match(s.value, m, gpio_line_spec_regex)
+                && static_cast<std::size_t>(std::stoi(m[2])) == regex_matches - 3) {
+                ++regex_matches;
+            }
+        }
+    }
+    auto regex_duration = clock::now() - regex_start;
+
+    std::size_t matcher_matches{0};
+    auto matcher_start = clock::now();
+    for (auto const& s : f.sections()) {
+        if (s.name == "dbus") {
+            if (validate::dbus_connection_name(s.properties[0].value)) {
+                ++matcher_matches;
+            }
+            if (validate::dbus_object_name(s.properties[1].value)) {
+                ++matcher_matches;
+            }
+            if (validate::boolean(s.properties[2].value)) {
+                ++matcher_matches;
+            }
+        }
+        else {
+            validate::line_spec spec{};
+            if (validate::gpio_line_spec(s.value, spec) && spec.line == matcher_matches - 3) {
+                ++matcher_matches;
+            }
+        }
+    }
+    auto matcher_duration = clock::now() - matcher_start;
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    MESSAGE("std::regex: " << duration_cast<microseconds>(regex_duration).count() << "us, "
+            << "validators: " << duration_cast<microseconds>(matcher_duration).count() << "us "
+            << "(" << section_count << " gpio sections)");
+
+    CHECK_EQ(regex_matches, section_count + 3);
+    CHECK_EQ(matcher_matches, regex_matches);
+    CHECK_LT(matcher_duration, regex_duration);
+}